@@ -0,0 +1,157 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[debounce_test]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/cpu.h>
+#include <kernel/init.h>
+#include <string.h>
+#include <key/debounce.h>
+
+#define DEBOUNCE_TEST_HZ    1000
+#define DEBOUNCE_TEST_MS    5
+#define DEBOUNCE_TEST_LOOPS 10000
+
+/* a trace is a list of (level, scans) runs sampled at DEBOUNCE_TEST_HZ */
+struct debounce_run {
+    uint8_t level;
+    uint16_t scans;
+};
+
+struct debounce_trace {
+    const char *name;
+    const struct debounce_run *run;
+    int nr_run;
+    int presses;
+    int max_ms;
+};
+
+/* synthetic traces written by hand, shaped like switch bounce at a 1 kHz scan */
+static const struct debounce_run trace_clean[] = {
+    {0, 10}, {1, 60}, {0, 40},
+};
+
+static const struct debounce_run trace_bouncy[] = {
+    {0, 5}, {1, 1}, {0, 1}, {1, 2}, {0, 1}, {1, 40},
+    {0, 1}, {1, 1}, {0, 1}, {1, 1}, {0, 30},
+};
+
+static const struct debounce_run trace_fast[] = {
+    {0, 5}, {1, 1}, {0, 2}, {1, 20}, {0, 1}, {1, 1}, {0, 25},
+    {1, 1}, {0, 1}, {1, 18}, {0, 2}, {1, 1}, {0, 30},
+};
+
+/* max_ms is the longest bounce of the trace plus the lockout time */
+#define DEBOUNCE_TRACE(_name, _presses, _max_ms) \
+    { #_name, _name, sizeof(_name) / sizeof(_name[0]), _presses, _max_ms }
+
+static const struct debounce_trace traces[] = {
+    DEBOUNCE_TRACE(trace_clean, 1, DEBOUNCE_TEST_MS),
+    DEBOUNCE_TRACE(trace_bouncy, 1, 5 + DEBOUNCE_TEST_MS),
+    DEBOUNCE_TRACE(trace_fast, 2, 3 + DEBOUNCE_TEST_MS),
+};
+
+static const char *type_name[] = {
+    [DEBOUNCE_SYM_DEFER] = "sym_defer",
+    [DEBOUNCE_EAGER] = "eager",
+    [DEBOUNCE_ASYM] = "asym",
+};
+
+/*
+ * Replay a trace on key 0 and key 40 and count the reported edges. The
+ * latency is from the first raw edge away from the reported state to the
+ * reported edge, an excursion that settles back for the lockout time is a
+ * bounce and does not count.
+ */
+static int debounce_test_trace(enum debounce_type type, const struct debounce_trace *trace)
+{
+    struct debounce db;
+    uint32_t raw[2], state[2];
+    int edges = 0, raw_edge = -1, max_latency = 0;
+    int i, n, scan = 0, same = 0;
+    int level, reported = 0;
+    bool ok;
+
+    debounce_init(&db, type, DEBOUNCE_MAX_KEYS, DEBOUNCE_TEST_MS, DEBOUNCE_TEST_HZ);
+
+    for (i = 0; i < trace->nr_run; i++) {
+        for (n = 0; n < trace->run[i].scans; n++, scan++) {
+            level = trace->run[i].level;
+            if (level != reported) {
+                same = 0;
+                if (raw_edge < 0)
+                    raw_edge = scan;
+            } else if (++same >= DEBOUNCE_TEST_MS * DEBOUNCE_TEST_HZ / 1000) {
+                raw_edge = -1;
+            }
+            raw[0] = level ? 1 << 0 : 0;
+            raw[1] = level ? 1 << (40 - 32) : 0;
+            debounce_update(&db, raw, state);
+
+            if (((state[1] >> (40 - 32)) & 1) != (state[0] & 1)) {
+                pr_err("%s %s: key 0 and key 40 differ at scan %d\r\n",
+                       type_name[type], trace->name, scan);
+                return -EINVAL;
+            }
+            if ((int)(state[0] & 1) != reported) {
+                reported = state[0] & 1;
+                edges++;
+                if (raw_edge >= 0 && scan - raw_edge > max_latency)
+                    max_latency = scan - raw_edge;
+                raw_edge = -1;
+            }
+        }
+    }
+
+    ok = edges == trace->presses * 2 && reported == 0 &&
+         max_latency * 1000 / DEBOUNCE_TEST_HZ <= trace->max_ms;
+    pr_info("%s %s: edges %d/%d, max latency %dms %s\r\n", type_name[type], trace->name,
+            edges, trace->presses * 2, max_latency * 1000 / DEBOUNCE_TEST_HZ,
+            ok ? "ok" : "FAIL");
+
+    return ok ? 0 : -EINVAL;
+}
+
+static void debounce_test_speed(enum debounce_type type)
+{
+    struct debounce db;
+    uint32_t raw[2] = { 0 }, state[2];
+    u64 start;
+    int i;
+
+    debounce_init(&db, type, DEBOUNCE_MAX_KEYS, DEBOUNCE_TEST_MS, DEBOUNCE_TEST_HZ);
+    start = cpu_run_time_us();
+    for (i = 0; i < DEBOUNCE_TEST_LOOPS; i++) {
+        /* keep a few keys bouncing so the counters run */
+        raw[0] = (i & 1) ? 0x0f0f0f0f : 0;
+        debounce_update(&db, raw, state);
+    }
+    pr_info("%s: %uns per 64 key scan\r\n", type_name[type],
+            (u32)((cpu_run_time_us() - start) * 1000 / DEBOUNCE_TEST_LOOPS));
+}
+
+static int debounce_test_init(void)
+{
+    int type, i, fail = 0;
+
+    for (type = DEBOUNCE_SYM_DEFER; type <= DEBOUNCE_ASYM; type++) {
+        for (i = 0; i < (int)(sizeof(traces) / sizeof(traces[0])); i++) {
+            if (debounce_test_trace(type, &traces[i]) < 0)
+                fail++;
+        }
+        debounce_test_speed(type);
+    }
+    pr_info("%d failed\r\n", fail);
+
+    return 0;
+}
+task_init(debounce_test_init);
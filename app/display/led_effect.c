@@ -0,0 +1,384 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[LED_EFFECT]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <string.h>
+#include <display/led_effect.h>
+
+/*
+ * All of the math is fixed point: phases, hues and levels are Q8 turns or
+ * fractions, the key levels and the column step are Q16. Sine and the hue
+ * circle are tables, a pixel is a few multiplies and no division. The time
+ * of a frame is the start of its slot, so every pixel of a frame is drawn
+ * at the same time and the effects keep their speed at any rate.
+ *
+ * The render time is kept as a running average. When it would take more
+ * than the budget gives for a second at the full rate, the rate is lowered
+ * so the cpu time a second stays the same, and it goes back up after a
+ * second of frames that fit a higher one.
+ */
+
+static const uint8_t led_sin8[256] = {
+    128, 131, 134, 137, 140, 144, 147, 150, 153, 156, 159, 162, 165, 168, 171, 174,
+    177, 179, 182, 185, 188, 191, 193, 196, 199, 201, 204, 206, 209, 211, 213, 216,
+    218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 239, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+    255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+    245, 244, 243, 241, 240, 239, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 216, 213, 211, 209, 206, 204, 201, 199, 196, 193, 191, 188, 185, 182, 179,
+    177, 174, 171, 168, 165, 162, 159, 156, 153, 150, 147, 144, 140, 137, 134, 131,
+    128, 125, 122, 119, 116, 112, 109, 106, 103, 100,  97,  94,  91,  88,  85,  82,
+     79,  77,  74,  71,  68,  65,  63,  60,  57,  55,  52,  50,  47,  45,  43,  40,
+     38,  36,  34,  32,  30,  28,  26,  24,  22,  21,  19,  17,  16,  15,  13,  12,
+     11,  10,   8,   7,   6,   6,   5,   4,   3,   3,   2,   2,   2,   1,   1,   1,
+      1,   1,   1,   1,   2,   2,   2,   3,   3,   4,   5,   6,   6,   7,   8,  10,
+     11,  12,  13,  15,  16,  17,  19,  21,  22,  24,  26,  28,  30,  32,  34,  36,
+     38,  40,  43,  45,  47,  50,  52,  55,  57,  60,  63,  65,  68,  71,  74,  77,
+     79,  82,  85,  88,  91,  94,  97, 100, 103, 106, 109, 112, 116, 119, 122, 125,
+};
+
+static const uint8_t led_hue_rgb[256][3] = {
+    {255, 0, 0}, {255, 6, 0}, {255, 12, 0}, {255, 18, 0}, {255, 24, 0}, {255, 30, 0},
+    {255, 36, 0}, {255, 42, 0}, {255, 48, 0}, {255, 54, 0}, {255, 60, 0}, {255, 66, 0},
+    {255, 72, 0}, {255, 78, 0}, {255, 84, 0}, {255, 90, 0}, {255, 96, 0}, {255, 102, 0},
+    {255, 108, 0}, {255, 114, 0}, {255, 120, 0}, {255, 126, 0}, {255, 131, 0}, {255, 137, 0},
+    {255, 143, 0}, {255, 149, 0}, {255, 155, 0}, {255, 161, 0}, {255, 167, 0}, {255, 173, 0},
+    {255, 179, 0}, {255, 185, 0}, {255, 191, 0}, {255, 197, 0}, {255, 203, 0}, {255, 209, 0},
+    {255, 215, 0}, {255, 221, 0}, {255, 227, 0}, {255, 233, 0}, {255, 239, 0}, {255, 245, 0},
+    {255, 251, 0}, {253, 255, 0}, {247, 255, 0}, {241, 255, 0}, {235, 255, 0}, {229, 255, 0},
+    {223, 255, 0}, {217, 255, 0}, {211, 255, 0}, {205, 255, 0}, {199, 255, 0}, {193, 255, 0},
+    {187, 255, 0}, {181, 255, 0}, {175, 255, 0}, {169, 255, 0}, {163, 255, 0}, {157, 255, 0},
+    {151, 255, 0}, {145, 255, 0}, {139, 255, 0}, {133, 255, 0}, {127, 255, 0}, {122, 255, 0},
+    {116, 255, 0}, {110, 255, 0}, {104, 255, 0}, {98, 255, 0}, {92, 255, 0}, {86, 255, 0},
+    {80, 255, 0}, {74, 255, 0}, {68, 255, 0}, {62, 255, 0}, {56, 255, 0}, {50, 255, 0},
+    {44, 255, 0}, {38, 255, 0}, {32, 255, 0}, {26, 255, 0}, {20, 255, 0}, {14, 255, 0},
+    {8, 255, 0}, {2, 255, 0}, {0, 255, 4}, {0, 255, 10}, {0, 255, 16}, {0, 255, 22},
+    {0, 255, 28}, {0, 255, 34}, {0, 255, 40}, {0, 255, 46}, {0, 255, 52}, {0, 255, 58},
+    {0, 255, 64}, {0, 255, 70}, {0, 255, 76}, {0, 255, 82}, {0, 255, 88}, {0, 255, 94},
+    {0, 255, 100}, {0, 255, 106}, {0, 255, 112}, {0, 255, 118}, {0, 255, 124}, {0, 255, 129},
+    {0, 255, 135}, {0, 255, 141}, {0, 255, 147}, {0, 255, 153}, {0, 255, 159}, {0, 255, 165},
+    {0, 255, 171}, {0, 255, 177}, {0, 255, 183}, {0, 255, 189}, {0, 255, 195}, {0, 255, 201},
+    {0, 255, 207}, {0, 255, 213}, {0, 255, 219}, {0, 255, 225}, {0, 255, 231}, {0, 255, 237},
+    {0, 255, 243}, {0, 255, 249}, {0, 255, 255}, {0, 249, 255}, {0, 243, 255}, {0, 237, 255},
+    {0, 231, 255}, {0, 225, 255}, {0, 219, 255}, {0, 213, 255}, {0, 207, 255}, {0, 201, 255},
+    {0, 195, 255}, {0, 189, 255}, {0, 183, 255}, {0, 177, 255}, {0, 171, 255}, {0, 165, 255},
+    {0, 159, 255}, {0, 153, 255}, {0, 147, 255}, {0, 141, 255}, {0, 135, 255}, {0, 129, 255},
+    {0, 124, 255}, {0, 118, 255}, {0, 112, 255}, {0, 106, 255}, {0, 100, 255}, {0, 94, 255},
+    {0, 88, 255}, {0, 82, 255}, {0, 76, 255}, {0, 70, 255}, {0, 64, 255}, {0, 58, 255},
+    {0, 52, 255}, {0, 46, 255}, {0, 40, 255}, {0, 34, 255}, {0, 28, 255}, {0, 22, 255},
+    {0, 16, 255}, {0, 10, 255}, {0, 4, 255}, {2, 0, 255}, {8, 0, 255}, {14, 0, 255},
+    {20, 0, 255}, {26, 0, 255}, {32, 0, 255}, {38, 0, 255}, {44, 0, 255}, {50, 0, 255},
+    {56, 0, 255}, {62, 0, 255}, {68, 0, 255}, {74, 0, 255}, {80, 0, 255}, {86, 0, 255},
+    {92, 0, 255}, {98, 0, 255}, {104, 0, 255}, {110, 0, 255}, {116, 0, 255}, {122, 0, 255},
+    {128, 0, 255}, {133, 0, 255}, {139, 0, 255}, {145, 0, 255}, {151, 0, 255}, {157, 0, 255},
+    {163, 0, 255}, {169, 0, 255}, {175, 0, 255}, {181, 0, 255}, {187, 0, 255}, {193, 0, 255},
+    {199, 0, 255}, {205, 0, 255}, {211, 0, 255}, {217, 0, 255}, {223, 0, 255}, {229, 0, 255},
+    {235, 0, 255}, {241, 0, 255}, {247, 0, 255}, {253, 0, 255}, {255, 0, 251}, {255, 0, 245},
+    {255, 0, 239}, {255, 0, 233}, {255, 0, 227}, {255, 0, 221}, {255, 0, 215}, {255, 0, 209},
+    {255, 0, 203}, {255, 0, 197}, {255, 0, 191}, {255, 0, 185}, {255, 0, 179}, {255, 0, 173},
+    {255, 0, 167}, {255, 0, 161}, {255, 0, 155}, {255, 0, 149}, {255, 0, 143}, {255, 0, 137},
+    {255, 0, 131}, {255, 0, 126}, {255, 0, 120}, {255, 0, 114}, {255, 0, 108}, {255, 0, 102},
+    {255, 0, 96}, {255, 0, 90}, {255, 0, 84}, {255, 0, 78}, {255, 0, 72}, {255, 0, 66},
+    {255, 0, 60}, {255, 0, 54}, {255, 0, 48}, {255, 0, 42}, {255, 0, 36}, {255, 0, 30},
+    {255, 0, 24}, {255, 0, 18}, {255, 0, 12}, {255, 0, 6},
+};
+
+static struct led_effect *g_led_effect;
+
+static const struct led_effect_param g_led_effect_param[LED_EFFECT_NUM] = {
+    [LED_EFFECT_OFF] = { 0, 0, 0, 0 },
+    [LED_EFFECT_BREATH] = { 160, 255, 255, 3000 },
+    [LED_EFFECT_WAVE] = { 96, 255, 255, 2000 },
+    [LED_EFFECT_REACTIVE] = { 0, 255, 255, 500 },
+    [LED_EFFECT_GRADIENT] = { 0, 255, 255, 720 },
+};
+
+/* 255 * 255 is 255 */
+static inline uint8_t led_q8_mul(uint8_t a, uint8_t b)
+{
+    return (a * (b + 1)) >> 8;
+}
+
+static inline uint8_t led_effect_channel(uint8_t c, uint8_t white, uint8_t val)
+{
+    return led_q8_mul(c + led_q8_mul(255 - c, white), val);
+}
+
+static void led_effect_hsv(uint8_t *dst, uint8_t hue, uint8_t sat, uint8_t val)
+{
+    const uint8_t *c = led_hue_rgb[hue];
+    uint8_t white = 255 - sat;
+
+    dst[DS_COLOR_R] = led_effect_channel(c[0], white, val);
+    dst[DS_COLOR_G] = led_effect_channel(c[1], white, val);
+    dst[DS_COLOR_B] = led_effect_channel(c[2], white, val);
+}
+
+/* Q8 turn of the cycle ms is in */
+static inline uint8_t led_effect_phase(uint32_t ms, uint16_t period_ms)
+{
+    if (period_ms == 0)
+        return 0;
+
+    return ((ms % period_ms) << 8) / period_ms;
+}
+
+/* takes the presses queued since the last frame and fades the rest */
+static void led_effect_keys(struct led_effect *fx, uint32_t ms)
+{
+    uint32_t period = fx->param[LED_EFFECT_REACTIVE].period_ms;
+    uint32_t dt = ms - fx->last_ms;
+    struct key_event ev;
+    uint16_t fade;
+    int i;
+
+    fx->last_ms = ms;
+    if (period == 0)
+        fade = 0xffff;
+    else
+        fade = min_t(uint32_t, (min_t(uint32_t, dt, period) << 16) / period, 0xffff);
+    for (i = 0; i < LED_EFFECT_MAX_KEYS; i++)
+        fx->heat[i] = fx->heat[i] > fade ? fx->heat[i] - fade : 0;
+
+    while (key_event_pop(&fx->queue, &ev)) {
+        if (ev.key < LED_EFFECT_MAX_KEYS)
+            fx->heat[ev.key] = 0xffff;
+    }
+}
+
+/* a press turns the hue a quarter as it fades */
+static void led_effect_react(struct led_effect *fx, uint8_t *dst, uint16_t heat)
+{
+    const struct led_effect_param *p = &fx->param[LED_EFFECT_REACTIVE];
+    uint8_t color[DS_COLOR_DATA_MAX];
+    uint8_t mix = led_q8_mul(heat >> 8, heat >> 8);
+    int i;
+
+    led_effect_hsv(color, p->hue + ((0xffff - heat) >> 10), p->sat, p->val);
+    for (i = 0; i < DS_COLOR_DATA_MAX; i++)
+        dst[i] += ((color[i] - dst[i]) * (mix + 1)) >> 8;
+}
+
+/**
+ * This function will start an effects engine, every pixel is off and the
+ * key events go to this engine from now on.
+ *
+ * @param fx the engine, it must stay valid.
+ * @param width the width of the pixels.
+ * @param height the height of the pixels.
+ * @param key_map the key of each pixel, NULL if no pixel is on a key.
+ * @param fps the full rate, 1 to FRAME_SCHED_FPS_MAX.
+ * @param budget_us the render time a frame may take at the full rate.
+ *
+ * @return 0 on successful, -EINVAL if an argument is out of range.
+ */
+int led_effect_init(struct led_effect *fx, uint16_t width, uint16_t height,
+                    const uint8_t *key_map, uint32_t fps, uint32_t budget_us)
+{
+    if (width == 0 || height == 0 || width * height > LED_EFFECT_MAX_PIXELS) {
+        pr_err("size is out of range, width=%u, height=%u\r\n", width, height);
+        return -EINVAL;
+    }
+    if (fps < LED_EFFECT_FPS_MIN || fps > FRAME_SCHED_FPS_MAX || budget_us == 0) {
+        pr_err("fps or budget is out of range, fps=%u, budget=%uus\r\n", fps, budget_us);
+        return -EINVAL;
+    }
+
+    memset(fx, 0, sizeof(struct led_effect));
+    fx->width = width;
+    fx->height = height;
+    fx->key_map = key_map;
+    memcpy(fx->param, g_led_effect_param, sizeof(fx->param));
+    key_event_queue_init(&fx->queue);
+
+    fx->fps = fps;
+    fx->rate = fps;
+    fx->budget_us = budget_us;
+    fx->cost_avg = budget_us << 4;
+    frame_sched_init(&fx->sched, fps);
+    fx->last_ms = fx->sched.deadline / 1000;
+
+    /* the queue is ready before the keyboard task sees it */
+    smp_wmb();
+    WRITE_ONCE(g_led_effect, fx);
+
+    return 0;
+}
+
+/**
+ * This function will set the effect of the pixels in rect.
+ *
+ * @param fx the engine.
+ * @param rect the pixels, NULL for all of them.
+ * @param type the effect.
+ *
+ * @return 0 on successful, -EINVAL if rect or type is out of range.
+ */
+int led_effect_set(struct led_effect *fx, const struct ds_rect *rect,
+                   enum led_effect_type type)
+{
+    struct ds_rect all = { 0, 0, fx->width, fx->height };
+    int x, y;
+
+    if (rect == NULL)
+        rect = &all;
+    if (type >= LED_EFFECT_NUM || rect->x + rect->width > fx->width ||
+        rect->y + rect->height > fx->height) {
+        pr_err("rect or type is out of range, type=%d\r\n", type);
+        return -EINVAL;
+    }
+
+    for (y = rect->y; y < rect->y + rect->height; y++) {
+        for (x = rect->x; x < rect->x + rect->width; x++)
+            fx->effect[y * fx->width + x] = type;
+    }
+
+    return 0;
+}
+
+int led_effect_set_param(struct led_effect *fx, enum led_effect_type type,
+                         const struct led_effect_param *param)
+{
+    if (type >= LED_EFFECT_NUM) {
+        pr_err("type is out of range, type=%d\r\n", type);
+        return -EINVAL;
+    }
+
+    memcpy(&fx->param[type], param, sizeof(struct led_effect_param));
+
+    return 0;
+}
+
+/* sleeps until the next frame is due */
+void led_effect_wait(struct led_effect *fx)
+{
+    frame_sched_wait(&fx->sched);
+}
+
+/**
+ * This function will draw the frame started by led_effect_wait().
+ *
+ * @param fx the engine.
+ * @param pixels the RGB888 pixels, in DS_COLOR_* order.
+ * @param stride the bytes a row of pixels.
+ */
+void led_effect_render(struct led_effect *fx, uint8_t *pixels, uint16_t stride)
+{
+    const struct led_effect_param *p;
+    uint8_t phase[LED_EFFECT_NUM];
+    uint32_t ms = fx->sched.start / 1000;
+    /* Q16 turn a column, the width is a turn */
+    uint32_t step = (256 << 16) / fx->width;
+    uint32_t col;
+    uint8_t *dst, type, key, off;
+    int i, x, y;
+
+    led_effect_keys(fx, ms);
+    for (i = 0; i < LED_EFFECT_NUM; i++)
+        phase[i] = led_effect_phase(ms, fx->param[i].period_ms);
+
+    for (y = 0, i = 0; y < fx->height; y++) {
+        dst = pixels + y * stride;
+        for (x = 0, col = 0; x < fx->width; x++, i++, col += step, dst += DS_COLOR_DATA_MAX) {
+            type = fx->effect[i];
+            p = &fx->param[type];
+            off = col >> 16;
+            switch (type) {
+            case LED_EFFECT_BREATH:
+                off = led_sin8[phase[type]];
+                led_effect_hsv(dst, p->hue, p->sat, led_q8_mul(p->val, led_q8_mul(off, off)));
+                break;
+            case LED_EFFECT_WAVE:
+                off = led_sin8[(uint8_t)(phase[type] - off)];
+                led_effect_hsv(dst, p->hue, p->sat, led_q8_mul(p->val, off));
+                break;
+            case LED_EFFECT_GRADIENT:
+                led_effect_hsv(dst, p->hue + off - phase[type], p->sat, p->val);
+                break;
+            default:
+                memset(dst, 0, DS_COLOR_DATA_MAX);
+                break;
+            }
+
+            key = fx->key_map ? fx->key_map[i] : LED_EFFECT_NO_KEY;
+            if (key < LED_EFFECT_MAX_KEYS && fx->heat[key] != 0)
+                led_effect_react(fx, dst, fx->heat[key]);
+        }
+    }
+
+    frame_sched_composed(&fx->sched);
+}
+
+static void led_effect_set_rate(struct led_effect *fx, uint32_t fps)
+{
+    pr_info("rate %u -> %u fps, render avg=%uus, budget=%uus\r\n",
+            fx->rate, fps, fx->cost_avg >> 4, fx->budget_us);
+    fx->rate = fps;
+    frame_sched_set_rate(&fx->sched, fps);
+}
+
+/* the rate at which the average render time takes what the budget gives a second */
+static void led_effect_balance(struct led_effect *fx)
+{
+    uint32_t cost = fx->sched.composed - fx->sched.start;
+    uint32_t fps;
+
+    /* over about 8 frames */
+    fx->cost_avg += (cost << 1) - (fx->cost_avg >> 3);
+    fps = min_t(u64, (u64)fx->fps * fx->budget_us * 16 / max_t(uint32_t, fx->cost_avg, 1),
+                fx->fps);
+    fps = max_t(uint32_t, fps, LED_EFFECT_FPS_MIN);
+
+    if (fps < fx->rate) {
+        fx->calm = 0;
+        led_effect_set_rate(fx, fps);
+    } else if (fps > fx->rate && (fps == fx->fps || fps > fx->rate + fx->rate / 8)) {
+        if (++fx->calm >= fx->rate) {
+            fx->calm = 0;
+            led_effect_set_rate(fx, fps);
+        }
+    } else {
+        fx->calm = 0;
+    }
+}
+
+/* ends the frame, after the pixels are handed on */
+void led_effect_done(struct led_effect *fx)
+{
+    frame_sched_done(&fx->sched);
+    led_effect_balance(fx);
+}
+
+void led_effect_dump(struct led_effect *fx)
+{
+    frame_sched_dump(&fx->sched, "led_effect");
+    pr_info("rate=%u/%u fps, render avg=%uus, budget=%uus, keys dropped=%u\r\n",
+            fx->rate, fx->fps, fx->cost_avg >> 4, fx->budget_us, fx->queue.dropped);
+}
+
+/**
+ * This function will queue a key press for the reactive lighting, it is
+ * called from the keyboard task only and never waits.
+ *
+ * @param ev the event, releases are ignored.
+ *
+ * @return false if the queue is full or no engine is running.
+ */
+bool led_effect_post(const struct key_event *ev)
+{
+    struct led_effect *fx = READ_ONCE(g_led_effect);
+
+    if (fx == NULL || !ev->down)
+        return false;
+
+    return key_event_push(&fx->queue, ev);
+}
@@ -22,6 +22,7 @@
 #include <kernel/console.h>
 
 #include <display/display.h>
+#include <display/led_effect.h>
 
 #define LED_WIDTH  14
 #define LED_HEIGHT 5
@@ -31,66 +32,46 @@ struct nk60_display_server {
     struct device *ds_dev;
     struct display_server *ds;
     struct ds_draw_info *draw_info;
+    struct led_effect fx;
 };
 
-#define GRADATION_DATA_MAX 24
-static u8 g_gradation_rgb_data[GRADATION_DATA_MAX][DS_COLOR_DATA_MAX] = {
-    {0, 230, 18}, {97, 235, 0}, {152, 243, 0}, {200, 252, 0}, {251, 255, 0},
-    {219, 207, 0}, {195, 143, 31}, {172, 34, 56}, {153, 0, 68}, {155, 0, 107},
-    {158, 0, 150}, {160, 0, 193}, {160, 0, 233}, {134, 0, 209}, {104, 0, 183},
-    {71, 0, 157}, {32, 29, 136}, {25, 96, 134}, {7, 146, 131}, {0, 190, 129},
-    {0, 228, 127}, {0, 229, 106}, {0, 229, 79}, {0, 230, 51}
+/* key under each led pixel, the wide keys take a few */
+static const uint8_t g_nk60_key_map[LED_WIDTH * LED_HEIGHT] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+    14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,
+    28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 40,
+    41, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 52,
+    53, 54, 55, 56, 56, 56, 56, 56, 56, 56, 57, 58, 59, 60
 };
 
 static int nk60_display_server_draw_info_init(struct nk60_display_server *nk60_ds)
 {
     struct ds_draw_area *area;
-    struct ds_data *data;
-    int i;
+    int rc;
 
-    nk60_ds->draw_info = display_server_alloc_draw_area_info(nk60_ds->ds,
-        0, 0, LED_WIDTH, LED_HEIGHT);
+    nk60_ds->draw_info = display_server_alloc_draw_area_info_format(nk60_ds->ds,
+        0, 0, LED_WIDTH, LED_HEIGHT, DS_FMT_RGB888, 0);
     if (nk60_ds->draw_info == NULL) {
         pr_err("alloc draw_info buf error\r\n");
         return -ENOMEM;
     }
+    /* the effects are the backdrop, overlays go on the layers above */
+    ds_set_draw_info_layer(nk60_ds->ds, nk60_ds->draw_info, BACKGROUND_LAYER, DS_ALPHA_OPAQUE);
     area = &nk60_ds->draw_info->area;
+    memset(area->pixels, 0, area->stride * LED_HEIGHT);
 
-    for (i = 0; i < LED_WIDTH * LED_HEIGHT; i++) {
-        data = &area->data[i];
-        data->data[DS_COLOR_R] = 0;
-        data->data[DS_COLOR_G] = 0;
-        data->data[DS_COLOR_B] = 0;
-    }
-
-    return 0;
-}
-
-static void nk60_display_server_data_update(struct nk60_display_server *nk60_ds)
-{
-    struct ds_draw_area *area;
-    struct ds_data *data;
-    int i;
-    static int index = GRADATION_DATA_MAX;
-    int tmp_index;
+    rc = led_effect_init(&nk60_ds->fx, LED_WIDTH, LED_HEIGHT, g_nk60_key_map,
+                         LED_EFFECT_FPS, LED_EFFECT_BUDGET_US);
+    if (rc < 0)
+        return rc;
 
-    area = &nk60_ds->draw_info->area;
-    index--;
-    if (index < 0)
-        index = GRADATION_DATA_MAX - 1;
-
-    for (i = 0; i < LED_WIDTH * LED_HEIGHT; i++) {
-        tmp_index = (index + (i % LED_WIDTH)) % GRADATION_DATA_MAX;
-        data = &area->data[i];
-        data->data[DS_COLOR_R] = g_gradation_rgb_data[tmp_index][DS_COLOR_R];
-        data->data[DS_COLOR_G] = g_gradation_rgb_data[tmp_index][DS_COLOR_G];
-        data->data[DS_COLOR_B] = g_gradation_rgb_data[tmp_index][DS_COLOR_B];
-    }
+    return led_effect_set(&nk60_ds->fx, NULL, LED_EFFECT_GRADIENT);
 }
 
 static void nk60_display_server_task_entry(void* parameter)
 {
     struct nk60_display_server *nk60_ds = parameter;
+    struct ds_draw_area *area;
     int i;
     int rc;
 
@@ -119,9 +100,12 @@ static void nk60_display_server_task_entry(void* parameter)
         return;
     }
 
+    area = &nk60_ds->draw_info->area;
     while (true) {
-        msleep(30);
-        nk60_display_server_data_update(nk60_ds);
+        led_effect_wait(&nk60_ds->fx);
+        led_effect_render(&nk60_ds->fx, area->pixels, area->stride);
+        ds_commit_draw_info(nk60_ds->ds, nk60_ds->draw_info);
+        led_effect_done(&nk60_ds->fx);
     }
 }
 
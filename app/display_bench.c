@@ -0,0 +1,310 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[display_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <string.h>
+
+#include <display/display.h>
+#include <display/frame_sched.h>
+#include <display/virt_fb.h>
+
+/*
+ * Scenes of the display server against whatever device it drives, on qemu
+ * the virt-fb. Fill redraws the whole frame each frame, rects moves small
+ * rects over nothing so only their damage is drawn, blend moves a half
+ * alpha RGB565 area over a filled background. After a scene the server
+ * stats and the device stats are printed and one frame is dumped. On qemu
+ * the times are of the emulator, only compare them with each other.
+ */
+
+#ifdef CONFIG_DISPLAY_BENCH_FPS
+#define DISPLAY_BENCH_FPS CONFIG_DISPLAY_BENCH_FPS
+#else
+#define DISPLAY_BENCH_FPS 50
+#endif
+#define DISPLAY_BENCH_SEC   5
+#define DISPLAY_BENCH_RECTS 8
+#define DISPLAY_BENCH_RECT  16
+
+enum display_bench_scene {
+    BENCH_FILL,
+    BENCH_RECTS,
+    BENCH_BLEND,
+    BENCH_NUM,
+};
+
+static const char *scene_name[] = {
+    [BENCH_FILL] = "fill",
+    [BENCH_RECTS] = "rects",
+    [BENCH_BLEND] = "blend",
+};
+
+struct display_bench {
+    struct task_struct *task;
+    struct device *ds_dev;
+    struct display_server *ds;
+    struct device *fb_dev;
+    struct display_dev_info dev_info;
+    struct ds_draw_info *bg;
+    struct ds_draw_info *overlay;
+    struct frame_sched fs;
+    uint32_t frame;
+};
+
+/* 0 to len and back, for a bounce */
+static uint16_t display_bench_bounce(uint32_t pos, uint16_t len)
+{
+    if (len == 0)
+        return 0;
+    pos %= 2 * len;
+
+    return pos < len ? pos : 2 * len - pos;
+}
+
+static void display_bench_color(uint8_t *color, uint32_t n)
+{
+    color[DS_COLOR_R] = n * 7;
+    color[DS_COLOR_G] = n * 3 + 85;
+    color[DS_COLOR_B] = 255 - n * 5;
+}
+
+static void display_bench_fill(struct display_bench *db, uint32_t n)
+{
+    struct ds_rect screen = {0, 0, db->dev_info.width, db->dev_info.height};
+    uint8_t color[DS_COLOR_DATA_MAX];
+
+    display_bench_color(color, n);
+    ds_cmd_begin(db->bg);
+    ds_cmd_fill_rect(db->bg, &screen, color);
+    ds_cmd_submit(db->ds, db->bg);
+}
+
+static void display_bench_rects(struct display_bench *db)
+{
+    uint16_t w = db->dev_info.width - DISPLAY_BENCH_RECT;
+    uint16_t h = db->dev_info.height - DISPLAY_BENCH_RECT;
+    uint8_t color[DS_COLOR_DATA_MAX];
+    struct ds_rect r;
+    int i;
+
+    ds_cmd_begin(db->bg);
+    for (i = 0; i < DISPLAY_BENCH_RECTS; i++) {
+        r.x = display_bench_bounce(db->frame * (i + 1) + i * 37, w);
+        r.y = display_bench_bounce(db->frame * (DISPLAY_BENCH_RECTS - i) + i * 11, h);
+        r.width = DISPLAY_BENCH_RECT;
+        r.height = DISPLAY_BENCH_RECT;
+        display_bench_color(color, i * 32);
+        ds_cmd_fill_rect(db->bg, &r, color);
+    }
+    ds_cmd_submit(db->ds, db->bg);
+}
+
+static int display_bench_overlay_init(struct display_bench *db)
+{
+    uint16_t width = db->dev_info.width / 2;
+    uint16_t height = db->dev_info.height / 2;
+    struct ds_draw_area *area;
+    uint16_t *row;
+    int x, y;
+
+    db->overlay = display_server_alloc_draw_area_info_format(db->ds, 0, 0, width, height,
+                                                             DS_FMT_RGB565, 0);
+    if (db->overlay == NULL)
+        return -ENOMEM;
+
+    area = &db->overlay->area;
+    mutex_lock(&db->overlay->lock);
+    for (y = 0; y < height; y++) {
+        row = (uint16_t *)(area->pixels + y * area->stride);
+        for (x = 0; x < width; x++)
+            row[x] = ((x * 31 / width) << 11) | ((y * 63 / height) << 5) | 0x10;
+    }
+    mutex_unlock(&db->overlay->lock);
+    ds_set_draw_info_layer(db->ds, db->overlay, TOP_LAYER, 128);
+
+    return 0;
+}
+
+static void display_bench_blend(struct display_bench *db)
+{
+    struct ds_draw_area *area = &db->overlay->area;
+
+    mutex_lock(&db->overlay->lock);
+    area->x = display_bench_bounce(db->frame * 3, db->dev_info.width - area->width);
+    area->y = display_bench_bounce(db->frame * 2, db->dev_info.height - area->height);
+    mutex_unlock(&db->overlay->lock);
+    ds_commit_draw_info(db->ds, db->overlay);
+}
+
+static void display_bench_frame(struct display_bench *db, enum display_bench_scene scene)
+{
+    switch (scene) {
+    case BENCH_FILL:
+        display_bench_fill(db, db->frame);
+        break;
+    case BENCH_RECTS:
+        display_bench_rects(db);
+        break;
+    case BENCH_BLEND:
+        display_bench_blend(db);
+        break;
+    default:
+        break;
+    }
+    db->frame++;
+}
+
+static void display_bench_report(struct display_bench *db, enum display_bench_scene scene,
+                                 const struct ds_stats *start)
+{
+    struct ds_stats stats;
+    struct frame_stats fstats;
+#ifdef CONFIG_VIRT_FB
+    struct virt_fb_stats fb;
+#endif
+
+    db->ds_dev->ops.control(db->ds_dev, DS_CTRL_GET_STATS, &stats);
+    db->ds_dev->ops.control(db->ds_dev, DS_CTRL_GET_FRAME_STATS, &fstats);
+    pr_info("%s: %u frames, %u rects, %u pixels, %u culled, server cpu %u.%02u%%\r\n",
+            scene_name[scene], stats.frames - start->frames, stats.rects - start->rects,
+            stats.pixels - start->pixels, stats.culled_rects - start->culled_rects,
+            stats.cpu_usage / 100, stats.cpu_usage % 100);
+    pr_info("%s: %u.%02u fps, target=%u, dropped=%u, late=%u, p99=%uus, compose=%uus, flush=%uus\r\n",
+            scene_name[scene], fstats.fps_x100 / 100, fstats.fps_x100 % 100,
+            fstats.target_fps, fstats.dropped, fstats.late, fstats.frame_p99_us,
+            fstats.compose_avg_us, fstats.flush_avg_us);
+#ifdef CONFIG_VIRT_FB
+    if (db->fb_dev == NULL)
+        return;
+    db->fb_dev->ops.control(db->fb_dev, VIRT_FB_CTRL_GET_STATS, &fb);
+    pr_info("%s: %s %u frames, %u writes, pixels a frame avg=%u max=%u, empty=%u\r\n",
+            scene_name[scene], VIRT_FB_NAME, fb.frames, fb.writes,
+            fb.frames ? (uint32_t)(fb.total_pixels / fb.frames) : 0, fb.max_pixels, fb.empty);
+#endif
+}
+
+static void display_bench_run(struct display_bench *db, enum display_bench_scene scene)
+{
+    uint32_t fps = DISPLAY_BENCH_FPS;
+    struct ds_stats start;
+    u64 end;
+
+    if (scene == BENCH_BLEND) {
+        display_bench_fill(db, 0);
+        if (display_bench_overlay_init(db) < 0) {
+            pr_err("alloc overlay error\r\n");
+            return;
+        }
+    }
+
+    /* the first frame of the scene is not counted, it clears the last one */
+    display_bench_frame(db, scene);
+    msleep(100);
+    db->ds_dev->ops.control(db->ds_dev, DS_CTRL_SET_FRAME_RATE, &fps);
+    db->ds_dev->ops.control(db->ds_dev, DS_CTRL_GET_STATS, &start);
+    if (db->fb_dev != NULL)
+        db->fb_dev->ops.control(db->fb_dev, VIRT_FB_CTRL_CLEAR_STATS, NULL);
+
+    /* only paces the client, the stats are of the server */
+    frame_sched_init(&db->fs, DISPLAY_BENCH_FPS);
+    end = cpu_run_time_us() + DISPLAY_BENCH_SEC * 1000000ULL;
+    while (cpu_run_time_us() < end) {
+        frame_sched_wait(&db->fs);
+        display_bench_frame(db, scene);
+    }
+    /* the server takes the last frame */
+    msleep(100);
+    display_bench_report(db, scene, &start);
+
+    if (db->fb_dev != NULL) {
+        db->fb_dev->ops.control(db->fb_dev, VIRT_FB_CTRL_DUMP, NULL);
+        display_bench_frame(db, scene);
+        msleep(100);
+    }
+
+    if (scene == BENCH_BLEND) {
+        display_server_free_draw_info(db->ds, db->overlay);
+        db->overlay = NULL;
+    }
+    ds_cmd_begin(db->bg);
+    ds_cmd_submit(db->ds, db->bg);
+}
+
+static void display_bench_task_entry(void* parameter)
+{
+    struct display_bench *db = parameter;
+    int i;
+
+    db->ds_dev = NULL;
+    for (i = 0; i < 100; i ++) {
+        db->ds_dev = device_find_by_name("display-server");
+        if (db->ds_dev == NULL) {
+            i++;
+            pr_err("%s device not found, retry=%d\r\n", "display-server", i);
+            sleep(1);
+            continue;
+        } else {
+            pr_info("%s device found\r\n", "display-server");
+            break;
+        }
+    }
+    if (i >= 100) {
+        pr_err("%s device not found, exit\r\n", "display-server");
+        return;
+    }
+
+    db->ds = display_dev_to_server(db->ds_dev);
+    db->ds_dev->ops.control(db->ds_dev, DS_CTRL_GET_DEV_INFO, &db->dev_info);
+#ifdef CONFIG_VIRT_FB
+    db->fb_dev = device_find_by_name(VIRT_FB_NAME);
+#endif
+    db->bg = display_server_alloc_draw_cmd_info(db->ds,
+                                                DS_CMD_FILL_RECT_SIZE * DISPLAY_BENCH_RECTS);
+    if (db->bg == NULL) {
+        pr_err("alloc draw info error\r\n");
+        return;
+    }
+    ds_set_draw_info_layer(db->ds, db->bg, BACKGROUND_LAYER, DS_ALPHA_OPAQUE);
+    pr_info("display %u*%u, %u fps, %us a scene\r\n", db->dev_info.width,
+            db->dev_info.height, DISPLAY_BENCH_FPS, DISPLAY_BENCH_SEC);
+
+    while (true) {
+        for (i = 0; i < BENCH_NUM; i++)
+            display_bench_run(db, i);
+        sleep(2);
+    }
+}
+
+static int display_bench_init(void)
+{
+    struct display_bench *db;
+
+    db = kzalloc(sizeof(struct display_bench), GFP_KERNEL);
+    if (db == NULL) {
+        pr_err("alloc display_bench buf error\r\n");
+        return -ENOMEM;
+    }
+
+    db->task = task_create("display_bench", display_bench_task_entry, db, 20, 1024, 10, NULL);
+    if (db->task == NULL) {
+        pr_fatal("creat display_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(db->task);
+
+    return 0;
+}
+task_init(display_bench_init);
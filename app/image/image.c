@@ -0,0 +1,569 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[IMAGE]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/cpu.h>
+#include <kernel/mm.h>
+#include <kernel/sem.h>
+#include <string.h>
+#include <display/led.h>
+#include <display/image.h>
+#include <display/pixel_ops.h>
+
+#include "../../fs/fatfs/ff.h"
+
+/*
+ * A reader task fills two chunk buffers in turn with f_read while the
+ * decoder takes bytes from the other one, a buffer goes back to the reader
+ * once the decoder moves on. Only a row of pixels is decoded at a time, so
+ * the image is never in ram as a whole.
+ */
+
+#define IMAGE_READER_PRIO  10
+#define IMAGE_READER_STACK 1024
+
+#define QOI_MAGIC       "qoif"
+#define QOI_OP_INDEX    0x00
+#define QOI_OP_DIFF     0x40
+#define QOI_OP_LUMA     0x80
+#define QOI_OP_RUN      0xc0
+#define QOI_OP_RGB      0xfe
+#define QOI_OP_RGBA     0xff
+#define QOI_MASK_2      0xc0
+#define QOI_HASH(r, g, b, a) (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+
+struct image_stream {
+    FIL file;
+    struct task_struct *reader;
+    /* buffers filled by the reader, and given back by the decoder */
+    sem_t filled;
+    sem_t free;
+    sem_t exit;
+    uint8_t *buf[2];
+    /* bytes in a buffer, 0 at the end of the file */
+    uint16_t len[2];
+    int err;
+    volatile bool stop;
+    size_t stack_used;
+
+    /* decoder side */
+    int cur;
+    bool held;
+    bool eof;
+    const uint8_t *pos;
+    const uint8_t *end;
+    uint32_t bytes;
+    uint32_t wait_us;
+
+    uint8_t index[64][4];
+};
+
+static void image_reader_entry(void *parameter)
+{
+    struct image_stream *is = parameter;
+    FRESULT res;
+    UINT num;
+    int k = 0;
+
+    while (true) {
+        sem_get(&is->free);
+        if (is->stop)
+            break;
+        res = f_read(&is->file, is->buf[k], IMAGE_CHUNK, &num);
+        if (res != FR_OK) {
+            pr_err("read error, res=%d\r\n", res);
+            is->err = -EIO;
+            num = 0;
+        }
+        is->len[k] = num;
+        sem_send_one(&is->filled);
+        if (num == 0)
+            break;
+        k ^= 1;
+    }
+    is->stack_used = task_get_stack_max_used(current);
+    sem_send_one(&is->exit);
+}
+
+/* gives the buffer read out back and takes the next, 0 past the end */
+static uint8_t image_refill(struct image_stream *is)
+{
+    u64 start;
+
+    if (is->eof)
+        return 0;
+    if (is->held)
+        sem_send_one(&is->free);
+
+    start = cpu_run_time_us();
+    sem_get(&is->filled);
+    is->wait_us += cpu_run_time_us() - start;
+    is->cur ^= 1;
+    is->held = true;
+    if (is->len[is->cur] == 0) {
+        is->eof = true;
+        return 0;
+    }
+
+    is->pos = is->buf[is->cur];
+    is->end = is->pos + is->len[is->cur];
+    is->bytes += is->len[is->cur];
+
+    return *is->pos++;
+}
+
+/* a truncated file reads as zeros, it is caught by eof after the row */
+static inline uint8_t image_getc(struct image_stream *is)
+{
+    if (is->pos < is->end)
+        return *is->pos++;
+
+    return image_refill(is);
+}
+
+static uint32_t image_get_be32(struct image_stream *is)
+{
+    uint32_t v = 0;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        v = (v << 8) | image_getc(is);
+
+    return v;
+}
+
+static bool image_magic(struct image_stream *is, const char *magic)
+{
+    bool match = true;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        match &= image_getc(is) == (uint8_t)magic[i];
+
+    return match;
+}
+
+static int image_header(struct image_stream *is, enum image_type type,
+                        uint32_t *width, uint32_t *height)
+{
+    switch (type) {
+    case IMAGE_QOI:
+        if (!image_magic(is, QOI_MAGIC))
+            return -EINVAL;
+        *width = image_get_be32(is);
+        *height = image_get_be32(is);
+        /* channels and colorspace, the alpha is dropped either way */
+        image_getc(is);
+        image_getc(is);
+        break;
+    case IMAGE_RLE:
+        if (!image_magic(is, IMAGE_RLE_MAGIC))
+            return -EINVAL;
+        *width = image_getc(is);
+        *width |= image_getc(is) << 8;
+        *height = image_getc(is);
+        *height |= image_getc(is) << 8;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    if (is->eof || *width == 0 || *width > IMAGE_MAX_WIDTH ||
+        *height == 0 || *height > U16_MAX)
+        return -EINVAL;
+
+    return 0;
+}
+
+static int image_emit(struct image_stream *is, struct image_sink *sink, uint16_t y,
+                      const uint8_t *line, uint16_t width, uint32_t *sink_us)
+{
+    u64 start;
+    int rc;
+
+    if (is->eof)
+        return is->err ? is->err : -EIO;
+
+    start = cpu_run_time_us();
+    rc = sink->line(sink, y, line, width);
+    *sink_us += cpu_run_time_us() - start;
+
+    return rc;
+}
+
+static int image_qoi_decode(struct image_stream *is, struct image_sink *sink, uint8_t *line,
+                            uint16_t width, uint16_t height, uint32_t *sink_us)
+{
+    uint8_t r = 0, g = 0, b = 0, a = 255;
+    uint8_t c, b2, *dst, *p;
+    int run = 0, vg;
+    int x, y, rc;
+
+    memset(is->index, 0, sizeof(is->index));
+    for (y = 0; y < height; y++) {
+        dst = line;
+        for (x = 0; x < width; x++, dst += DS_COLOR_DATA_MAX) {
+            if (run > 0) {
+                run--;
+            } else {
+                c = image_getc(is);
+                if (c == QOI_OP_RGB) {
+                    r = image_getc(is);
+                    g = image_getc(is);
+                    b = image_getc(is);
+                } else if (c == QOI_OP_RGBA) {
+                    r = image_getc(is);
+                    g = image_getc(is);
+                    b = image_getc(is);
+                    a = image_getc(is);
+                } else if ((c & QOI_MASK_2) == QOI_OP_INDEX) {
+                    p = is->index[c];
+                    r = p[0];
+                    g = p[1];
+                    b = p[2];
+                    a = p[3];
+                } else if ((c & QOI_MASK_2) == QOI_OP_DIFF) {
+                    r += ((c >> 4) & 0x03) - 2;
+                    g += ((c >> 2) & 0x03) - 2;
+                    b += (c & 0x03) - 2;
+                } else if ((c & QOI_MASK_2) == QOI_OP_LUMA) {
+                    b2 = image_getc(is);
+                    vg = (c & 0x3f) - 32;
+                    r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    g += vg;
+                    b += vg - 8 + (b2 & 0x0f);
+                } else {
+                    run = c & 0x3f;
+                }
+                p = is->index[QOI_HASH(r, g, b, a)];
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+                p[3] = a;
+            }
+            dst[DS_COLOR_R] = r;
+            dst[DS_COLOR_G] = g;
+            dst[DS_COLOR_B] = b;
+        }
+
+        rc = image_emit(is, sink, y, line, width, sink_us);
+        if (rc < 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+static int image_rle_decode(struct image_stream *is, struct image_sink *sink, uint8_t *line,
+                            uint16_t width, uint16_t height, uint32_t *sink_us)
+{
+    uint8_t r = 0, g = 0, b = 0, n, *dst;
+    bool literal = false;
+    int count = 0;
+    int x, y, rc;
+
+    for (y = 0; y < height; y++) {
+        dst = line;
+        for (x = 0; x < width; x++, dst += DS_COLOR_DATA_MAX) {
+            if (count == 0) {
+                n = image_getc(is);
+                literal = n < 0x80;
+                count = (n & 0x7f) + 1;
+                if (!literal) {
+                    r = image_getc(is);
+                    g = image_getc(is);
+                    b = image_getc(is);
+                }
+            }
+            if (literal) {
+                r = image_getc(is);
+                g = image_getc(is);
+                b = image_getc(is);
+            }
+            count--;
+            dst[DS_COLOR_R] = r;
+            dst[DS_COLOR_G] = g;
+            dst[DS_COLOR_B] = b;
+        }
+
+        rc = image_emit(is, sink, y, line, width, sink_us);
+        if (rc < 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+/**
+ * This function will decode an image file into a sink a row at a time.
+ *
+ * @param path the file, on a mounted fatfs volume.
+ * @param type the format of the file.
+ * @param sink where the rows go.
+ * @param stats the stats of the decode, or NULL.
+ *
+ * @return 0 on successful, < 0 on error.
+ */
+int image_draw_file(const char *path, enum image_type type, struct image_sink *sink,
+                    struct image_stats *stats)
+{
+    struct image_stream *is;
+    uint32_t width = 0, height = 0, sink_us = 0;
+    uint8_t *line = NULL;
+    size_t ram_base, ram_peak = 0;
+    u64 start, total;
+    int rc;
+
+    /* the peak is measured, from the first allocation for the image on */
+    mm_block_peak_reset();
+    ram_base = mm_block_used_size();
+    is = kzalloc(sizeof(struct image_stream), GFP_KERNEL);
+    if (is == NULL) {
+        pr_err("alloc image_stream buf error\r\n");
+        return -ENOMEM;
+    }
+    is->buf[0] = kmalloc(IMAGE_CHUNK * 2, GFP_KERNEL);
+    if (is->buf[0] == NULL) {
+        pr_err("alloc chunk buf error\r\n");
+        rc = -ENOMEM;
+        goto out_free;
+    }
+    is->buf[1] = is->buf[0] + IMAGE_CHUNK;
+
+    if (f_open(&is->file, path, FA_OPEN_EXISTING | FA_READ) != FR_OK) {
+        pr_err("%s open error\r\n", path);
+        rc = -ENOENT;
+        goto out_free;
+    }
+
+    sem_init(&is->filled, 0);
+    sem_init(&is->free, 2);
+    sem_init(&is->exit, 0);
+    is->cur = 1;
+    is->reader = task_create("image_reader", image_reader_entry, is,
+                             IMAGE_READER_PRIO, IMAGE_READER_STACK, 10, NULL);
+    if (is->reader == NULL) {
+        pr_err("creat image_reader task err\r\n");
+        rc = -ENOMEM;
+        goto out_close;
+    }
+    start = cpu_run_time_us();
+    task_ready(is->reader);
+
+    rc = image_header(is, type, &width, &height);
+    if (rc < 0) {
+        pr_err("%s is not a valid image\r\n", path);
+        goto out_stop;
+    }
+    line = kmalloc(width * DS_COLOR_DATA_MAX, GFP_KERNEL);
+    if (line == NULL) {
+        pr_err("alloc line buf error\r\n");
+        rc = -ENOMEM;
+        goto out_stop;
+    }
+
+    rc = sink->begin(sink, width, height);
+    if (rc < 0)
+        goto out_stop;
+    if (type == IMAGE_QOI)
+        rc = image_qoi_decode(is, sink, line, width, height, &sink_us);
+    else
+        rc = image_rle_decode(is, sink, line, width, height, &sink_us);
+    sink->end(sink);
+    total = cpu_run_time_us() - start;
+    ram_peak = mm_block_peak_size() - ram_base;
+
+    if (stats != NULL) {
+        stats->width = width;
+        stats->height = height;
+        stats->bytes = is->bytes;
+        stats->total_us = total;
+        stats->read_wait_us = is->wait_us;
+        stats->sink_us = sink_us;
+        stats->pixels_per_sec = total ? (u64)width * height * 1000000 / total : 0;
+        stats->peak_ram = ram_peak;
+    }
+
+out_stop:
+    /* the reader is stopped at its next buffer, or has ended on its own */
+    is->stop = true;
+    sem_send_one(&is->free);
+    sem_get(&is->exit);
+    if (stats != NULL)
+        stats->reader_stack = is->stack_used;
+out_close:
+    f_close(&is->file);
+out_free:
+    if (line != NULL)
+        kfree(line);
+    if (is->buf[0] != NULL)
+        kfree(is->buf[0]);
+    kfree(is);
+
+    return rc;
+}
+
+static int image_dev_sink_begin(struct image_sink *sink, uint16_t width, uint16_t height)
+{
+    struct image_dev_sink *ds = container_of(sink, struct image_dev_sink, sink);
+    uint32_t bytes = ds->info.flags & DISPLAY_DEV_RGB565 ? sizeof(uint16_t) : DS_COLOR_DATA_MAX;
+
+    /* an async device reads one row while the next is converted */
+    ds->line = kmalloc(min_t(uint32_t, width, ds->info.width) * bytes * 2, GFP_KERNEL);
+    if (ds->line == NULL) {
+        pr_err("alloc line buf error\r\n");
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+static int image_dev_sink_line(struct image_sink *sink, uint16_t y,
+                               const uint8_t *pixels, uint16_t width)
+{
+    struct image_dev_sink *ds = container_of(sink, struct image_dev_sink, sink);
+    struct device *dev = ds->dev;
+    uint16_t n = min_t(uint16_t, width, ds->info.width);
+    uint16_t *dst;
+    void *buf;
+    size_t size;
+    addr_t pos;
+
+    if (y >= ds->info.height)
+        return 0;
+
+    if (ds->info.flags & DISPLAY_DEV_RGB565) {
+        size = n * sizeof(uint16_t);
+        dst = (uint16_t *)(ds->line + (y & 1) * size);
+        pixel_rgb888_to_rgb565(dst, pixels, n);
+        buf = dst;
+        pos = (addr_t)y * ds->info.width;
+    } else {
+        size = n * DS_COLOR_DATA_MAX;
+        buf = ds->line + (y & 1) * size;
+        memcpy(buf, pixels, size);
+        pos = (addr_t)y * ds->info.width * DS_COLOR_DATA_MAX;
+    }
+
+    return dev->ops.write(dev, pos, buf, size) < 0 ? -EIO : 0;
+}
+
+static void image_dev_sink_end(struct image_sink *sink)
+{
+    struct image_dev_sink *ds = container_of(sink, struct image_dev_sink, sink);
+
+    /* waits for the last row */
+    if (ds->info.flags & DISPLAY_DEV_ASYNC_WRITE)
+        ds->dev->ops.control(ds->dev, DS_CTRL_SET_FLUSH_DONE, NULL);
+    if (!(ds->info.flags & DISPLAY_DEV_RGB565))
+        ds->dev->ops.control(ds->dev, LED_CTRL_REFRESH, NULL);
+    kfree(ds->line);
+    ds->line = NULL;
+}
+
+/**
+ * This function will make a sink of a display device, the image is drawn
+ * from the top left of the device.
+ *
+ * @param ds the sink.
+ * @param dev the display device, enabled.
+ *
+ * @return 0 on successful, -ENODEV if the device has no size.
+ */
+int image_dev_sink_init(struct image_dev_sink *ds, struct device *dev)
+{
+    memset(ds, 0, sizeof(struct image_dev_sink));
+    ds->dev = dev;
+    dev->ops.control(dev, DS_CTRL_GET_DEV_INFO, &ds->info);
+    if (ds->info.width == 0 || ds->info.height == 0) {
+        pr_err("display device has no size\r\n");
+        return -ENODEV;
+    }
+
+    ds->sink.begin = image_dev_sink_begin;
+    ds->sink.line = image_dev_sink_line;
+    ds->sink.end = image_dev_sink_end;
+
+    return 0;
+}
+
+#ifdef CONFIG_DISPLAY_SERVER
+static int image_area_sink_begin(struct image_sink *sink, uint16_t width, uint16_t height)
+{
+    return 0;
+}
+
+static int image_area_sink_line(struct image_sink *sink, uint16_t y,
+                                const uint8_t *pixels, uint16_t width)
+{
+    struct image_area_sink *as = container_of(sink, struct image_area_sink, sink);
+    struct ds_draw_area *area = &as->info->area;
+    uint16_t n = min_t(uint16_t, width, area->width);
+
+    if (y >= area->height)
+        return 0;
+
+    if (area->format == DS_FMT_RGB888) {
+        memcpy(area->pixels + y * area->stride, pixels, n * DS_COLOR_DATA_MAX);
+        return 0;
+    }
+
+    pixel_rgb888_to_rgb565((uint16_t *)(area->pixels + y * area->stride), pixels, n);
+
+    return 0;
+}
+
+static void image_area_sink_end(struct image_sink *sink)
+{
+    struct image_area_sink *as = container_of(sink, struct image_area_sink, sink);
+
+    ds_commit_draw_info(as->ds, as->info);
+}
+
+/**
+ * This function will make a sink of an area info, the image is drawn from
+ * the top left of the area and the area is committed once it is drawn.
+ *
+ * @param as the sink.
+ * @param ds the display server of the info.
+ * @param info an RGB888 or RGB565 area info.
+ *
+ * @return 0 on successful, -EINVAL for an area of another format.
+ */
+int image_area_sink_init(struct image_area_sink *as, struct display_server *ds,
+                         struct ds_draw_info *info)
+{
+    if (info->area.format != DS_FMT_RGB888 && info->area.format != DS_FMT_RGB565) {
+        pr_err("area format is not supported, format=%u\r\n", info->area.format);
+        return -EINVAL;
+    }
+
+    memset(as, 0, sizeof(struct image_area_sink));
+    as->ds = ds;
+    as->info = info;
+    as->sink.begin = image_area_sink_begin;
+    as->sink.line = image_area_sink_line;
+    as->sink.end = image_area_sink_end;
+
+    return 0;
+}
+#endif
+
+void image_stats_dump(const struct image_stats *stats, const char *name)
+{
+    pr_info("%s: %u*%u, %u bytes, %u us, %u pixels/s\r\n", name, stats->width,
+            stats->height, stats->bytes, stats->total_us, stats->pixels_per_sec);
+    pr_info("%s: read wait=%uus, sink=%uus, peak ram=%u bytes, reader stack=%u/%u bytes\r\n",
+            name, stats->read_wait_us, stats->sink_us, stats->peak_ram, stats->reader_stack,
+            IMAGE_READER_STACK);
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[image_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <string.h>
+
+#include <display/display.h>
+#include <display/image.h>
+
+#include "../fs/fatfs/ff.h"
+
+/*
+ * Draws a full screen QOI and RLE image from the sd card to the display
+ * device over and over, a file that is missing is skipped.
+ */
+
+#ifdef CONFIG_IMAGE_DEV
+#define IMAGE_BENCH_DEV CONFIG_IMAGE_DEV
+#else
+#define IMAGE_BENCH_DEV "zj-tft_lcd"
+#endif
+
+static FATFS image_bench_fs;
+
+static const struct {
+    const char *path;
+    enum image_type type;
+} image_bench_file[] = {
+    { "0:image.qoi", IMAGE_QOI },
+    { "0:image.rle", IMAGE_RLE },
+};
+
+static void image_bench_task_entry(void* parameter)
+{
+    struct image_dev_sink sink;
+    struct image_stats stats;
+    struct device *dev = NULL;
+    FRESULT res;
+    int i, rc;
+
+    res = f_mount(&image_bench_fs, "0:", 1);
+    if (res != FR_OK) {
+        pr_err("mount error, res=%d\r\n", res);
+        return;
+    }
+
+    for (i = 0; i < 100; i++) {
+        dev = device_find_by_name(IMAGE_BENCH_DEV);
+        if (dev != NULL)
+            break;
+        pr_err("%s device not found, retry=%d\r\n", IMAGE_BENCH_DEV, i + 1);
+        sleep(1);
+    }
+    if (dev == NULL) {
+        pr_err("%s device not found, exit\r\n", IMAGE_BENCH_DEV);
+        return;
+    }
+    dev->ops.control(dev, DS_CTRL_ENABLE, NULL);
+    if (image_dev_sink_init(&sink, dev) < 0)
+        return;
+    pr_info("display device:[%s] %u*%u, chunk=%u\r\n", IMAGE_BENCH_DEV,
+            sink.info.width, sink.info.height, IMAGE_CHUNK);
+
+    while (true) {
+        for (i = 0; i < sizeof(image_bench_file) / sizeof(image_bench_file[0]); i++) {
+            rc = image_draw_file(image_bench_file[i].path, image_bench_file[i].type,
+                                 &sink.sink, &stats);
+            if (rc < 0) {
+                pr_err("%s draw error, rc=%d\r\n", image_bench_file[i].path, rc);
+                continue;
+            }
+            image_stats_dump(&stats, image_bench_file[i].path);
+            sleep(1);
+        }
+    }
+}
+
+static int image_bench_init(void)
+{
+    struct task_struct *task;
+
+    task = task_create("image_bench", image_bench_task_entry, NULL, 15, 2048, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat image_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(image_bench_init);
@@ -0,0 +1,157 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[key_lat_test]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <string.h>
+#include <usb/usb_common.h>
+#include <key/matrix_kbd.h>
+#include <key/latency.h>
+
+/*
+ * A virtual board for boards without a matrix (qemu-stm32): the matrix_kbd
+ * core runs as on a keyboard, debounce, keymap and report included, over a
+ * scan that only sleeps one period. The latency module merges its synthetic
+ * key into every scan, so a sample runs from the scan that sees the injected
+ * change to the hid report. Without usb a "hidd" device stands in for the
+ * hid class and completes every report as soon as it is written.
+ */
+
+#define KEY_LAT_TEST_KEYS      64
+#define KEY_LAT_TEST_KEY       5
+/* msleep() has tick resolution */
+#define KEY_LAT_TEST_SCAN_MS   CONFIG_SYS_TICK_MS
+#define KEY_LAT_TEST_PERIOD_MS 50
+#define KEY_LAT_TEST_SAMPLES   100
+
+static hid_in_done_t key_lat_test_in_done;
+static struct device key_lat_test_hid;
+
+/* virtual key n reports usage KC_A + n, no key has an action */
+static uint8_t key_lat_test_code[KEY_LAT_TEST_KEYS];
+static const uint8_t key_lat_test_action[KEY_LAT_TEST_KEYS];
+
+static int key_lat_test_kbd_init(__always_unused struct matrix_kbd *kbd)
+{
+    return 0;
+}
+
+/* nothing is pressed, the injected key is merged in by the core */
+static u32 key_lat_test_kbd_scan(__always_unused struct matrix_kbd *kbd,
+                                 __always_unused uint32_t *bits)
+{
+    msleep(KEY_LAT_TEST_SCAN_MS);
+
+    return cpu_cycles();
+}
+
+static const struct matrix_kbd_ops key_lat_test_kbd_ops = {
+    .init = key_lat_test_kbd_init,
+    .scan = key_lat_test_kbd_scan,
+};
+
+static struct matrix_kbd key_lat_test_kbd = {
+    .name = "key_lat_kbd",
+    .ops = &key_lat_test_kbd_ops,
+    .position = NULL,
+    .positions = KEY_LAT_TEST_KEYS,
+    .keys = KEY_LAT_TEST_KEYS,
+    .layers = 1,
+    .code = key_lat_test_code,
+    .action = key_lat_test_action,
+    .scan_hz = 1000 / KEY_LAT_TEST_SCAN_MS,
+    .prio = 3,
+    .stack_size = 2048,
+};
+
+static ssize_t key_lat_test_hid_write(__always_unused struct device *dev, addr_t pos,
+                                      __always_unused const void *buffer, size_t size)
+{
+    if (key_lat_test_in_done != NULL)
+        key_lat_test_in_done(pos, true);
+
+    return size;
+}
+
+static int key_lat_test_hid_control(__always_unused struct device *dev, int cmd, void *args)
+{
+    if (cmd != HID_CTRL_SET_IN_DONE)
+        return -EINVAL;
+
+    key_lat_test_in_done = (hid_in_done_t)args;
+    return 0;
+}
+
+static int key_lat_test_hid_register(void)
+{
+    device_init(&key_lat_test_hid);
+    key_lat_test_hid.name = "hidd";
+    key_lat_test_hid.ops.write = key_lat_test_hid_write;
+    key_lat_test_hid.ops.control = key_lat_test_hid_control;
+
+    return device_register(&key_lat_test_hid);
+}
+
+static void key_lat_test_task_entry(__always_unused void *parameter)
+{
+    struct key_lat_report report;
+
+    pr_info("key %d, toggle every %dms, scan every %dms\r\n", KEY_LAT_TEST_KEY,
+            KEY_LAT_TEST_PERIOD_MS, KEY_LAT_TEST_SCAN_MS);
+
+    key_latency_clear();
+    key_latency_inject(KEY_LAT_TEST_KEY, KEY_LAT_TEST_PERIOD_MS);
+
+    do {
+        msleep(KEY_LAT_TEST_PERIOD_MS);
+        key_latency_get(&report);
+    } while (report.samples + report.lost < KEY_LAT_TEST_SAMPLES);
+
+    key_latency_inject(KEY_LAT_TEST_KEY, 0);
+    key_latency_dump();
+}
+
+static int key_lat_test_init(void)
+{
+    struct task_struct *task;
+    int rc, i;
+
+    if (device_find_by_name("hidd") == NULL) {
+        rc = key_lat_test_hid_register();
+        if (rc < 0) {
+            pr_err("register hidd err, rc=%d\r\n", rc);
+            return rc;
+        }
+    }
+
+    for (i = 0; i < KEY_LAT_TEST_KEYS; i++)
+        key_lat_test_code[i] = 0x04 + i;
+    rc = matrix_kbd_register(&key_lat_test_kbd);
+    if (rc < 0) {
+        pr_err("register key_lat_kbd err, rc=%d\r\n", rc);
+        return rc;
+    }
+
+    task = task_create("key_lat_test", key_lat_test_task_entry, NULL, 4, 1024, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat key_lat_test task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(key_lat_test_init);
@@ -0,0 +1,166 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[lcd_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <kernel/sch.h>
+#include <string.h>
+#include <kernel/sem.h>
+
+#include <display/led.h>
+#include <display/display.h>
+
+/*
+ * Full frames of RGB565 are rendered into two bands of rows and written
+ * in turn. In the sync pass each band waits for its flush before the next
+ * one is rendered, in the overlap pass a band is rendered while the other
+ * one is sent. The cpu usage is of the whole system over the last second.
+ */
+
+#define LCD_BENCH_ROWS 20
+#define LCD_BENCH_SEC  3
+
+struct lcd_bench {
+    struct task_struct *task;
+    struct device *dev;
+    struct display_dev_info dev_info;
+    sem_t done;
+    u16 *band[2];
+};
+
+static void lcd_bench_flush_done(void *arg)
+{
+    struct lcd_bench *lb = arg;
+
+    sem_send_one(&lb->done);
+}
+
+static void lcd_bench_render(u16 *band, int width, int rows, int y0, int frame)
+{
+    int x, y;
+
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < width; x++) {
+            *band++ = (((x + frame) & 0x1f) << 11) | (((y0 + y) & 0x3f) << 5) |
+                      (frame & 0x1f);
+        }
+    }
+}
+
+static void lcd_bench_run(struct lcd_bench *lb, bool overlap)
+{
+    struct display_flush_done done = { lcd_bench_flush_done, lb };
+    u16 width = lb->dev_info.width;
+    u16 height = lb->dev_info.height;
+    u64 start, now, end;
+    u32 frames = 0, usage, fps_x100, kbps;
+    int y, rows, k = 0;
+
+    lb->dev->ops.control(lb->dev, DS_CTRL_SET_FLUSH_DONE, overlap ? NULL : &done);
+
+    start = cpu_run_time_us();
+    end = start + LCD_BENCH_SEC * 1000000ULL;
+    do {
+        for (y = 0; y < height; y += LCD_BENCH_ROWS) {
+            rows = min_t(int, LCD_BENCH_ROWS, height - y);
+            lcd_bench_render(lb->band[k], width, rows, y, frames);
+            lb->dev->ops.write(lb->dev, y * width, lb->band[k], width * rows * sizeof(u16));
+            if (!overlap)
+                sem_get(&lb->done);
+            k ^= 1;
+        }
+        frames++;
+        now = cpu_run_time_us();
+    } while (now < end);
+
+    /* waits for the last band */
+    lb->dev->ops.control(lb->dev, DS_CTRL_SET_FLUSH_DONE, NULL);
+    now = cpu_run_time_us();
+    usage = get_cpu_usage() / 100;
+
+    fps_x100 = (u64)frames * 100000000 / (now - start);
+    kbps = (u64)frames * width * height * sizeof(u16) * 1000 / (now - start);
+    pr_info("%s: %u frames, %u.%02u fps, %u KB/s, cpu %u.%02u%%\r\n",
+            overlap ? "overlap" : "sync", frames, fps_x100 / 100, fps_x100 % 100,
+            kbps, usage / 100, usage % 100);
+}
+
+static void lcd_bench_task_entry(void* parameter)
+{
+    struct lcd_bench *lb = parameter;
+    int i;
+
+    lb->dev = NULL;
+    for (i = 0; i < 100; i ++) {
+        lb->dev = device_find_by_name(CONFIG_LED_DEV);
+        if (lb->dev == NULL) {
+            i++;
+            pr_err("%s device not found, retry=%d\r\n", CONFIG_LED_DEV, i);
+            sleep(1);
+            continue;
+        } else {
+            pr_info("%s device found\r\n", CONFIG_LED_DEV);
+            break;
+        }
+    }
+    if (i >= 100) {
+        pr_err("%s device not found, exit\r\n", CONFIG_LED_DEV);
+        return;
+    }
+
+    lb->dev->ops.control(lb->dev, DS_CTRL_GET_DEV_INFO, &lb->dev_info);
+    if (!(lb->dev_info.flags & DISPLAY_DEV_ASYNC_WRITE)) {
+        pr_err("%s has no asynchronous write\r\n", CONFIG_LED_DEV);
+        return;
+    }
+    for (i = 0; i < 2; i++) {
+        lb->band[i] = kmalloc(lb->dev_info.width * LCD_BENCH_ROWS * sizeof(u16), GFP_KERNEL);
+        if (lb->band[i] == NULL) {
+            pr_err("alloc band buf error\r\n");
+            return;
+        }
+    }
+    pr_info("display device:[%s] %u*%u, band=%u rows\r\n", CONFIG_LED_DEV,
+            lb->dev_info.width, lb->dev_info.height, LCD_BENCH_ROWS);
+    lb->dev->ops.control(lb->dev, DS_CTRL_ENABLE, NULL);
+
+    while (true) {
+        lcd_bench_run(lb, false);
+        lcd_bench_run(lb, true);
+        sleep(2);
+    }
+}
+
+static int lcd_bench_init(void)
+{
+    struct lcd_bench *lb;
+
+    lb = kzalloc(sizeof(struct lcd_bench), GFP_KERNEL);
+    if (lb == NULL) {
+        pr_err("alloc lcd_bench buf error\r\n");
+        return -ENOMEM;
+    }
+    sem_init(&lb->done, 0);
+
+    lb->task = task_create("lcd_bench", lcd_bench_task_entry, lb, 10, 1024, 10, NULL);
+    if (lb->task == NULL) {
+        pr_fatal("creat lcd_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(lb->task);
+
+    return 0;
+}
+task_init(lcd_bench_init);
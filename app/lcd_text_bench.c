@@ -0,0 +1,125 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[lcd_text_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <string.h>
+
+#include "../drivers/display/zj-tft-lcd.h"
+
+/*
+ * Each font size is run in three passes over the whole screen, row after
+ * row. The number pass draws an 8 digit counter, its glyphs stay in the
+ * cache. The text pass draws a line of more different characters than the
+ * cache holds, so it shows the cost of a miss. The overlay pass draws the
+ * counter without its background, in runs of set pixels.
+ */
+
+#define LCD_TEXT_BENCH_SEC    2
+#define LCD_TEXT_BENCH_DIGITS 8
+
+enum lcd_text_pass {
+    LCD_TEXT_NUMBER,
+    LCD_TEXT_STRING,
+    LCD_TEXT_OVERLAY,
+};
+
+static const char *const lcd_text_pass_name[] = {
+    [LCD_TEXT_NUMBER] = "number",
+    [LCD_TEXT_STRING] = "text",
+    [LCD_TEXT_OVERLAY] = "overlay",
+};
+
+static u8 lcd_text_line[] = "The quick brown fox jumps over the lazy dog 0123456789";
+
+static void lcd_text_bench_run(u8 size, enum lcd_text_pass pass)
+{
+    u16 cols = lcddev.width / (size / 2);
+    u16 rows = lcddev.height / size;
+    u32 hits0, misses0, hits, misses;
+    u32 chars = 0, n = 0, cps, hit_x100;
+    u64 start, now, end;
+    u16 y;
+    int len;
+
+    LCD_Clear(WHITE);
+    LCD_Glyph_Stats(&hits0, &misses0);
+    len = min_t(int, strlen((char *)lcd_text_line), cols);
+
+    start = cpu_run_time_us();
+    end = start + LCD_TEXT_BENCH_SEC * 1000000ULL;
+    do {
+        y = (n % rows) * size;
+        switch (pass) {
+        case LCD_TEXT_NUMBER:
+            LCD_ShowxNum(0, y, n, LCD_TEXT_BENCH_DIGITS, size, 0x80);
+            chars += LCD_TEXT_BENCH_DIGITS;
+            break;
+        case LCD_TEXT_STRING:
+            LCD_ShowString(0, y, len * (size / 2), size, size, lcd_text_line);
+            chars += len;
+            break;
+        case LCD_TEXT_OVERLAY:
+            LCD_ShowxNum(0, y, n, LCD_TEXT_BENCH_DIGITS, size, 0x81);
+            chars += LCD_TEXT_BENCH_DIGITS;
+            break;
+        }
+        n++;
+        now = cpu_run_time_us();
+    } while (now < end);
+
+    LCD_Glyph_Stats(&hits, &misses);
+    hits -= hits0;
+    misses -= misses0;
+    cps = (u64)chars * 1000000 / (now - start);
+    hit_x100 = hits + misses ? (u64)hits * 10000 / (hits + misses) : 0;
+    pr_info("size %u %s: %u chars/s, cache hit %u.%02u%%\r\n", size,
+            lcd_text_pass_name[pass], cps, hit_x100 / 100, hit_x100 % 100);
+}
+
+static void lcd_text_bench_task_entry(void* parameter)
+{
+    static const u8 sizes[] = { 12, 16, 24 };
+    int i;
+
+    LCD_Init();
+    POINT_COLOR = BLACK;
+    BACK_COLOR = WHITE;
+    pr_info("lcd %u*%u, glyph cache=%u\r\n", lcddev.width, lcddev.height, LCD_GLYPH_CACHE);
+
+    while (true) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            LCD_Glyph_Flush();
+            lcd_text_bench_run(sizes[i], LCD_TEXT_NUMBER);
+            lcd_text_bench_run(sizes[i], LCD_TEXT_STRING);
+            lcd_text_bench_run(sizes[i], LCD_TEXT_OVERLAY);
+        }
+        sleep(2);
+    }
+}
+
+static int lcd_text_bench_init(void)
+{
+    struct task_struct *task;
+
+    task = task_create("lcd_text_bench", lcd_text_bench_task_entry, NULL, 10, 1024, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat lcd_text_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(lcd_text_bench_init);
@@ -0,0 +1,211 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[lvgl_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <string.h>
+#include <display/display.h>
+#include <display/frame_sched.h>
+#include <display/virt_fb.h>
+
+#include "lvgl.h"
+
+/*
+ * LVGL renders into an RGB565 area of the display server the size of the
+ * screen, so its frames go through the server to whatever device it
+ * drives, on qemu the virt-fb. A flush copies the band into the area and
+ * the last flush of a frame commits it. The area is one blit for the
+ * server, so it redraws the whole screen whenever LVGL changed any of it,
+ * the pixels LVGL flushed are printed next to the ones the device got.
+ */
+
+#ifdef CONFIG_LVGL_BENCH_FPS
+#define LVGL_BENCH_FPS CONFIG_LVGL_BENCH_FPS
+#else
+#define LVGL_BENCH_FPS (1000 / LV_DEF_REFR_PERIOD)
+#endif
+#define LVGL_BENCH_ROWS     10
+#define LVGL_BENCH_DUMP_SEC 10
+
+struct lvgl_bench {
+    struct device *ds_dev;
+    struct display_server *ds;
+    struct device *fb_dev;
+    struct display_dev_info dev_info;
+    struct ds_draw_info *info;
+    struct frame_sched fs;
+    lv_obj_t *bar;
+    lv_obj_t *label;
+    uint32_t flushes;
+    uint32_t flush_pixels;
+};
+
+static void lvgl_bench_flush(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    struct lvgl_bench *lb = lv_display_get_user_data(disp);
+    struct ds_draw_area *da = &lb->info->area;
+    int32_t width = lv_area_get_width(area);
+    int32_t y;
+
+    mutex_lock(&lb->info->lock);
+    for (y = area->y1; y <= area->y2; y++, px_map += width * sizeof(uint16_t)) {
+        memcpy(da->pixels + y * da->stride + area->x1 * sizeof(uint16_t), px_map,
+               width * sizeof(uint16_t));
+    }
+    mutex_unlock(&lb->info->lock);
+    lb->flushes++;
+    lb->flush_pixels += width * lv_area_get_height(area);
+
+    if (lv_display_flush_is_last(disp))
+        ds_commit_draw_info(lb->ds, lb->info);
+    lv_display_flush_ready(disp);
+}
+
+static int lvgl_bench_disp_init(struct lvgl_bench *lb)
+{
+    uint32_t size = lb->dev_info.width * LVGL_BENCH_ROWS * sizeof(uint16_t);
+    lv_display_t *disp;
+    void *buf[2];
+
+    lb->info = display_server_alloc_draw_area_info_format(lb->ds, 0, 0, lb->dev_info.width,
+                                                          lb->dev_info.height,
+                                                          DS_FMT_RGB565, 0);
+    buf[0] = kmalloc(size, GFP_KERNEL);
+    buf[1] = kmalloc(size, GFP_KERNEL);
+    if (lb->info == NULL || buf[0] == NULL || buf[1] == NULL) {
+        pr_err("alloc lvgl buf error\r\n");
+        return -ENOMEM;
+    }
+
+    disp = lv_display_create(lb->dev_info.width, lb->dev_info.height);
+    lv_display_set_user_data(disp, lb);
+    lv_display_set_flush_cb(disp, lvgl_bench_flush);
+    lv_display_set_buffers(disp, buf[0], buf[1], size, LV_DISPLAY_RENDER_MODE_PARTIAL);
+
+    return 0;
+}
+
+/* a spinner animates by itself, the bar and the label change every frame */
+static void lvgl_bench_ui_init(struct lvgl_bench *lb)
+{
+    lv_obj_t *spinner;
+
+    spinner = lv_spinner_create(lv_scr_act());
+    lv_obj_set_size(spinner, 64, 64);
+    lv_obj_align(spinner, LV_ALIGN_CENTER, 0, -32);
+
+    lb->bar = lv_bar_create(lv_scr_act());
+    lv_obj_set_size(lb->bar, lb->dev_info.width * 2 / 3, 16);
+    lv_obj_align(lb->bar, LV_ALIGN_CENTER, 0, 32);
+
+    lb->label = lv_label_create(lv_scr_act());
+    lv_obj_align(lb->label, LV_ALIGN_BOTTOM_MID, 0, -8);
+}
+
+static void lvgl_bench_dump(struct lvgl_bench *lb, uint32_t frames)
+{
+#ifdef CONFIG_VIRT_FB
+    struct virt_fb_stats fb;
+#endif
+
+    frame_sched_dump(&lb->fs, "lvgl");
+    pr_info("lvgl: %u flushes, %u pixels a frame\r\n", lb->flushes,
+            frames ? lb->flush_pixels / frames : 0);
+    lb->ds_dev->ops.control(lb->ds_dev, DS_CTRL_DUMP_STATS, NULL);
+#ifdef CONFIG_VIRT_FB
+    if (lb->fb_dev == NULL)
+        return;
+    lb->fb_dev->ops.control(lb->fb_dev, VIRT_FB_CTRL_GET_STATS, &fb);
+    pr_info("%s: %u frames, %u writes, pixels a frame avg=%u max=%u, empty=%u\r\n",
+            VIRT_FB_NAME, fb.frames, fb.writes,
+            fb.frames ? (uint32_t)(fb.total_pixels / fb.frames) : 0, fb.max_pixels, fb.empty);
+    lb->fb_dev->ops.control(lb->fb_dev, VIRT_FB_CTRL_CLEAR_STATS, NULL);
+    lb->fb_dev->ops.control(lb->fb_dev, VIRT_FB_CTRL_DUMP, NULL);
+#endif
+    lb->flushes = 0;
+    lb->flush_pixels = 0;
+}
+
+static void lvgl_bench_task_entry(void* parameter)
+{
+    struct lvgl_bench *lb = parameter;
+    uint32_t frames = 0;
+    int i;
+
+    lb->ds_dev = NULL;
+    for (i = 0; i < 100; i ++) {
+        lb->ds_dev = device_find_by_name("display-server");
+        if (lb->ds_dev == NULL) {
+            i++;
+            pr_err("%s device not found, retry=%d\r\n", "display-server", i);
+            sleep(1);
+            continue;
+        } else {
+            pr_info("%s device found\r\n", "display-server");
+            break;
+        }
+    }
+    if (i >= 100) {
+        pr_err("%s device not found, exit\r\n", "display-server");
+        return;
+    }
+
+    lb->ds = display_dev_to_server(lb->ds_dev);
+    lb->ds_dev->ops.control(lb->ds_dev, DS_CTRL_GET_DEV_INFO, &lb->dev_info);
+#ifdef CONFIG_VIRT_FB
+    lb->fb_dev = device_find_by_name(VIRT_FB_NAME);
+#endif
+
+    lv_init();
+    if (lvgl_bench_disp_init(lb) < 0)
+        return;
+    lvgl_bench_ui_init(lb);
+
+    frame_sched_init(&lb->fs, LVGL_BENCH_FPS);
+    while (true) {
+        frame_sched_wait(&lb->fs);
+        lv_bar_set_value(lb->bar, frames % 100, LV_ANIM_OFF);
+        lv_label_set_text_fmt(lb->label, "frame %u", (unsigned int)frames);
+        lv_timer_handler();
+        frame_sched_composed(&lb->fs);
+        frame_sched_done(&lb->fs);
+        if (++frames % (LVGL_BENCH_FPS * LVGL_BENCH_DUMP_SEC) == 0) {
+            lvgl_bench_dump(lb, LVGL_BENCH_FPS * LVGL_BENCH_DUMP_SEC);
+            frame_sched_clear_stats(&lb->fs);
+        }
+    }
+}
+
+static int lvgl_bench_init(void)
+{
+    struct lvgl_bench *lb;
+    struct task_struct *task;
+
+    lb = kzalloc(sizeof(struct lvgl_bench), GFP_KERNEL);
+    if (lb == NULL) {
+        pr_err("alloc lvgl_bench buf error\r\n");
+        return -ENOMEM;
+    }
+
+    task = task_create("lvgl_bench", lvgl_bench_task_entry, lb, 2, 4096, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat lvgl_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(lvgl_bench_init);
@@ -19,6 +19,7 @@
 #include <kernel/mm.h>
 #include <string.h>
 #include <kernel/sem.h>
+#include <display/frame_sched.h>
 
 #include "lvgl.h"
 #include "lib/demos/lv_demos.h"
@@ -28,6 +29,20 @@
 #define MY_DISP_HOR_RES    480
 #define MY_DISP_VER_RES    800
 
+#ifdef CONFIG_LVGL_FPS
+#define LVGL_TEST_FPS CONFIG_LVGL_FPS
+#else
+#define LVGL_TEST_FPS (1000 / LV_DEF_REFR_PERIOD)
+#endif
+/* the frame stats go to the console this often */
+#define LVGL_TEST_DUMP_SEC 10
+
+/*
+ * The flush sends a band by dma and renders the next one meanwhile,
+ * CONFIG_LVGL_FLUSH_CPU puts the pixels one by one from a single buffer
+ * to compare the two.
+ */
+
 
 static void disp_init(void);
 
@@ -58,19 +73,21 @@ void lv_port_disp_init(void)
     lv_display_t * disp = lv_display_create(MY_DISP_HOR_RES, MY_DISP_VER_RES);
     lv_display_set_flush_cb(disp, disp_flush);
 
+#ifdef CONFIG_LVGL_FLUSH_CPU
     /* Example 1
      * One buffer for partial rendering*/
     static lv_color_t buf_1_1[MY_DISP_HOR_RES * 10];                          /*A buffer for 10 rows*/
     lv_display_set_buffers(disp, buf_1_1, NULL, sizeof(buf_1_1), LV_DISPLAY_RENDER_MODE_PARTIAL);
-
-#if 0
+#else
     /* Example 2
      * Two buffers for partial rendering
      * In flush_cb DMA or similar hardware should be used to update the display in the background.*/
     static lv_color_t buf_2_1[MY_DISP_HOR_RES * 10];
     static lv_color_t buf_2_2[MY_DISP_HOR_RES * 10];
     lv_display_set_buffers(disp, buf_2_1, buf_2_2, sizeof(buf_2_1), LV_DISPLAY_RENDER_MODE_PARTIAL);
+#endif
 
+#if 0
     /* Example 3
      * Two buffers screen sized buffer for double buffering.
      * Both LV_DISPLAY_RENDER_MODE_DIRECT and LV_DISPLAY_RENDER_MODE_FULL works, see their comments*/
@@ -107,12 +124,27 @@ void disp_disable_update(void)
     disp_flush_enabled = false;
 }
 
+#ifndef CONFIG_LVGL_FLUSH_CPU
+/* called in the dma irq, lvgl may render into the buffer again */
+static void disp_flush_done(void *arg)
+{
+    lv_display_flush_ready(arg);
+}
+#endif
+
 /*Flush the content of the internal buffer the specific area on the display.
  *`px_map` contains the rendered image as raw pixel map and it should be copied to `area` on the display.
  *You can use DMA or any hardware acceleration to do this operation in the background but
  *'lv_display_flush_ready()' has to be called when it's finished.*/
 static void disp_flush(lv_display_t * disp_drv, const lv_area_t * area, uint8_t * px_map)
 {
+#ifndef CONFIG_LVGL_FLUSH_CPU
+    if(disp_flush_enabled) {
+        LCD_DMA_Write(area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area),
+                      (const uint16_t *)px_map, disp_flush_done, disp_drv);
+        return;
+    }
+#else
     if(disp_flush_enabled) {
         /*The most simple case (but also the slowest) to put all pixels to the screen one-by-one*/
 
@@ -127,6 +159,7 @@ static void disp_flush(lv_display_t * disp_drv, const lv_area_t * area, uint8_t
             }
         }
     }
+#endif
 
     /*IMPORTANT!!!
      *Inform the graphics library that you are ready with the flushing*/
@@ -139,19 +172,36 @@ static char *demos[] = {
 
 static void lvgl_test_task_entry(void* parameter)
 {
+    struct frame_sched fs;
+
     lv_init();
     lv_port_disp_init();
-    // lv_demos_create(demos, 1);
-
+#ifdef CONFIG_LVGL_DEMO
+    lv_demos_create(demos, 1);
+#else
     lv_obj_t *btn = lv_btn_create(lv_scr_act());
     if (btn != NULL) {
         lv_obj_set_size(btn, 100, 50);
         lv_obj_set_pos(btn, 100, 100);
     }
+#endif
 
+    /*
+     * The handler renders a band while the one before is sent, it returns
+     * with the last band in flight, waiting for it is the flush time. No
+     * slot is ever skipped.
+     */
+    frame_sched_init(&fs, LVGL_TEST_FPS);
     while(1) {
+        frame_sched_wait(&fs);
         lv_timer_handler();
-        msleep(10);
+        frame_sched_composed(&fs);
+#ifndef CONFIG_LVGL_FLUSH_CPU
+        LCD_DMA_Wait();
+#endif
+        frame_sched_done(&fs);
+        if (fs.stats.frames % (LVGL_TEST_FPS * LVGL_TEST_DUMP_SEC) == 0)
+            frame_sched_dump(&fs, "lvgl");
     }
 }
 
@@ -0,0 +1,225 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[pixel_ops_test]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/cpu.h>
+#include <kernel/init.h>
+#include <string.h>
+#include <display/display.h>
+#include <display/pixel_ops.h>
+
+/* lengths 0 to this at each offset 0 to 3 cover the word loops and tails */
+#define PIXEL_TEST_LEN    37
+#define PIXEL_TEST_PIXELS 1024
+#define PIXEL_TEST_LOOPS  8
+
+/*
+ * The pixel ops are checked against the byte loops below, on the m4 that
+ * is the simd against the plain C, on the m3 it only checks the tails and
+ * the conversions. The buffers are static, 3 of a 1024 pixel row do not
+ * fit a task stack.
+ */
+
+static uint8_t test_dst[PIXEL_TEST_PIXELS * DS_COLOR_DATA_MAX + 4];
+static uint8_t test_ref[PIXEL_TEST_PIXELS * DS_COLOR_DATA_MAX + 4];
+static uint8_t test_src[PIXEL_TEST_PIXELS * DS_COLOR_DATA_MAX + 4];
+static uint16_t test_565[PIXEL_TEST_PIXELS];
+static uint32_t test_seed = 1;
+
+static const uint16_t test_alpha[] = { 0, 1, 127, 128, 129, 255, 256 };
+
+static uint8_t test_rand(void)
+{
+    test_seed = test_seed * 1664525 + 1013904223;
+    return test_seed >> 24;
+}
+
+static void test_fill_rand(uint8_t *buf, int bytes)
+{
+    int i;
+
+    for (i = 0; i < bytes; i++)
+        buf[i] = test_rand();
+}
+
+static void ref_blend(uint8_t *dst, const uint8_t *src, int bytes, uint16_t alpha)
+{
+    int i;
+
+    for (i = 0; i < bytes; i++)
+        dst[i] = dst[i] + (((src[i] - dst[i]) * alpha) >> 8);
+}
+
+static void ref_scale(uint8_t *dst, const uint8_t *src, int bytes, uint16_t scale)
+{
+    int i;
+
+    for (i = 0; i < bytes; i++)
+        dst[i] = (src[i] * scale) >> 8;
+}
+
+static void ref_blend_color(uint8_t *dst, const uint8_t *color, int num, uint16_t alpha)
+{
+    int i;
+
+    for (i = 0; i < num; i++, dst += DS_COLOR_DATA_MAX)
+        ref_blend(dst, color, DS_COLOR_DATA_MAX, alpha);
+}
+
+/* dst and ref start equal, the op is run on dst and the reference on ref */
+static int test_check(const char *name, int len, int off, uint16_t alpha, int bytes)
+{
+    if (memcmp(test_dst, test_ref, bytes) == 0)
+        return 0;
+
+    pr_err("%s: len=%d off=%d alpha=%u FAIL\r\n", name, len, off, alpha);
+    return -EINVAL;
+}
+
+static int pixel_test_blend(void)
+{
+    int len, off, i, fail = 0;
+    uint16_t alpha;
+
+    for (i = 0; i <= (int)(sizeof(test_alpha) / sizeof(test_alpha[0])); i++) {
+        alpha = i < (int)(sizeof(test_alpha) / sizeof(test_alpha[0])) ? test_alpha[i] : test_rand();
+        for (off = 0; off < 4; off++) {
+            for (len = 0; len <= PIXEL_TEST_LEN; len++) {
+                test_fill_rand(test_dst, sizeof(test_dst));
+                test_fill_rand(test_src, sizeof(test_src));
+                memcpy(test_ref, test_dst, sizeof(test_ref));
+
+                pixel_blend(test_dst + off, test_src + (3 - off), len, alpha);
+                ref_blend(test_ref + off, test_src + (3 - off), len, alpha);
+                if (test_check("blend", len, off, alpha, sizeof(test_dst)) < 0)
+                    fail++;
+
+                pixel_scale(test_dst + off, test_src + (3 - off), len, alpha);
+                ref_scale(test_ref + off, test_src + (3 - off), len, alpha);
+                if (test_check("scale", len, off, alpha, sizeof(test_dst)) < 0)
+                    fail++;
+
+                pixel_blend_color_rgb888(test_dst + off, test_src, len, alpha);
+                ref_blend_color(test_ref + off, test_src, len, alpha);
+                if (test_check("blend_color", len, off, alpha, sizeof(test_dst)) < 0)
+                    fail++;
+            }
+        }
+    }
+    pr_info("blend, scale, blend_color %s\r\n", fail ? "FAIL" : "ok");
+
+    return fail;
+}
+
+static int pixel_test_convert(void)
+{
+    int v, i, fail = 0;
+    uint8_t *p;
+
+    /* every RGB565 value goes to RGB888 and back to itself */
+    for (v = 0; v <= U16_MAX; v += PIXEL_TEST_PIXELS) {
+        for (i = 0; i < PIXEL_TEST_PIXELS; i++)
+            test_565[i] = v + i;
+        pixel_rgb565_to_rgb888(test_dst, test_565, PIXEL_TEST_PIXELS);
+        p = &test_dst[0x1f * DS_COLOR_DATA_MAX];
+        if (v == 0 && (p[DS_COLOR_B] != 0xff || p[DS_COLOR_R] != 0 || p[DS_COLOR_G] != 0))
+            fail++;
+        pixel_rgb888_to_rgb565(test_565, test_dst, PIXEL_TEST_PIXELS);
+        for (i = 0; i < PIXEL_TEST_PIXELS; i++) {
+            if (test_565[i] != (uint16_t)(v + i)) {
+                pr_err("rgb565 0x%04x came back as 0x%04x\r\n", v + i, test_565[i]);
+                fail++;
+                break;
+            }
+        }
+    }
+
+    for (v = 0; v <= PIXEL_TEST_LEN; v++) {
+        memset(test_dst, 0, sizeof(test_dst));
+        memset(test_ref, 0, sizeof(test_ref));
+        pixel_fill_rgb888(test_dst + 1, test_src, v);
+        ref_blend_color(test_ref + 1, test_src, v, PIXEL_ALPHA_COPY);
+        if (test_check("fill", v, 1, PIXEL_ALPHA_COPY, sizeof(test_dst)) < 0)
+            fail++;
+    }
+    pr_info("convert, fill %s\r\n", fail ? "FAIL" : "ok");
+
+    return fail;
+}
+
+static void pixel_test_report(const char *name, u32 cycles, u32 ref_cycles)
+{
+    u32 cpp = cycles * 100 / (PIXEL_TEST_PIXELS * PIXEL_TEST_LOOPS);
+    u32 ref_cpp = ref_cycles * 100 / (PIXEL_TEST_PIXELS * PIXEL_TEST_LOOPS);
+
+    pr_info("%s: %u.%02u cycles/pixel, bytes loop %u.%02u\r\n", name,
+            cpp / 100, cpp % 100, ref_cpp / 100, ref_cpp % 100);
+}
+
+/* over one 1024 pixel row, in the cache and with no irq work in the way */
+static void pixel_test_speed(void)
+{
+    int bytes = PIXEL_TEST_PIXELS * DS_COLOR_DATA_MAX;
+    u32 start, cycles, ref_cycles;
+    int i;
+
+#define PIXEL_TEST_TIME(_var, _op)                  \
+    do {                                            \
+        start = cpu_cycles();                       \
+        for (i = 0; i < PIXEL_TEST_LOOPS; i++)      \
+            _op;                                    \
+        _var = cpu_cycles() - start;                \
+    } while (0)
+
+    PIXEL_TEST_TIME(cycles, pixel_blend(test_dst, test_src, bytes, 100));
+    PIXEL_TEST_TIME(ref_cycles, ref_blend(test_ref, test_src, bytes, 100));
+    pixel_test_report("blend", cycles, ref_cycles);
+
+    PIXEL_TEST_TIME(cycles, pixel_blend(test_dst, test_src, bytes, 128));
+    PIXEL_TEST_TIME(ref_cycles, ref_blend(test_ref, test_src, bytes, 128));
+    pixel_test_report("blend half", cycles, ref_cycles);
+
+    PIXEL_TEST_TIME(cycles, pixel_scale(test_dst, test_src, bytes, 100));
+    PIXEL_TEST_TIME(ref_cycles, ref_scale(test_ref, test_src, bytes, 100));
+    pixel_test_report("scale", cycles, ref_cycles);
+
+    PIXEL_TEST_TIME(cycles, pixel_blend_color_rgb888(test_dst, test_src, PIXEL_TEST_PIXELS, 100));
+    PIXEL_TEST_TIME(ref_cycles, ref_blend_color(test_ref, test_src, PIXEL_TEST_PIXELS, 100));
+    pixel_test_report("blend color", cycles, ref_cycles);
+
+    PIXEL_TEST_TIME(cycles, pixel_fill_rgb888(test_dst, test_src, PIXEL_TEST_PIXELS));
+    PIXEL_TEST_TIME(ref_cycles, ref_blend_color(test_ref, test_src, PIXEL_TEST_PIXELS,
+                                                PIXEL_ALPHA_COPY));
+    pixel_test_report("fill", cycles, ref_cycles);
+
+    PIXEL_TEST_TIME(cycles, pixel_rgb888_to_rgb565(test_565, test_src, PIXEL_TEST_PIXELS));
+    PIXEL_TEST_TIME(ref_cycles, pixel_rgb565_to_rgb888(test_dst, test_565, PIXEL_TEST_PIXELS));
+    pixel_test_report("rgb888 to rgb565", cycles, 0);
+    pixel_test_report("rgb565 to rgb888", ref_cycles, 0);
+
+#undef PIXEL_TEST_TIME
+}
+
+static int pixel_ops_test_init(void)
+{
+    int fail = 0;
+
+    pr_info("simd %s\r\n", PIXEL_OPS_SIMD ? "on" : "off");
+    fail += pixel_test_blend();
+    fail += pixel_test_convert();
+    pr_info("%d failed\r\n", fail);
+    pixel_test_speed();
+
+    return 0;
+}
+task_init(pixel_ops_test_init);
@@ -32,18 +32,18 @@ struct rgb_test {
 static void rgb_test_draw_info_init(struct rgb_test *rt)
 {
     struct ds_draw_area *area;
-    struct ds_data *data;
+    uint16_t *pixels;
     int i;
 
-    rt->draw_info = display_server_alloc_draw_area_info(rt->ds, 0, 0, 6, 6);
+    /* 2 bytes a pixel instead of the 4 of struct ds_data */
+    rt->draw_info = display_server_alloc_draw_area_info_format(rt->ds, 0, 0, 6, 6,
+                                                               DS_FMT_RGB565, 0);
     area = &rt->draw_info->area;
+    pixels = (uint16_t *)area->pixels;
 
-    for (i = 0; i < 36; i++) {
-        data = &area->data[i];
-        data->data[DS_COLOR_R] = 0;
-        data->data[DS_COLOR_G] = 255;
-        data->data[DS_COLOR_B] = 0;
-    }
+    for (i = 0; i < 36; i++)
+        pixels[i] = 0x07e0;
+    ds_commit_draw_info(rt->ds, rt->draw_info);
 }
 
 static void rgb_test_draw_info_update(struct rgb_test *rt)
@@ -61,6 +61,7 @@ static void rgb_test_draw_info_update(struct rgb_test *rt)
         area->y = 0;
     }
     mutex_unlock(&rt->draw_info->lock);
+    ds_commit_draw_info(rt->ds, rt->draw_info);
 }
 
 static void rgb_test_task_entry(void* parameter)
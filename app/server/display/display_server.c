@@ -23,6 +23,18 @@
 
 #include <display/led.h>
 #include <display/display.h>
+#include <display/pixel_ops.h>
+
+#include "ds_cmd.h"
+
+/* damage past this many rects is merged into the nearest one */
+#define DS_DAMAGE_RECTS 4
+
+#ifdef CONFIG_DISPLAY_SERVER_FPS
+#define DS_FPS CONFIG_DISPLAY_SERVER_FPS
+#else
+#define DS_FPS 100
+#endif
 
 struct display_server {
     struct task_struct *task;
@@ -36,8 +48,214 @@ struct display_server {
     bool led_enable;
 
     uint8_t *buf;
+    /* rows converted for an RGB565 device, one is sent while the next is converted */
+    uint16_t *line[2];
+    /* the row converted next, it keeps alternating across rects and frames */
+    uint8_t line_k;
+
+    spinlock_t damage_lock;
+    struct ds_rect damage[DS_DAMAGE_RECTS];
+    int damage_num;
+    struct ds_stats stats;
+    struct frame_sched fs;
 };
 
+static inline uint32_t ds_rect_area(const struct ds_rect *r)
+{
+    return (uint32_t)r->width * r->height;
+}
+
+/* true if a and b overlap or touch, so their union adds no clean pixels between them */
+static bool ds_rect_touch(const struct ds_rect *a, const struct ds_rect *b)
+{
+    return a->x <= b->x + b->width && b->x <= a->x + a->width &&
+           a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+/* only records the rect, the caller wakes the server once it recorded all of them */
+static void ds_damage_record(struct display_server *ds, const struct ds_rect *rect)
+{
+    struct ds_rect screen = {0, 0, ds->dev_info.width, ds->dev_info.height};
+    struct ds_rect r, u;
+    uint32_t grow, best_grow;
+    int i, best;
+
+    if (!ds_rect_intersect(&r, rect, &screen))
+        return;
+
+    spin_lock_irq(&ds->damage_lock);
+    for (i = 0; i < ds->damage_num; i++) {
+        if (!ds_rect_touch(&ds->damage[i], &r))
+            continue;
+        /* take the rect out and retry with the union, it may touch others now */
+        ds_rect_union(&r, &ds->damage[i]);
+        ds->damage[i] = ds->damage[--ds->damage_num];
+        i = -1;
+    }
+    if (ds->damage_num == DS_DAMAGE_RECTS) {
+        best = 0;
+        best_grow = U32_MAX;
+        for (i = 0; i < ds->damage_num; i++) {
+            u = ds->damage[i];
+            ds_rect_union(&u, &r);
+            grow = ds_rect_area(&u) - ds_rect_area(&ds->damage[i]);
+            if (grow < best_grow) {
+                best_grow = grow;
+                best = i;
+            }
+        }
+        ds_rect_union(&ds->damage[best], &r);
+    } else {
+        ds->damage[ds->damage_num++] = r;
+    }
+    spin_unlock_irq(&ds->damage_lock);
+}
+
+static void ds_damage_add(struct display_server *ds, const struct ds_rect *rect)
+{
+    ds_damage_record(ds, rect);
+    sem_send_one(&ds->sem);
+}
+
+static int ds_damage_take(struct display_server *ds, struct ds_rect *rects)
+{
+    int num;
+
+    spin_lock_irq(&ds->damage_lock);
+    num = ds->damage_num;
+    memcpy(rects, ds->damage, sizeof(struct ds_rect) * num);
+    ds->damage_num = 0;
+    spin_unlock_irq(&ds->damage_lock);
+
+    return num;
+}
+
+static void ds_damage_all(struct display_server *ds)
+{
+    struct ds_rect screen = {0, 0, ds->dev_info.width, ds->dev_info.height};
+
+    ds_damage_add(ds, &screen);
+}
+
+/*
+ * The list runs from the bottom layer to the top one, so it is drawn in
+ * order. A new info goes above the others of its layer. The caller holds
+ * ds->lock.
+ */
+static void ds_draw_list_insert(struct display_server *ds, struct ds_draw_info *info)
+{
+    struct ds_draw_info *di;
+
+    list_for_each_entry(di, &ds->draw_list, list) {
+        if (di->layer < info->layer)
+            break;
+    }
+    list_add_tail(&info->list, &di->list);
+}
+
+/* an area info whose pixels the client changes in place under info->lock */
+static inline bool ds_draw_info_in_place(const struct ds_draw_info *info)
+{
+    return !info->point_num && info->area.pixels != NULL;
+}
+
+/**
+ * This function will make the recorded list the one drawn from the next
+ * frame on, and mark what the info covered and covers now as damaged.
+ *
+ * @param ds the display server.
+ * @param info the draw info.
+ *
+ * @return 0 on successful, -EINVAL if info is NULL.
+ */
+int ds_cmd_submit(struct display_server *ds, struct ds_draw_info *info)
+{
+    struct ds_rect old, new;
+
+    if (info == NULL) {
+        pr_err("draw info is NULL\r\n");
+        return -EINVAL;
+    }
+
+    spin_lock_irq(&info->cmd_lock);
+    swap(info->cmd_rec, info->cmd_ready);
+    info->cmd_fresh = true;
+    old = info->footprint;
+    new = info->cmd[info->cmd_ready].bounds;
+    info->footprint = new;
+    spin_unlock_irq(&info->cmd_lock);
+
+    ds_damage_record(ds, &old);
+    ds_damage_record(ds, &new);
+    sem_send_one(&ds->sem);
+
+    return 0;
+}
+
+/* take the last submitted list to draw, the caller holds ds->lock */
+static void ds_draw_info_latch(struct ds_draw_info *info)
+{
+    if (!READ_ONCE(info->cmd_fresh))
+        return;
+
+    spin_lock_irq(&info->cmd_lock);
+    swap(info->cmd_draw, info->cmd_ready);
+    info->cmd_fresh = false;
+    spin_unlock_irq(&info->cmd_lock);
+}
+
+/*
+ * A point info's commit damages only the points that moved or changed since
+ * the last one, their old and new pixel, not the bounds of all the points.
+ */
+static int ds_commit_points(struct display_server *ds, struct ds_draw_info *info)
+{
+    struct ds_rect r = {0, 0, 1, 1};
+    struct ds_draw_point *point, *last;
+    bool damaged = false;
+    int i;
+
+    spin_lock_irq(&info->cmd_lock);
+    swap(info->cmd_rec, info->cmd_ready);
+    info->cmd_fresh = true;
+    info->footprint = info->cmd[info->cmd_ready].bounds;
+    spin_unlock_irq(&info->cmd_lock);
+
+    mutex_lock(&info->lock);
+    for (i = 0; i < info->point_num; i++) {
+        point = &info->point[i];
+        last = &info->point_last[i];
+        if (memcmp(point, last, sizeof(struct ds_draw_point)) == 0)
+            continue;
+        r.x = last->x;
+        r.y = last->y;
+        ds_damage_record(ds, &r);
+        r.x = point->x;
+        r.y = point->y;
+        ds_damage_record(ds, &r);
+        memcpy(last, point, sizeof(struct ds_draw_point));
+        damaged = true;
+    }
+    mutex_unlock(&info->lock);
+
+    if (damaged)
+        sem_send_one(&ds->sem);
+
+    return 0;
+}
+
+/**
+ * This function will move a point of a point info, the move is drawn after
+ * the next ds_commit_draw_info(), so a batch of moves is committed once.
+ *
+ * @param ds the display server.
+ * @param info the point info.
+ * @param point the point, one of info->point.
+ * @param x the new x.
+ * @param y the new y.
+ *
+ * @return 0 on successful, -EINVAL if info or point is NULL.
+ */
 int ds_set_draw_point_loc(struct display_server *ds, struct ds_draw_info *info, struct ds_draw_point *point, uint16_t x, uint16_t y)
 {
     if (info == NULL) {
@@ -64,35 +282,195 @@ int ds_set_draw_point_loc(struct display_server *ds, struct ds_draw_info *info,
     return 0;
 }
 
-struct ds_draw_info *display_server_alloc_draw_point_info(struct display_server *ds, int point_num)
+/**
+ * This function will record the points or the area of an info as its
+ * command list and submit it, call it after changing the data or the
+ * place of an info.
+ *
+ * @param ds the display server.
+ * @param info the draw info.
+ *
+ * @return 0 on successful, -EINVAL if info is NULL or has no points or area.
+ */
+int ds_commit_draw_info(struct display_server *ds, struct ds_draw_info *info)
+{
+    int rc;
+
+    if (info == NULL) {
+        pr_err("draw info is NULL\r\n");
+        return -EINVAL;
+    }
+    if (!info->point_num && !ds_draw_info_in_place(info)) {
+        pr_err("draw info has no points or area, use ds_cmd_submit\r\n");
+        return -EINVAL;
+    }
+
+    /* the list is sized for the points or the area, it can not be full */
+    mutex_lock(&info->lock);
+    ds_cmd_begin(info);
+    if (info->point_num)
+        rc = ds_cmd_set_pixels(info, info->point, info->point_num);
+    else
+        rc = ds_cmd_blit(info, &info->area);
+    mutex_unlock(&info->lock);
+    if (rc < 0)
+        return rc;
+
+    if (info->point_num)
+        return ds_commit_points(ds, info);
+
+    return ds_cmd_submit(ds, info);
+}
+
+/**
+ * This function will move an info to another layer and set its alpha.
+ *
+ * @param ds the display server.
+ * @param info the draw info.
+ * @param layer TOP_LAYER to BACKGROUND_LAYER, a new info is on DEFAULT_LAYER.
+ * @param alpha 0 hides the info, DS_ALPHA_OPAQUE draws it as is.
+ *
+ * @return 0 on successful, -EINVAL if info is NULL.
+ */
+int ds_set_draw_info_layer(struct display_server *ds, struct ds_draw_info *info,
+                           uint8_t layer, uint8_t alpha)
+{
+    if (info == NULL) {
+        pr_err("draw info is NULL\r\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&ds->lock);
+    info->alpha = alpha;
+    if (info->layer != layer) {
+        info->layer = layer;
+        list_del(&info->list);
+        ds_draw_list_insert(ds, info);
+    }
+    mutex_unlock(&ds->lock);
+
+    ds_damage_add(ds, &info->footprint);
+
+    return 0;
+}
+
+/*
+ * An info with payload bytes for its points or area, then its command
+ * lists of cmd_size bytes each. Nothing is drawn until a list is submitted.
+ */
+static struct ds_draw_info *ds_draw_info_alloc(size_t payload, size_t cmd_size)
 {
     struct ds_draw_info *info;
     int i;
 
-    info = kmalloc(sizeof(struct ds_draw_info) + sizeof(struct ds_draw_point) * point_num, GFP_KERNEL);
+    payload = ds_cmd_size(payload);
+    cmd_size = ds_cmd_size(cmd_size);
+    if (cmd_size == 0 || cmd_size > U16_MAX) {
+        pr_err("command list size error, size=%u\r\n", (unsigned int)cmd_size);
+        return NULL;
+    }
+
+    info = kmalloc(sizeof(struct ds_draw_info) + payload + cmd_size * DS_CMD_LISTS, GFP_KERNEL);
     if (info == NULL) {
         pr_err("alloc draw info failed\r\n");
         return NULL;
     }
 
-    info->point_num = point_num;
-    info->point = (struct ds_draw_point *)info->buf;
-    for (i = 0; i < point_num; i++) {
-        memset(&info->point[i], 0, sizeof(struct ds_draw_point));
+    memset(info, 0, sizeof(struct ds_draw_info));
+    for (i = 0; i < DS_CMD_LISTS; i++) {
+        info->cmd[i].buf = info->buf + payload + cmd_size * i;
+        ds_cmd_list_reset(&info->cmd[i]);
     }
+    info->cmd_size = cmd_size;
+    info->cmd_rec = 0;
+    info->cmd_ready = 1;
+    info->cmd_draw = 2;
+    info->layer = DEFAULT_LAYER;
+    info->alpha = DS_ALPHA_OPAQUE;
     mutex_init(&info->lock);
+    spin_lock_init(&info->cmd_lock);
+
+    return info;
+}
+
+static void ds_draw_info_add(struct display_server *ds, struct ds_draw_info *info)
+{
     mutex_lock(&ds->lock);
-    list_add(&info->list, &ds->draw_list);
+    ds_draw_list_insert(ds, info);
     mutex_unlock(&ds->lock);
+}
+
+/**
+ * This function will alloc an info drawn by the commands recorded with
+ * ds_cmd_begin() and the ds_cmd_* functions and submitted with
+ * ds_cmd_submit().
+ *
+ * @param ds the display server.
+ * @param size the bytes of one command list.
+ *
+ * @return the draw info, NULL on error.
+ */
+struct ds_draw_info *display_server_alloc_draw_cmd_info(struct display_server *ds, uint16_t size)
+{
+    struct ds_draw_info *info;
+
+    info = ds_draw_info_alloc(0, size);
+    if (info == NULL)
+        return NULL;
+    ds_draw_info_add(ds, info);
 
     return info;
 }
 
-struct ds_draw_info *display_server_alloc_draw_area_info(struct display_server *ds,
-                                                         uint16_t x, uint16_t y,
-                                                         uint16_t width, uint16_t height)
+struct ds_draw_info *display_server_alloc_draw_point_info(struct display_server *ds, int point_num)
+{
+    struct ds_draw_info *info;
+
+    if (point_num <= 0) {
+        pr_err("point num error, point_num=%d\r\n", point_num);
+        return NULL;
+    }
+
+    /* the points and the points as last committed */
+    info = ds_draw_info_alloc(sizeof(struct ds_draw_point) * point_num * 2,
+                              sizeof(struct ds_cmd_set_pixels) +
+                              sizeof(struct ds_draw_point) * point_num);
+    if (info == NULL)
+        return NULL;
+
+    info->point_num = point_num;
+    info->point = (struct ds_draw_point *)info->buf;
+    info->point_last = info->point + point_num;
+    memset(info->point, 0, sizeof(struct ds_draw_point) * point_num * 2);
+    ds_draw_info_add(ds, info);
+    ds_commit_draw_info(ds, info);
+
+    return info;
+}
+
+/**
+ * This function will alloc an area in a given pixel format, the pixels and
+ * the mask are zeroed, so a masked area starts with nothing drawn.
+ *
+ * @param ds the display server.
+ * @param x the left of the area.
+ * @param y the top of the area.
+ * @param width the area width.
+ * @param height the area height.
+ * @param format the pixel format.
+ * @param flags DS_AREA_MASK and DS_AREA_COLOR_KEY.
+ *
+ * @return the draw info, NULL on error.
+ */
+struct ds_draw_info *display_server_alloc_draw_area_info_format(struct display_server *ds,
+                                                                uint16_t x, uint16_t y,
+                                                                uint16_t width, uint16_t height,
+                                                                enum ds_pixel_format format,
+                                                                uint8_t flags)
 {
     struct ds_draw_info *info;
+    uint16_t stride, mask_stride;
+    size_t size;
 
     if (x + width > ds->dev_info.width) {
         pr_err("x is out of range, x=%u, x_max=%u\r\n",
@@ -105,35 +483,63 @@ struct ds_draw_info *display_server_alloc_draw_area_info(struct display_server *
         return NULL;
     }
 
-    info = kmalloc(sizeof(struct ds_draw_info) + sizeof(struct ds_data) * width * height, GFP_KERNEL);
-    if (info == NULL) {
-        pr_err("alloc draw info failed\r\n");
+    stride = ds_pixel_stride(format, width);
+    if (stride == 0) {
+        pr_err("unknown pixel format: %d\r\n", format);
         return NULL;
     }
+    mask_stride = (flags & DS_AREA_MASK) ? (width + 7) / 8 : 0;
+    size = (stride + mask_stride) * height;
+
+    info = ds_draw_info_alloc(size, sizeof(struct ds_cmd_blit));
+    if (info == NULL)
+        return NULL;
 
-    info->point_num = 0;
     info->area.x = x;
     info->area.y = y;
     info->area.width = width;
     info->area.height = height;
-    info->area.data = (struct ds_data *)info->buf;
-    memset(info->buf, 0, sizeof(struct ds_data) * width * height);
-    mutex_init(&info->lock);
-    mutex_lock(&ds->lock);
-    list_add(&info->list, &ds->draw_list);
-    mutex_unlock(&ds->lock);
+    info->area.pixels = info->buf;
+    info->area.format = format;
+    info->area.flags = flags;
+    info->area.stride = stride;
+    info->area.mask_stride = mask_stride;
+    if (flags & DS_AREA_MASK)
+        info->area.mask = info->buf + stride * height;
+    memset(info->buf, 0, size);
+    ds_draw_info_add(ds, info);
+    ds_commit_draw_info(ds, info);
 
     return info;
 }
 
+struct ds_draw_info *display_server_alloc_draw_area_info(struct display_server *ds,
+                                                         uint16_t x, uint16_t y,
+                                                         uint16_t width, uint16_t height)
+{
+    return display_server_alloc_draw_area_info_format(ds, x, y, width, height, DS_FMT_DATA, 0);
+}
+
 void display_server_free_draw_info(struct display_server *ds, struct ds_draw_info *info)
 {
     mutex_lock(&ds->lock);
     list_del(&info->list);
     mutex_unlock(&ds->lock);
+    ds_damage_add(ds, &info->footprint);
     kfree(info);
 }
 
+static void display_server_dump_stats(struct display_server *ds)
+{
+    struct ds_stats *stats = &ds->stats;
+
+    stats->cpu_usage = task_get_cpu_usage(ds->task) / 100;
+    pr_info("frames=%u, rects=%u, pixels=%u, culled=%u, cpu=%u.%02u%%\r\n",
+            stats->frames, stats->rects, stats->pixels, stats->culled_rects,
+            stats->cpu_usage / 100, stats->cpu_usage % 100);
+    frame_sched_dump(&ds->fs, "display_server");
+}
+
 static int display_server_control(struct device *dev, int cmd, void *args)
 {
     struct display_server *ds = dev->priv;
@@ -142,7 +548,8 @@ static int display_server_control(struct device *dev, int cmd, void *args)
     case DS_CTRL_ENABLE:
         ds->led_dev->ops.control(ds->led_dev, LED_CTRL_ENABLE, NULL);
         ds->led_enable = true;
-        sem_send_one(&ds->sem);
+        /* the device was cleared when it was disabled */
+        ds_damage_all(ds);
         break;
     case DS_CTRL_DISABLE:
         ds->led_enable = false;
@@ -159,6 +566,18 @@ static int display_server_control(struct device *dev, int cmd, void *args)
     case DS_CTRL_GET_DEV_INFO:
         memcpy(args, &ds->dev_info, sizeof(struct display_dev_info));
         break;
+    case DS_CTRL_GET_STATS:
+        ds->stats.cpu_usage = task_get_cpu_usage(ds->task) / 100;
+        memcpy(args, &ds->stats, sizeof(struct ds_stats));
+        break;
+    case DS_CTRL_GET_FRAME_STATS:
+        frame_sched_get_stats(&ds->fs, args);
+        break;
+    case DS_CTRL_SET_FRAME_RATE:
+        return frame_sched_set_rate(&ds->fs, *(uint32_t *)args);
+    case DS_CTRL_DUMP_STATS:
+        display_server_dump_stats(ds);
+        break;
     default:
         pr_err("unknown cmd: %d\r\n", cmd);
         return -EINVAL;
@@ -167,58 +586,117 @@ static int display_server_control(struct device *dev, int cmd, void *args)
     return 0;
 }
 
-static void display_server_merge_point(struct display_server *ds, struct ds_draw_point *point)
+/* an opaque info whose drawn list has an opaque rect over the whole clip */
+static bool ds_draw_info_hides(const struct ds_draw_info *info, const struct ds_rect *clip)
 {
-    int index;
+    const struct ds_rect *opaque = &info->cmd[info->cmd_draw].opaque;
 
-    if (point->data.cmd == DS_DATA_CMD_TRANSPARENT)
-        return;
+    return info->alpha == DS_ALPHA_OPAQUE && opaque->width &&
+           opaque->x <= clip->x && opaque->y <= clip->y &&
+           opaque->x + opaque->width >= clip->x + clip->width &&
+           opaque->y + opaque->height >= clip->y + clip->height;
+}
 
-    index = (point->y * ds->dev_info.width + point->x) * DS_COLOR_DATA_MAX;
-    memcpy(ds->buf + index, point->data.data, DS_COLOR_DATA_MAX);
+/*
+ * Recompose one damaged rect, everything outside it is left as it is.
+ * Drawing starts at the top info with an opaque rect over the whole rect, the
+ * infos below it and the clear are skipped.
+ */
+static void display_server_merge_rect(struct display_server *ds, const struct ds_rect *clip)
+{
+    struct ds_draw_info *di, *start = NULL;
+    uint16_t alpha;
+    int y;
+
+    list_for_each_entry(di, &ds->draw_list, list) {
+        if (ds_draw_info_hides(di, clip))
+            start = di;
+    }
+
+    if (start == NULL) {
+        for (y = clip->y; y < clip->y + clip->height; y++)
+            memset(ds->buf + (y * ds->dev_info.width + clip->x) * DS_COLOR_DATA_MAX, 0,
+                   clip->width * DS_COLOR_DATA_MAX);
+        di = list_first_entry(&ds->draw_list, struct ds_draw_info, list);
+    } else {
+        di = start;
+        ds->stats.culled_rects++;
+    }
+
+    list_for_each_entry_from(di, &ds->draw_list, list) {
+        if (di->alpha == 0)
+            continue;
+        alpha = di->alpha == DS_ALPHA_OPAQUE ? DS_PIXEL_ALPHA_COPY : di->alpha;
+        /* the list is the server's own, only pixels changed in place need the lock */
+        if (ds_draw_info_in_place(di)) {
+            mutex_lock(&di->lock);
+            ds_cmd_replay(ds->buf, ds->dev_info.width, &di->cmd[di->cmd_draw], clip, alpha);
+            mutex_unlock(&di->lock);
+        } else {
+            ds_cmd_replay(ds->buf, ds->dev_info.width, &di->cmd[di->cmd_draw], clip, alpha);
+        }
+    }
 }
 
-static void display_server_merge_area(struct display_server *ds, struct ds_draw_area *area)
+/* one write per row of the rect, pos is the byte offset in the frame */
+static void display_server_write_rect(struct display_server *ds, const struct ds_rect *rect)
 {
-    int x, y;
-    int index;
-    int data_index;
-
-    for (y = area->y; y < area->y + area->height; y++) {
-        for (x = area->x; x < area->x + area->width; x++) {
-            data_index = (y - area->y) * area->width + (x - area->x);
-            if (area->data[data_index].cmd == DS_DATA_CMD_TRANSPARENT)
-                continue;
-            index = (y * ds->dev_info.width + x) * DS_COLOR_DATA_MAX;
-            memcpy(ds->buf + index, area->data[data_index].data, DS_COLOR_DATA_MAX);
+    size_t pos;
+    uint16_t *line;
+    int y;
+
+    if (ds->dev_info.flags & DISPLAY_DEV_RGB565) {
+        for (y = rect->y; y < rect->y + rect->height; y++) {
+            pos = y * ds->dev_info.width + rect->x;
+            /* a device writing by dma may still read the row written before */
+            line = ds->line[ds->line_k];
+            ds->line_k ^= 1;
+            pixel_rgb888_to_rgb565(line, ds->buf + pos * DS_COLOR_DATA_MAX, rect->width);
+            ds->led_dev->ops.write(ds->led_dev, pos, line, rect->width * sizeof(uint16_t));
         }
+        return;
+    }
+
+    for (y = rect->y; y < rect->y + rect->height; y++) {
+        pos = (y * ds->dev_info.width + rect->x) * DS_COLOR_DATA_MAX;
+        ds->led_dev->ops.write(ds->led_dev, pos, ds->buf + pos,
+                               rect->width * DS_COLOR_DATA_MAX);
     }
 }
 
-static void display_server_merge_buf(struct display_server *ds)
+/* the damage is taken before the lists, a list submitted in between is drawn next frame */
+static void display_server_update(struct display_server *ds, const struct ds_rect *rects, int num)
 {
     struct ds_draw_info *di;
     int i;
 
     mutex_lock(&ds->lock);
-    memset(ds->buf, 0, ds->dev_info.width * ds->dev_info.height * DS_COLOR_DATA_MAX);
-    list_for_each_entry(di, &ds->draw_list, list) {
-        mutex_lock(&di->lock);
-        if (di->point_num) {
-            for (i = 0; i < di->point_num; i++) {
-                display_server_merge_point(ds, &di->point[i]);
-            }
-        } else {
-            display_server_merge_area(ds, &di->area);
-        }
-        mutex_unlock(&di->lock);
+    list_for_each_entry(di, &ds->draw_list, list)
+        ds_draw_info_latch(di);
+    for (i = 0; i < num; i++) {
+        display_server_merge_rect(ds, &rects[i]);
+        ds->stats.pixels += ds_rect_area(&rects[i]);
+    }
+    frame_sched_composed(&ds->fs);
+    /* an RGB565 write is of any pixels, so it goes by the rects */
+    if (ds->dev_info.flags & (DISPLAY_DEV_PARTIAL_WRITE | DISPLAY_DEV_RGB565)) {
+        for (i = 0; i < num; i++)
+            display_server_write_rect(ds, &rects[i]);
+    } else {
+        ds->led_dev->ops.write(ds->led_dev, 0, ds->buf,
+            ds->dev_info.width * ds->dev_info.height * DS_COLOR_DATA_MAX);
     }
     mutex_unlock(&ds->lock);
+
+    ds->stats.frames++;
+    ds->stats.rects += num;
 }
 
 static void display_server_task_entry(void* parameter)
 {
     struct display_server *ds = parameter;
+    struct ds_rect rects[DS_DAMAGE_RECTS];
+    int num;
     int i;
 
     ds->led_dev = NULL;
@@ -246,25 +724,47 @@ static void display_server_task_entry(void* parameter)
         return;
     }
     memset(ds->buf, 0, ds->dev_info.width * ds->dev_info.height * DS_COLOR_DATA_MAX);
-    pr_info("display device:[%s] %u*%u\r\n", CONFIG_LED_DEV, ds->dev_info.width, ds->dev_info.height);
+    if (ds->dev_info.flags & DISPLAY_DEV_RGB565) {
+        for (i = 0; i < 2; i++) {
+            ds->line[i] = kmalloc(ds->dev_info.width * sizeof(uint16_t), GFP_KERNEL);
+            if (ds->line[i] == NULL) {
+                pr_err("alloc line buf error\r\n");
+                return;
+            }
+        }
+    }
+    pr_info("display device:[%s] %u*%u, partial write %s\r\n", CONFIG_LED_DEV,
+            ds->dev_info.width, ds->dev_info.height,
+            (ds->dev_info.flags & DISPLAY_DEV_PARTIAL_WRITE) ? "on" : "off");
 
     ds->led_enable = true;
     ds->led_dev->ops.control(ds->led_dev, LED_CTRL_ENABLE, NULL);
+    ds_damage_all(ds);
+    frame_sched_init(&ds->fs, DS_FPS);
 
     device_register(&ds->ds_dev);
 
     while (true) {
-        if (ds->led_enable) {
-            display_server_merge_buf(ds);
-            mutex_lock(&ds->lock);
-            ds->led_dev->ops.write(ds->led_dev, 0, ds->buf,
-                ds->dev_info.width * ds->dev_info.height * DS_COLOR_DATA_MAX);
-            mutex_unlock(&ds->lock);
-            ds->led_dev->ops.control(ds->led_dev, LED_CTRL_REFRESH, NULL);
-            msleep(10);
-        } else {
+        /* nothing is composed or written until a client damages something */
+        if (!ds->led_enable || READ_ONCE(ds->damage_num) == 0) {
             sem_get(&ds->sem);
+            continue;
         }
+
+        frame_sched_wait(&ds->fs);
+        /* the device still sends the last frame, the damage waits for the next slot */
+        if (ds->led_dev->ops.control(ds->led_dev, LED_CTRL_GET_BUSY, NULL) > 0) {
+            frame_sched_skip(&ds->fs);
+            continue;
+        }
+
+        num = ds_damage_take(ds, rects);
+        if (num == 0)
+            continue;
+        display_server_update(ds, rects, num);
+        if (!(ds->dev_info.flags & DISPLAY_DEV_RGB565))
+            ds->led_dev->ops.control(ds->led_dev, LED_CTRL_REFRESH, NULL);
+        frame_sched_done(&ds->fs);
     }
 }
 
@@ -281,6 +781,10 @@ static int display_server_init(void)
     sem_init(&ds->sem, 0);
     mutex_init(&ds->lock);
     INIT_LIST_HEAD(&ds->draw_list);
+    spin_lock_init(&ds->damage_lock);
+    ds->damage_num = 0;
+    ds->line_k = 0;
+    memset(&ds->stats, 0, sizeof(ds->stats));
 
     device_init(&ds->ds_dev);
     ds->ds_dev.name = "display-server";
@@ -53,6 +53,7 @@ struct draw_demo {
     struct device *ds_dev;
     struct display_server *ds;
     struct ds_draw_info *draw_info;
+    struct ds_draw_point point[DEMO_LEN];
     int index;
 };
 
@@ -62,15 +63,18 @@ static void draw_demo_data_init(struct draw_demo *dd)
     struct ds_data *data;
     int i;
 
-    dd->draw_info = display_server_alloc_draw_point_info(dd->ds, DEMO_LEN);
-    point = dd->draw_info->point;
+    /* the points are recorded as one command each frame */
+    dd->draw_info = display_server_alloc_draw_cmd_info(dd->ds, DS_CMD_PIXELS_SIZE(DEMO_LEN));
+    point = dd->point;
     dd->index = 0;
+    /* a translucent overlay on whatever else is drawn */
+    ds_set_draw_info_layer(dd->ds, dd->draw_info, TOP_LAYER, 192);
 
-    mutex_lock(&dd->draw_info->lock);
+    memset(point, 0, sizeof(dd->point));
     for (i = 0; i < DEMO_LEN; i++) {
-        data = &point->data;
-        point->x = index_map[INDEX_X][i];
-        point->y = index_map[INDEX_Y][i];
+        data = &point[i].data;
+        point[i].x = index_map[INDEX_X][i];
+        point[i].y = index_map[INDEX_Y][i];
         switch(i) {
             case 0:
                 data->data[DS_COLOR_R] = 5;
@@ -101,7 +105,9 @@ static void draw_demo_data_init(struct draw_demo *dd)
                 break;
         }
     }
-    mutex_unlock(&dd->draw_info->lock);
+    ds_cmd_begin(dd->draw_info);
+    ds_cmd_set_pixels(dd->draw_info, point, DEMO_LEN);
+    ds_cmd_submit(dd->ds, dd->draw_info);
 }
 
 static void draw_demo_data_update(struct draw_demo *dd)
@@ -110,8 +116,7 @@ static void draw_demo_data_update(struct draw_demo *dd)
     int index;
     int i;
 
-    mutex_lock(&dd->draw_info->lock);
-    point = dd->draw_info->point;
+    point = dd->point;
     for (i = 0; i < DEMO_LEN; i++) {
         dd->index++;
         if (dd->index >= LED_NUM)
@@ -119,10 +124,12 @@ static void draw_demo_data_update(struct draw_demo *dd)
         index = dd->index + i;
         if (index >= LED_NUM)
             index -= LED_NUM;
-        point->x = index_map[INDEX_X][index];
-        point->y = index_map[INDEX_Y][index];
+        point[i].x = index_map[INDEX_X][index];
+        point[i].y = index_map[INDEX_Y][index];
     }
-    mutex_unlock(&dd->draw_info->lock);
+    ds_cmd_begin(dd->draw_info);
+    ds_cmd_set_pixels(dd->draw_info, point, DEMO_LEN);
+    ds_cmd_submit(dd->ds, dd->draw_info);
 }
 
 static void draw_demo_task_entry(void* parameter)
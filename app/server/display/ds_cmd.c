@@ -0,0 +1,425 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#include <kernel/errno.h>
+#include "ds_cmd.h"
+
+/*
+ * A client records commands into its own list with no lock, the list
+ * keeps the bounds of what it draws for the damage and the largest opaque
+ * rect for the culling. Submitting swaps the list with the last submitted
+ * one, the server swaps that with the one it draws at the start of a frame,
+ * so a list is never written while it is replayed.
+ */
+
+static const uint8_t ds_font_3x5_glyphs[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, /* space */
+    0x40, 0x40, 0x40, 0x00, 0x40, /* ! */
+    0xa0, 0xa0, 0x00, 0x00, 0x00, /* " */
+    0xa0, 0xe0, 0xa0, 0xe0, 0xa0, /* # */
+    0x60, 0xc0, 0x40, 0x60, 0xc0, /* $ */
+    0x80, 0x20, 0x40, 0x80, 0x20, /* % */
+    0x40, 0xa0, 0x40, 0xa0, 0x60, /* & */
+    0x40, 0x40, 0x00, 0x00, 0x00, /* ' */
+    0x20, 0x40, 0x40, 0x40, 0x20, /* ( */
+    0x80, 0x40, 0x40, 0x40, 0x80, /* ) */
+    0x00, 0xa0, 0x40, 0xa0, 0x00, /* * */
+    0x00, 0x40, 0xe0, 0x40, 0x00, /* + */
+    0x00, 0x00, 0x00, 0x40, 0x80, /* , */
+    0x00, 0x00, 0xe0, 0x00, 0x00, /* - */
+    0x00, 0x00, 0x00, 0x00, 0x40, /* . */
+    0x20, 0x20, 0x40, 0x80, 0x80, /* / */
+    0xe0, 0xa0, 0xa0, 0xa0, 0xe0, /* 0 */
+    0x40, 0xc0, 0x40, 0x40, 0xe0, /* 1 */
+    0xe0, 0x20, 0xe0, 0x80, 0xe0, /* 2 */
+    0xe0, 0x20, 0x60, 0x20, 0xe0, /* 3 */
+    0xa0, 0xa0, 0xe0, 0x20, 0x20, /* 4 */
+    0xe0, 0x80, 0xe0, 0x20, 0xe0, /* 5 */
+    0xe0, 0x80, 0xe0, 0xa0, 0xe0, /* 6 */
+    0xe0, 0x20, 0x40, 0x40, 0x40, /* 7 */
+    0xe0, 0xa0, 0xe0, 0xa0, 0xe0, /* 8 */
+    0xe0, 0xa0, 0xe0, 0x20, 0xe0, /* 9 */
+    0x00, 0x40, 0x00, 0x40, 0x00, /* : */
+    0x00, 0x40, 0x00, 0x40, 0x80, /* ; */
+    0x20, 0x40, 0x80, 0x40, 0x20, /* < */
+    0x00, 0xe0, 0x00, 0xe0, 0x00, /* = */
+    0x80, 0x40, 0x20, 0x40, 0x80, /* > */
+    0xe0, 0x20, 0x40, 0x00, 0x40, /* ? */
+    0xe0, 0xa0, 0xa0, 0x80, 0xe0, /* @ */
+    0x40, 0xa0, 0xe0, 0xa0, 0xa0, /* A */
+    0xc0, 0xa0, 0xc0, 0xa0, 0xc0, /* B */
+    0x60, 0x80, 0x80, 0x80, 0x60, /* C */
+    0xc0, 0xa0, 0xa0, 0xa0, 0xc0, /* D */
+    0xe0, 0x80, 0xc0, 0x80, 0xe0, /* E */
+    0xe0, 0x80, 0xc0, 0x80, 0x80, /* F */
+    0x60, 0x80, 0xa0, 0xa0, 0x60, /* G */
+    0xa0, 0xa0, 0xe0, 0xa0, 0xa0, /* H */
+    0xe0, 0x40, 0x40, 0x40, 0xe0, /* I */
+    0x20, 0x20, 0x20, 0xa0, 0x40, /* J */
+    0xa0, 0xa0, 0xc0, 0xa0, 0xa0, /* K */
+    0x80, 0x80, 0x80, 0x80, 0xe0, /* L */
+    0xa0, 0xe0, 0xe0, 0xa0, 0xa0, /* M */
+    0xc0, 0xa0, 0xa0, 0xa0, 0xa0, /* N */
+    0x40, 0xa0, 0xa0, 0xa0, 0x40, /* O */
+    0xc0, 0xa0, 0xc0, 0x80, 0x80, /* P */
+    0x40, 0xa0, 0xa0, 0xc0, 0x60, /* Q */
+    0xc0, 0xa0, 0xc0, 0xa0, 0xa0, /* R */
+    0x60, 0x80, 0x40, 0x20, 0xc0, /* S */
+    0xe0, 0x40, 0x40, 0x40, 0x40, /* T */
+    0xa0, 0xa0, 0xa0, 0xa0, 0xe0, /* U */
+    0xa0, 0xa0, 0xa0, 0xa0, 0x40, /* V */
+    0xa0, 0xa0, 0xe0, 0xe0, 0xa0, /* W */
+    0xa0, 0xa0, 0x40, 0xa0, 0xa0, /* X */
+    0xa0, 0xa0, 0x40, 0x40, 0x40, /* Y */
+    0xe0, 0x20, 0x40, 0x80, 0xe0, /* Z */
+    0xc0, 0x80, 0x80, 0x80, 0xc0, /* [ */
+    0x80, 0x80, 0x40, 0x20, 0x20, /* backslash */
+    0x60, 0x20, 0x20, 0x20, 0x60, /* ] */
+    0x40, 0xa0, 0x00, 0x00, 0x00, /* ^ */
+    0x00, 0x00, 0x00, 0x00, 0xe0, /* _ */
+};
+
+const struct ds_font ds_font_3x5 = {
+    .width = 3,
+    .height = 5,
+    .first = 0x20,
+    .num = 0x40,
+    .glyphs = ds_font_3x5_glyphs,
+};
+
+static const uint8_t *ds_font_glyph(const struct ds_font *font, char c)
+{
+    int index = (uint8_t)c - font->first;
+
+    if (index >= font->num && c >= 'a' && c <= 'z')
+        index -= 'a' - 'A';
+    if (index < 0 || index >= font->num)
+        return NULL;
+
+    return font->glyphs + index * font->height * ((font->width + 7) / 8);
+}
+
+void ds_cmd_list_reset(struct ds_cmd_list *list)
+{
+    list->len = 0;
+    memset(&list->bounds, 0, sizeof(list->bounds));
+    memset(&list->opaque, 0, sizeof(list->opaque));
+}
+
+static void ds_cmd_bound(struct ds_cmd_list *list, const struct ds_rect *rect, bool opaque)
+{
+    if (rect->width == 0 || rect->height == 0)
+        return;
+
+    if (list->bounds.width == 0)
+        list->bounds = *rect;
+    else
+        ds_rect_union(&list->bounds, rect);
+
+    if (opaque && (uint32_t)rect->width * rect->height >
+                  (uint32_t)list->opaque.width * list->opaque.height)
+        list->opaque = *rect;
+}
+
+/* room for a command at the end of the recording list, NULL if it is full */
+static void *ds_cmd_add(struct ds_draw_info *info, uint8_t type, size_t size)
+{
+    struct ds_cmd_list *list = &info->cmd[info->cmd_rec];
+    struct ds_cmd *cmd;
+
+    size = ds_cmd_size(size);
+    if (list->len + size > info->cmd_size)
+        return NULL;
+
+    cmd = (struct ds_cmd *)(list->buf + list->len);
+    cmd->type = type;
+    cmd->reserved = 0;
+    cmd->size = size;
+    list->len += size;
+
+    return cmd;
+}
+
+/**
+ * This function will start a new recording, what was recorded and not
+ * submitted is dropped. Only one task records into an info.
+ *
+ * @param info the draw info.
+ */
+void ds_cmd_begin(struct ds_draw_info *info)
+{
+    ds_cmd_list_reset(&info->cmd[info->cmd_rec]);
+}
+
+/**
+ * This function will record a filled rect.
+ *
+ * @param info the draw info.
+ * @param rect the rect.
+ * @param color the color in DS_COLOR_* order.
+ *
+ * @return 0 on successful, -ENOSPC if the list is full.
+ */
+int ds_cmd_fill_rect(struct ds_draw_info *info, const struct ds_rect *rect,
+                     const uint8_t color[DS_COLOR_DATA_MAX])
+{
+    struct ds_cmd_fill_rect *cmd;
+
+    cmd = ds_cmd_add(info, DS_CMD_FILL_RECT, sizeof(*cmd));
+    if (cmd == NULL)
+        return -ENOSPC;
+
+    cmd->rect = *rect;
+    memcpy(cmd->color, color, DS_COLOR_DATA_MAX);
+    ds_cmd_bound(&info->cmd[info->cmd_rec], rect, true);
+
+    return 0;
+}
+
+/**
+ * This function will record an area, only its description is copied, the
+ * pixels are read when a frame is drawn. Changing them in place may show
+ * half of the change for one frame.
+ *
+ * @param info the draw info.
+ * @param area the area.
+ *
+ * @return 0 on successful, -ENOSPC if the list is full.
+ */
+int ds_cmd_blit(struct ds_draw_info *info, const struct ds_draw_area *area)
+{
+    struct ds_rect rect = {area->x, area->y, area->width, area->height};
+    struct ds_cmd_blit *cmd;
+
+    cmd = ds_cmd_add(info, DS_CMD_BLIT, sizeof(*cmd));
+    if (cmd == NULL)
+        return -ENOSPC;
+
+    cmd->area = *area;
+    ds_cmd_bound(&info->cmd[info->cmd_rec], &rect, ds_pixel_area_opaque(area));
+
+    return 0;
+}
+
+/**
+ * This function will record single pixels, a transparent one is skipped.
+ *
+ * @param info the draw info.
+ * @param point the pixels, they are copied.
+ * @param num the pixel count.
+ *
+ * @return 0 on successful, -ENOSPC if the list is full.
+ */
+int ds_cmd_set_pixels(struct ds_draw_info *info, const struct ds_draw_point *point, int num)
+{
+    struct ds_cmd_list *list = &info->cmd[info->cmd_rec];
+    struct ds_cmd_set_pixels *cmd;
+    struct ds_rect pt;
+    int i;
+
+    if (num <= 0 || num > U16_MAX)
+        return -EINVAL;
+
+    cmd = ds_cmd_add(info, DS_CMD_SET_PIXELS,
+                     sizeof(*cmd) + sizeof(struct ds_draw_point) * num);
+    if (cmd == NULL)
+        return -ENOSPC;
+
+    cmd->num = num;
+    memcpy(cmd->point, point, sizeof(struct ds_draw_point) * num);
+    pt.width = 1;
+    pt.height = 1;
+    for (i = 0; i < num; i++) {
+        if (point[i].data.cmd == DS_DATA_CMD_TRANSPARENT)
+            continue;
+        pt.x = point[i].x;
+        pt.y = point[i].y;
+        ds_cmd_bound(list, &pt, false);
+    }
+
+    return 0;
+}
+
+/**
+ * This function will record a line of text, one column is left between
+ * the chars.
+ *
+ * @param info the draw info.
+ * @param x the left of the first char.
+ * @param y the top of the line.
+ * @param font the font, it must stay valid, ds_font_3x5 is built in.
+ * @param color the color in DS_COLOR_* order.
+ * @param text at most U8_MAX chars, a char not in the font is a blank.
+ *
+ * @return 0 on successful, -ENOSPC if the list is full.
+ */
+int ds_cmd_text(struct ds_draw_info *info, uint16_t x, uint16_t y,
+                const struct ds_font *font, const uint8_t color[DS_COLOR_DATA_MAX],
+                const char *text)
+{
+    struct ds_cmd_text *cmd;
+    struct ds_rect rect;
+    size_t len = strlen(text);
+
+    if (font == NULL || len > U8_MAX)
+        return -EINVAL;
+    if (len == 0)
+        return 0;
+
+    cmd = ds_cmd_add(info, DS_CMD_TEXT, sizeof(*cmd) + len);
+    if (cmd == NULL)
+        return -ENOSPC;
+
+    cmd->x = x;
+    cmd->y = y;
+    cmd->font = font;
+    memcpy(cmd->color, color, DS_COLOR_DATA_MAX);
+    cmd->len = len;
+    memcpy(cmd->text, text, len);
+
+    rect.x = x;
+    rect.y = y;
+    rect.width = min_t(uint32_t, len * (font->width + 1) - 1, U16_MAX - x);
+    rect.height = min_t(uint32_t, font->height, U16_MAX - y);
+    ds_cmd_bound(&info->cmd[info->cmd_rec], &rect, false);
+
+    return 0;
+}
+
+static void ds_cmd_replay_fill(uint8_t *frame, uint16_t frame_width,
+                               const struct ds_cmd_fill_rect *cmd,
+                               const struct ds_rect *clip, uint16_t alpha)
+{
+    struct ds_rect r;
+    int y;
+
+    if (!ds_rect_intersect(&r, &cmd->rect, clip))
+        return;
+
+    for (y = r.y; y < r.y + r.height; y++) {
+        pixel_blend_color_rgb888(frame + (y * frame_width + r.x) * DS_COLOR_DATA_MAX,
+                                 cmd->color, r.width, alpha);
+    }
+}
+
+static void ds_cmd_replay_blit(uint8_t *frame, uint16_t frame_width,
+                               const struct ds_cmd_blit *cmd,
+                               const struct ds_rect *clip, uint16_t alpha)
+{
+    const struct ds_draw_area *area = &cmd->area;
+    struct ds_rect rect = {area->x, area->y, area->width, area->height};
+    struct ds_rect r;
+
+    if (!ds_rect_intersect(&r, &rect, clip))
+        return;
+
+    ds_pixel_merge_area(frame, frame_width, area, &r, alpha);
+}
+
+static void ds_cmd_replay_pixels(uint8_t *frame, uint16_t frame_width,
+                                 const struct ds_cmd_set_pixels *cmd,
+                                 const struct ds_rect *clip, uint16_t alpha)
+{
+    const struct ds_draw_point *point;
+    int i;
+
+    for (i = 0; i < cmd->num; i++) {
+        point = &cmd->point[i];
+        if (point->data.cmd == DS_DATA_CMD_TRANSPARENT)
+            continue;
+        if (point->x < clip->x || point->x >= clip->x + clip->width ||
+            point->y < clip->y || point->y >= clip->y + clip->height)
+            continue;
+        ds_pixel_put(frame + (point->y * frame_width + point->x) * DS_COLOR_DATA_MAX,
+                     point->data.data, alpha);
+    }
+}
+
+/* every glyph is merged as a mono area in the text color */
+static void ds_cmd_replay_text(uint8_t *frame, uint16_t frame_width,
+                               const struct ds_cmd_text *cmd,
+                               const struct ds_rect *clip, uint16_t alpha)
+{
+    const struct ds_font *font = cmd->font;
+    struct ds_draw_area glyph;
+    struct ds_rect rect, r;
+    const uint8_t *bits;
+    int i, x;
+
+    memset(&glyph, 0, sizeof(glyph));
+    glyph.width = font->width;
+    glyph.height = font->height;
+    glyph.format = DS_FMT_MONO1;
+    glyph.stride = (font->width + 7) / 8;
+    memcpy(glyph.fg, cmd->color, DS_COLOR_DATA_MAX);
+
+    for (i = 0; i < cmd->len; i++) {
+        x = cmd->x + i * (font->width + 1);
+        if (x >= clip->x + clip->width)
+            break;
+        bits = ds_font_glyph(font, cmd->text[i]);
+        if (bits == NULL)
+            continue;
+
+        rect.x = x;
+        rect.y = cmd->y;
+        rect.width = font->width;
+        rect.height = font->height;
+        if (!ds_rect_intersect(&r, &rect, clip))
+            continue;
+
+        glyph.x = x;
+        glyph.y = cmd->y;
+        glyph.pixels = (uint8_t *)bits;
+        ds_pixel_merge_area(frame, frame_width, &glyph, &r, alpha);
+    }
+}
+
+/**
+ * This function will draw the part of a list inside clip into the frame.
+ *
+ * @param frame the RGB888 frame.
+ * @param frame_width the frame width in pixels.
+ * @param list the list, it is not changed while it is replayed.
+ * @param clip the frame rect to draw.
+ * @param alpha 1 to 255, or DS_PIXEL_ALPHA_COPY.
+ */
+void ds_cmd_replay(uint8_t *frame, uint16_t frame_width, const struct ds_cmd_list *list,
+                   const struct ds_rect *clip, uint16_t alpha)
+{
+    const struct ds_cmd *cmd;
+    struct ds_rect r;
+    uint16_t pos;
+
+    if (!ds_rect_intersect(&r, &list->bounds, clip))
+        return;
+
+    for (pos = 0; pos < list->len; pos += cmd->size) {
+        cmd = (const struct ds_cmd *)(list->buf + pos);
+        switch (cmd->type) {
+        case DS_CMD_FILL_RECT:
+            ds_cmd_replay_fill(frame, frame_width,
+                               (const struct ds_cmd_fill_rect *)cmd, &r, alpha);
+            break;
+        case DS_CMD_BLIT:
+            ds_cmd_replay_blit(frame, frame_width,
+                               (const struct ds_cmd_blit *)cmd, &r, alpha);
+            break;
+        case DS_CMD_SET_PIXELS:
+            ds_cmd_replay_pixels(frame, frame_width,
+                                 (const struct ds_cmd_set_pixels *)cmd, &r, alpha);
+            break;
+        case DS_CMD_TEXT:
+            ds_cmd_replay_text(frame, frame_width,
+                               (const struct ds_cmd_text *)cmd, &r, alpha);
+            break;
+        default:
+            break;
+        }
+    }
+}
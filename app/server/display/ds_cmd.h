@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __DS_CMD_H__
+#define __DS_CMD_H__
+
+#include "ds_pixel.h"
+
+/* every command starts on this, the blit one holds pointers */
+#define DS_CMD_ALIGN sizeof(void *)
+
+enum ds_cmd_type {
+    DS_CMD_FILL_RECT = 1,
+    DS_CMD_BLIT,
+    DS_CMD_SET_PIXELS,
+    DS_CMD_TEXT,
+};
+
+struct ds_cmd {
+    uint8_t type;
+    uint8_t reserved;
+    /* of the whole command, a multiple of DS_CMD_ALIGN */
+    uint16_t size;
+};
+
+struct ds_cmd_fill_rect {
+    struct ds_cmd head;
+    struct ds_rect rect;
+    uint8_t color[DS_COLOR_DATA_MAX];
+};
+
+/* a copy of the area, the pixels stay with the client */
+struct ds_cmd_blit {
+    struct ds_cmd head;
+    struct ds_draw_area area;
+};
+
+struct ds_cmd_set_pixels {
+    struct ds_cmd head;
+    uint16_t num;
+    struct ds_draw_point point[];
+};
+
+struct ds_cmd_text {
+    struct ds_cmd head;
+    uint16_t x;
+    uint16_t y;
+    const struct ds_font *font;
+    uint8_t color[DS_COLOR_DATA_MAX];
+    uint8_t len;
+    char text[];
+};
+
+static inline size_t ds_cmd_size(size_t size)
+{
+    return (size + DS_CMD_ALIGN - 1) & ~(DS_CMD_ALIGN - 1);
+}
+
+void ds_cmd_list_reset(struct ds_cmd_list *list);
+void ds_cmd_replay(uint8_t *frame, uint16_t frame_width, const struct ds_cmd_list *list,
+                   const struct ds_rect *clip, uint16_t alpha);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#include "ds_pixel.h"
+
+/*
+ * An area row is cut into runs of drawn pixels by its mask, whole bytes
+ * and words of clear mask bits are skipped at once. Each run is then merged
+ * by a loop made for the source format, runs without a color key go to the
+ * pixel ops, which blend 4 bytes at a time on the m4.
+ */
+
+/* RGB565 pixels converted at once on the stack before a blend */
+#define DS_PIXEL_CHUNK 32
+
+typedef void (*ds_pixel_run_t)(const struct ds_draw_area *area, const uint8_t *row,
+                               int x, int n, uint8_t *dst, uint16_t alpha);
+
+/* first bit in [i, end) that is set, or clear, end if none, msb first */
+static int ds_bits_find(const uint8_t *bits, int i, int end, bool set)
+{
+    uint32_t skip32 = set ? 0 : U32_MAX;
+    uint8_t skip8 = (uint8_t)skip32;
+    uint32_t word;
+
+    while (i < end) {
+        if ((i & 7) == 0) {
+            if (end - i >= 32) {
+                memcpy(&word, &bits[i >> 3], sizeof(word));
+                if (word == skip32) {
+                    i += 32;
+                    continue;
+                }
+            }
+            if (end - i >= 8 && bits[i >> 3] == skip8) {
+                i += 8;
+                continue;
+            }
+        }
+        if (!!(bits[i >> 3] & (0x80 >> (i & 7))) == set)
+            return i;
+        i++;
+    }
+
+    return end;
+}
+
+static void ds_pixel_run_rgb888(const struct ds_draw_area *area, const uint8_t *row,
+                                int x, int n, uint8_t *dst, uint16_t alpha)
+{
+    const uint8_t *src = row + x * DS_COLOR_DATA_MAX;
+    uint32_t raw;
+    int i;
+
+    if (!(area->flags & DS_AREA_COLOR_KEY)) {
+        pixel_blend(dst, src, n * DS_COLOR_DATA_MAX, alpha);
+        return;
+    }
+
+    for (i = 0; i < n; i++, src += DS_COLOR_DATA_MAX, dst += DS_COLOR_DATA_MAX) {
+        raw = src[0] | (src[1] << 8) | (src[2] << 16);
+        if (raw == area->key)
+            continue;
+        ds_pixel_put(dst, src, alpha);
+    }
+}
+
+static void ds_pixel_run_rgb565(const struct ds_draw_area *area, const uint8_t *row,
+                                int x, int n, uint8_t *dst, uint16_t alpha)
+{
+    const uint16_t *src = (const uint16_t *)row + x;
+    uint8_t rgb[DS_PIXEL_CHUNK * DS_COLOR_DATA_MAX];
+    uint16_t v;
+    int i, k;
+
+    if (!(area->flags & DS_AREA_COLOR_KEY)) {
+        if (alpha == DS_PIXEL_ALPHA_COPY) {
+            pixel_rgb565_to_rgb888(dst, src, n);
+            return;
+        }
+        for (i = 0; i < n; i += k, dst += k * DS_COLOR_DATA_MAX) {
+            k = min_t(int, n - i, DS_PIXEL_CHUNK);
+            pixel_rgb565_to_rgb888(rgb, src + i, k);
+            pixel_blend(dst, rgb, k * DS_COLOR_DATA_MAX, alpha);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++, dst += DS_COLOR_DATA_MAX) {
+        v = src[i];
+        if (v == area->key)
+            continue;
+        /* the top bits are repeated in the low ones, so 0x1f is 0xff */
+        rgb[DS_COLOR_R] = ((v >> 8) & 0xf8) | (v >> 13);
+        rgb[DS_COLOR_G] = ((v >> 3) & 0xfc) | ((v >> 9) & 0x03);
+        rgb[DS_COLOR_B] = ((v << 3) & 0xf8) | ((v >> 2) & 0x07);
+        ds_pixel_put(dst, rgb, alpha);
+    }
+}
+
+static void ds_pixel_run_pal8(const struct ds_draw_area *area, const uint8_t *row,
+                              int x, int n, uint8_t *dst, uint16_t alpha)
+{
+    const uint8_t *src = row + x;
+    int i;
+
+    if (area->palette == NULL)
+        return;
+
+    for (i = 0; i < n; i++, dst += DS_COLOR_DATA_MAX) {
+        if ((area->flags & DS_AREA_COLOR_KEY) && src[i] == area->key)
+            continue;
+        ds_pixel_put(dst, area->palette[src[i]], alpha);
+    }
+}
+
+/* the run is set bits only, so it is a fill */
+static void ds_pixel_run_mono1(const struct ds_draw_area *area, const uint8_t *row,
+                               int x, int n, uint8_t *dst, uint16_t alpha)
+{
+    pixel_blend_color_rgb888(dst, area->fg, n, alpha);
+}
+
+static void ds_pixel_run_data(const struct ds_draw_area *area, const uint8_t *row,
+                              int x, int n, uint8_t *dst, uint16_t alpha)
+{
+    const struct ds_data *src = (const struct ds_data *)row + x;
+    int i;
+
+    for (i = 0; i < n; i++, dst += DS_COLOR_DATA_MAX) {
+        if (src[i].cmd == DS_DATA_CMD_TRANSPARENT)
+            continue;
+        ds_pixel_put(dst, src[i].data, alpha);
+    }
+}
+
+static const ds_pixel_run_t ds_pixel_run[] = {
+    [DS_FMT_DATA] = ds_pixel_run_data,
+    [DS_FMT_RGB888] = ds_pixel_run_rgb888,
+    [DS_FMT_RGB565] = ds_pixel_run_rgb565,
+    [DS_FMT_PAL8] = ds_pixel_run_pal8,
+    [DS_FMT_MONO1] = ds_pixel_run_mono1,
+};
+
+uint16_t ds_pixel_stride(enum ds_pixel_format format, uint16_t width)
+{
+    switch (format) {
+    case DS_FMT_DATA:
+        return width * sizeof(struct ds_data);
+    case DS_FMT_RGB888:
+        return width * DS_COLOR_DATA_MAX;
+    case DS_FMT_RGB565:
+        return width * sizeof(uint16_t);
+    case DS_FMT_PAL8:
+        return width;
+    case DS_FMT_MONO1:
+        return (width + 7) / 8;
+    default:
+        return 0;
+    }
+}
+
+/* true if every pixel of the area is drawn */
+bool ds_pixel_area_opaque(const struct ds_draw_area *area)
+{
+    const uint8_t *mask;
+    int i, y;
+
+    if (area->format == DS_FMT_MONO1 || (area->flags & DS_AREA_COLOR_KEY))
+        return false;
+
+    if (area->format == DS_FMT_DATA) {
+        for (i = 0; i < area->width * area->height; i++) {
+            if (area->data[i].cmd == DS_DATA_CMD_TRANSPARENT)
+                return false;
+        }
+        return true;
+    }
+
+    if (area->flags & DS_AREA_MASK) {
+        for (y = 0; y < area->height; y++) {
+            mask = area->mask + y * area->mask_stride;
+            if (ds_bits_find(mask, 0, area->width, false) != area->width)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * This function will merge the part of an area inside clip into the frame.
+ *
+ * @param frame the RGB888 frame.
+ * @param frame_width the frame width in pixels.
+ * @param area the area, clip must be inside it.
+ * @param clip the frame rect to merge.
+ * @param alpha 1 to 255, or DS_PIXEL_ALPHA_COPY.
+ */
+void ds_pixel_merge_area(uint8_t *frame, uint16_t frame_width,
+                         const struct ds_draw_area *area,
+                         const struct ds_rect *clip, uint16_t alpha)
+{
+    ds_pixel_run_t run;
+    const uint8_t *row, *mask;
+    uint8_t *dst;
+    int sx, sy, end, i, run_end;
+    int y;
+
+    if (area->format >= sizeof(ds_pixel_run) / sizeof(ds_pixel_run[0]))
+        return;
+    run = ds_pixel_run[area->format];
+
+    sx = clip->x - area->x;
+    end = sx + clip->width;
+    for (y = clip->y; y < clip->y + clip->height; y++) {
+        sy = y - area->y;
+        row = area->pixels + sy * area->stride;
+        dst = frame + (y * frame_width + clip->x) * DS_COLOR_DATA_MAX;
+
+        /* mono pixels are their own mask */
+        if (area->format == DS_FMT_MONO1)
+            mask = row;
+        else if (area->flags & DS_AREA_MASK)
+            mask = area->mask + sy * area->mask_stride;
+        else
+            mask = NULL;
+
+        if (mask == NULL) {
+            run(area, row, sx, clip->width, dst, alpha);
+            continue;
+        }
+
+        i = sx;
+        while (i < end) {
+            i = ds_bits_find(mask, i, end, true);
+            if (i >= end)
+                break;
+            run_end = ds_bits_find(mask, i, end, false);
+            run(area, row, i, run_end - i, dst + (i - sx) * DS_COLOR_DATA_MAX, alpha);
+            i = run_end;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __DS_PIXEL_H__
+#define __DS_PIXEL_H__
+
+#include <kernel/kernel.h>
+#include <string.h>
+#include <display/display.h>
+#include <display/pixel_ops.h>
+
+/* alpha as used by the merge, 256 is a plain copy */
+#define DS_PIXEL_ALPHA_COPY PIXEL_ALPHA_COPY
+
+/*
+ * dst + (src - dst) * alpha / 256, alpha 255 is taken as 256 so that an
+ * opaque pixel is copied as is.
+ */
+static inline void ds_pixel_put(uint8_t *dst, const uint8_t *src, uint16_t alpha)
+{
+    int i;
+
+    if (alpha == DS_PIXEL_ALPHA_COPY) {
+        memcpy(dst, src, DS_COLOR_DATA_MAX);
+        return;
+    }
+
+    for (i = 0; i < DS_COLOR_DATA_MAX; i++)
+        dst[i] = dst[i] + (((src[i] - dst[i]) * alpha) >> 8);
+}
+
+static inline void ds_rect_union(struct ds_rect *dst, const struct ds_rect *src)
+{
+    uint16_t x1 = max(dst->x + dst->width, src->x + src->width);
+    uint16_t y1 = max(dst->y + dst->height, src->y + src->height);
+
+    dst->x = min(dst->x, src->x);
+    dst->y = min(dst->y, src->y);
+    dst->width = x1 - dst->x;
+    dst->height = y1 - dst->y;
+}
+
+static inline bool ds_rect_intersect(struct ds_rect *dst, const struct ds_rect *a,
+                                     const struct ds_rect *b)
+{
+    int x0 = max(a->x, b->x);
+    int y0 = max(a->y, b->y);
+    int x1 = min(a->x + a->width, b->x + b->width);
+    int y1 = min(a->y + a->height, b->y + b->height);
+
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+
+    dst->x = x0;
+    dst->y = y0;
+    dst->width = x1 - x0;
+    dst->height = y1 - y0;
+
+    return true;
+}
+
+uint16_t ds_pixel_stride(enum ds_pixel_format format, uint16_t width);
+bool ds_pixel_area_opaque(const struct ds_draw_area *area);
+void ds_pixel_merge_area(uint8_t *frame, uint16_t frame_width,
+                         const struct ds_draw_area *area,
+                         const struct ds_rect *clip, uint16_t alpha);
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.ndk
+ */
+
+#define pr_fmt(fmt) "[NDK]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/types.h>
+#include <kernel/errno.h>
+#include <kernel/mm.h>
+#include <key/latency.h>
+
+#include "include/ndk.h"
+#include "include/protocol.h"
+#include "include/cmd.h"
+
+struct key_latency_inject_info {
+    uint16_t key;
+    uint16_t reserve;
+    uint32_t period_ms;
+} __attribute__ ((packed));
+
+static int cmd_key_latency_send(struct ndk_protocol *protocol)
+{
+    struct ndk_data_msg *msg;
+    int rc;
+
+    msg = kmalloc(sizeof(struct ndk_data_msg) + sizeof(struct key_lat_report), GFP_KERNEL);
+    if (msg == NULL) {
+        pr_err("alloc msg buf failed\r\n");
+        return -ENOMEM;
+    }
+
+    key_latency_get((struct key_lat_report *)msg->data);
+    msg->head.type = NDK_DATA_MSG;
+    msg->head.id = protocol->id;
+    msg->head.size = sizeof(struct ndk_data_msg) - sizeof(struct ndk_msg_head) +
+                     sizeof(struct key_lat_report);
+    msg->head.crc = 0;
+    msg->index = 0;
+    msg->size = sizeof(struct key_lat_report);
+
+    rc = ndk_protocol_send_data_msg(protocol, msg);
+    kfree(msg);
+
+    return rc < 0 ? rc : 0;
+}
+
+int cmd_key_latency(struct ndk_protocol *protocol, uint8_t subtype,
+    const char *buf, uint32_t size)
+{
+    const struct key_latency_inject_info *info;
+
+    switch (subtype) {
+    case NDK_KEY_LATENCY_GET:
+        return cmd_key_latency_send(protocol);
+    case NDK_KEY_LATENCY_CLEAR:
+        key_latency_clear();
+        return 0;
+    case NDK_KEY_LATENCY_INJECT:
+        if (size != sizeof(struct key_latency_inject_info)) {
+            pr_err("data size error\r\n");
+            return -EINVAL;
+        }
+        info = (const struct key_latency_inject_info *)buf;
+        pr_info("inject key=%u, period=%ums\r\n", info->key, info->period_ms);
+        key_latency_inject(info->key, info->period_ms);
+        return 0;
+    default:
+        pr_err("Unknown key latency subtype: %u\r\n", subtype);
+        return -EINVAL;
+    }
+}
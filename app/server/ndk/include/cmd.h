@@ -16,5 +16,7 @@
 int cmd_fw_update(struct ndk_protocol *protocol,
     uint16_t send_data_msg_num, uint32_t send_data_msg_size,
     const char *buf, uint32_t size);
+int cmd_key_latency(struct ndk_protocol *protocol, uint8_t subtype,
+    const char *buf, uint32_t size);
 
 #endif /* __NDK_CMD_H__ */
@@ -27,9 +27,17 @@ enum ndk_ctrl_msg_type {
     NDK_CTRL_MSG_HEART_BEAT = 0,
     NDK_CTRL_MSG_GET_VERSION,
     NDK_CTRL_MSG_FW_UPDATE,
+    NDK_CTRL_MSG_KEY_LATENCY,
     NDK_CTRL_MSG_TYPE_MAX,
 };
 
+/* subtype of NDK_CTRL_MSG_KEY_LATENCY */
+enum ndk_key_latency_subtype {
+    NDK_KEY_LATENCY_GET = 0,
+    NDK_KEY_LATENCY_CLEAR,
+    NDK_KEY_LATENCY_INJECT,
+};
+
 struct ndk_msg_head {
     uint8_t type;
     uint8_t id;
@@ -64,6 +64,16 @@ static void ndk_server_task_entry(void *parameter)
             pr_info("get version\r\n");
             ndk_protocol_reply_ack(ndk->protocol, 0, 0);
             break;
+#ifdef CONFIG_KEY_LATENCY
+        case NDK_CTRL_MSG_KEY_LATENCY:
+            ndk_protocol_reply_ack(ndk->protocol, 0, 0);
+            rc = cmd_key_latency(ndk->protocol, ctrl_msg->subtype,
+                ctrl_msg->data, ctrl_msg->size);
+            if (rc < 0) {
+                pr_err("key latency failed, rc=%d\r\n", rc);
+            }
+            break;
+#endif
         case NDK_CTRL_MSG_HEART_BEAT:
             pr_info("heart beat\r\n");
             ndk_protocol_reply_ack(ndk->protocol, 0, 0);
@@ -0,0 +1,200 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[usb_bench]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <kernel/clk.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <string.h>
+#include <usb/usb_common.h>
+#include <usb/usb_device.h>
+
+#define USB_BENCH_LOOPS 10000
+/* reports and winusb packets sent to time the data events */
+#define USB_BENCH_TRANSFERS   1000
+#define USB_BENCH_TIMEOUT_MS  100
+/* a high speed packet, 8 at full speed */
+#define USB_BENCH_WINUSB_SIZE 512
+
+/* the endpoint walk usbd_find_endpoint() did before the lookup table */
+static uep_t usb_bench_walk_endpoint(udevice_t device, ufunction_t *pfunc, uint8_t ep_addr)
+{
+    ufunction_t func;
+    uintf_t intf;
+    uep_t ep;
+
+    list_for_each_entry(func, &device->curr_cfg->func_list, list) {
+        list_for_each_entry(intf, &func->intf_list, list) {
+            list_for_each_entry(ep, &intf->curr_setting->ep_list, list) {
+                if (EP_ADDRESS(ep) == ep_addr) {
+                    if (pfunc != NULL)
+                        *pfunc = func;
+                    return ep;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static u32 usb_bench_ns_per_loop(u64 start_us, u64 end_us)
+{
+    return (u32)((end_us - start_us) * 1000 / USB_BENCH_LOOPS);
+}
+
+static void usb_bench_run(udevice_t device)
+{
+    ufunction_t func;
+    uintf_t intf;
+    uep_t ep;
+    u64 start;
+    u32 walk_ns, table_ns;
+    int i;
+
+    list_for_each_entry(func, &device->curr_cfg->func_list, list) {
+        list_for_each_entry(intf, &func->intf_list, list) {
+            list_for_each_entry(ep, &intf->curr_setting->ep_list, list) {
+                ufunction_t f;
+                uint8_t addr = EP_ADDRESS(ep);
+
+                start = cpu_run_time_us();
+                for (i = 0; i < USB_BENCH_LOOPS; i++)
+                    usb_bench_walk_endpoint(device, &f, addr);
+                walk_ns = usb_bench_ns_per_loop(start, cpu_run_time_us());
+
+                start = cpu_run_time_us();
+                for (i = 0; i < USB_BENCH_LOOPS; i++)
+                    usbd_find_endpoint(device, &f, addr);
+                table_ns = usb_bench_ns_per_loop(start, cpu_run_time_us());
+
+                pr_info("intf %u ep 0x%02x: walk %uns, table %uns\r\n",
+                        intf->intf_num, addr, walk_ns, table_ns);
+            }
+        }
+    }
+
+    start = cpu_run_time_us();
+    for (i = 0; i < USB_BENCH_LOOPS; i++)
+        usbd_find_interface(device, device->nr_intf - 1, &func);
+    pr_info("interface %u: table %uns\r\n", device->nr_intf - 1,
+            usb_bench_ns_per_loop(start, cpu_run_time_us()));
+}
+
+/* the host polls the keyboard, so an empty report completes without typing anything */
+static void usb_bench_hid_traffic(void)
+{
+    struct hid_nkro_report report;
+    struct device *hid_dev;
+    int i;
+
+    hid_dev = device_find_by_name("hidd");
+    if (hid_dev == NULL)
+        return;
+
+    memset(&report, 0, sizeof(report));
+    for (i = 0; i < USB_BENCH_TRANSFERS; i++) {
+        hid_dev->ops.write(hid_dev, HID_REPORT_ID_NKRO, &report, sizeof(report));
+        msleep(1);
+    }
+}
+
+/* winusb only completes while a host tool reads it, it stops at the first timeout */
+static void usb_bench_winusb_traffic(void)
+{
+    struct device *win_dev;
+    uint8_t *buf;
+    int i;
+
+    win_dev = device_find_by_name("winusb");
+    if (win_dev == NULL)
+        return;
+    buf = kmalloc(USB_BENCH_WINUSB_SIZE, GFP_KERNEL);
+    if (buf == NULL)
+        return;
+
+    memset(buf, 0x5a, USB_BENCH_WINUSB_SIZE);
+    for (i = 0; i < USB_BENCH_TRANSFERS; i++) {
+        if (win_dev->ops.write_timeout(win_dev, 0, buf, USB_BENCH_WINUSB_SIZE,
+                                       msec_to_tick(USB_BENCH_TIMEOUT_MS)) !=
+            USB_BENCH_WINUSB_SIZE)
+            break;
+    }
+    kfree(buf);
+}
+
+/* per transfer cost of the in and out completions, from the stats of the core */
+static void usb_bench_dispatch(udevice_t device)
+{
+    struct usbd_dispatch_stat *stat;
+    int i;
+
+    memset(device->dispatch, 0, sizeof(device->dispatch));
+    usb_bench_hid_traffic();
+    usb_bench_winusb_traffic();
+
+    for (i = 0; i < USB_EP_TABLE_SIZE; i++) {
+        stat = &device->dispatch[i];
+        if (device->ep_table[i].ep == NULL || stat->count == 0)
+            continue;
+        pr_info("ep 0x%02x: %u transfers, notify avg %uns max %uns, irq to done avg %uns\r\n",
+                EP_ADDRESS(device->ep_table[i].ep), stat->count,
+                cpu_cycles_to_ns((u32)(stat->notify_total / stat->count)),
+                cpu_cycles_to_ns(stat->notify_max),
+                cpu_cycles_to_ns((u32)(stat->event_total / stat->count)));
+    }
+}
+
+static void usb_bench_task_entry(void* parameter)
+{
+    struct device *dev;
+    udevice_t device;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        dev = device_find_by_name("usbd");
+        if (dev != NULL)
+            break;
+        sleep(1);
+    }
+    if (dev == NULL) {
+        pr_err("usbd device not found, exit\r\n");
+        return;
+    }
+
+    device = usbd_find_device(container_of(dev, struct udcd, dev));
+    if (device == NULL || device->curr_cfg == NULL) {
+        pr_err("usb device not configured, exit\r\n");
+        return;
+    }
+
+    pr_info("%u interfaces, %d loops per lookup\r\n", device->nr_intf, USB_BENCH_LOOPS);
+    usb_bench_run(device);
+    usb_bench_dispatch(device);
+}
+
+static int usb_bench_init(void)
+{
+    struct task_struct *task;
+
+    task = task_create("usb_bench", usb_bench_task_entry, NULL, 20, 1024, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat usb_bench task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(usb_bench_init);
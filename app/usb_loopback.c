@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[usb_loopback]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/task.h>
+#include <kernel/errno.h>
+#include <kernel/sleep.h>
+#include <kernel/clk.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+
+/*
+ * Echo every block received on winusb back to the host, run
+ * scripts/usb_loopback.py on the host to measure the throughput.
+ * The NDK server also owns winusb, disable CONFIG_NDK_SERVER when using it.
+ */
+#define USB_LOOPBACK_BLOCK 1024
+
+static void usb_loopback_task_entry(void* parameter)
+{
+    struct device *dev = NULL;
+    uint8_t *buf;
+    ssize_t rc;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        dev = device_find_by_name("winusb");
+        if (dev != NULL)
+            break;
+        sleep(1);
+    }
+    if (dev == NULL) {
+        pr_err("winusb device not found, exit\r\n");
+        return;
+    }
+
+    buf = kmalloc(USB_LOOPBACK_BLOCK, GFP_KERNEL);
+    if (buf == NULL) {
+        pr_err("alloc loopback buf error\r\n");
+        return;
+    }
+
+    while (true) {
+        rc = dev->ops.read_timeout(dev, 0, buf, USB_LOOPBACK_BLOCK, sec_to_tick(1));
+        if (rc <= 0)
+            continue;
+        /* a short packet is echoed as short, the rest of buf is stale */
+        rc = dev->ops.write_timeout(dev, 0, buf, rc, sec_to_tick(1));
+        if (rc < 0)
+            pr_err("loopback write error, rc=%d\r\n", rc);
+    }
+}
+
+static int usb_loopback_init(void)
+{
+    struct task_struct *task;
+
+    task = task_create("usb_loopback", usb_loopback_task_entry, NULL, 10, 1024, 10, NULL);
+    if (task == NULL) {
+        pr_fatal("creat usb_loopback task err\r\n");
+        return -EINVAL;
+    }
+    task_ready(task);
+
+    return 0;
+}
+task_init(usb_loopback_init);
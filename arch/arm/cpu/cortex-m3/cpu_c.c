@@ -137,7 +137,27 @@ extern uint32_t SystemCoreClock;
 
 static uint32_t nop_us_time_ns;
 static uint32_t sys_tick_num_by_us;
+/* core_cm3.h has no DWT block */
+#define DWT_CTRL               (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT             (*(volatile uint32_t *)0xE0001004)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+
 static uint32_t sys_tick_num_by_heartbeat;
+static bool cycle_counter_on;
+
+/* qemu does not model the DWT, asm_cpu_cycles() falls back to systick there */
+static void cycle_counter_init(void)
+{
+#ifndef CONFIG_QEMU
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    __NOP();
+    __NOP();
+    cycle_counter_on = (DWT_CYCCNT != 0);
+#endif
+}
+
 __init void asm_cpu_init(void)
 {
 #ifndef CONFIG_QEMU
@@ -148,6 +168,7 @@ __init void asm_cpu_init(void)
     sys_tick_num_by_us = SystemCoreClock / 1000000;
     sys_tick_num_by_heartbeat = SystemCoreClock * CONFIG_SYS_TICK_MS / 1000;
     nop_us_time_ns = (10000000000 / SystemCoreClock + 5) / 10;
+    cycle_counter_init();
 
     interrupt_from_task = 0;
     interrupt_to_task = 0;
@@ -232,3 +253,16 @@ u64 asm_cpu_run_time_us(void)
     u64 us = cpu_run_ticks() * CONFIG_SYS_TICK_MS * 1000;
     return (us + (sys_tick_num_by_heartbeat - SysTick->VAL) / sys_tick_num_by_us);
 }
+
+u32 asm_cpu_cycles(void)
+{
+    if (cycle_counter_on)
+        return DWT_CYCCNT;
+
+    return (u32)(asm_cpu_run_time_us() * sys_tick_num_by_us);
+}
+
+u32 asm_cpu_cycles_per_us(void)
+{
+    return sys_tick_num_by_us;
+}
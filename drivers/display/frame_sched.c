@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[FRAME_SCHED]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <string.h>
+#include <display/frame_sched.h>
+
+/**
+ * This function will start a scheduler, the first frame is not delayed.
+ *
+ * @param fs the scheduler.
+ * @param fps the target rate, 1 to FRAME_SCHED_FPS_MAX.
+ */
+void frame_sched_init(struct frame_sched *fs, uint32_t fps)
+{
+    memset(fs, 0, sizeof(struct frame_sched));
+    if (frame_sched_set_rate(fs, fps) < 0)
+        frame_sched_set_rate(fs, FRAME_SCHED_FPS_MAX);
+    fs->deadline = cpu_run_time_us();
+    fs->window_start = fs->deadline;
+}
+
+/**
+ * This function will change the target rate, the stats are cleared as the
+ * histogram is in parts of the period.
+ *
+ * @param fs the scheduler.
+ * @param fps the target rate, 1 to FRAME_SCHED_FPS_MAX.
+ *
+ * @return 0 on successful, -EINVAL if fps is out of range.
+ */
+int frame_sched_set_rate(struct frame_sched *fs, uint32_t fps)
+{
+    if (fps == 0 || fps > FRAME_SCHED_FPS_MAX) {
+        pr_err("fps is out of range, fps=%u\r\n", fps);
+        return -EINVAL;
+    }
+
+    fs->period_us = 1000000 / fps;
+    frame_sched_clear_stats(fs);
+    fs->stats.target_fps = fps;
+
+    return 0;
+}
+
+/**
+ * This function will sleep until the next frame is due. A scheduler more
+ * than a period behind, after an idle time or a long frame, starts now and
+ * the slots it missed are gone.
+ *
+ * @param fs the scheduler.
+ */
+void frame_sched_wait(struct frame_sched *fs)
+{
+    u64 now = cpu_run_time_us();
+    uint32_t left;
+
+    if (now >= fs->deadline + fs->period_us) {
+        fs->deadline = now;
+    } else if (now < fs->deadline) {
+        left = fs->deadline - now;
+        msleep((left + 999) / 1000);
+    }
+
+    fs->start = cpu_run_time_us();
+    fs->composed = fs->start;
+    fs->deadline += fs->period_us;
+}
+
+/* the slot was taken by frame_sched_wait(), the device could not take a frame */
+void frame_sched_skip(struct frame_sched *fs)
+{
+    fs->stats.dropped++;
+}
+
+void frame_sched_composed(struct frame_sched *fs)
+{
+    fs->composed = cpu_run_time_us();
+}
+
+/**
+ * This function will end a frame started by frame_sched_wait(), the time
+ * since frame_sched_composed() is the flush.
+ *
+ * @param fs the scheduler.
+ */
+void frame_sched_done(struct frame_sched *fs)
+{
+    u64 now = cpu_run_time_us();
+    uint32_t compose = fs->composed - fs->start;
+    uint32_t flush = now - fs->composed;
+    uint32_t total = now - fs->start;
+    uint32_t bucket, elapsed;
+
+    fs->stats.frames++;
+    if (total > fs->period_us)
+        fs->stats.late++;
+    fs->stats.frame_max_us = max(fs->stats.frame_max_us, total);
+    bucket = min_t(uint32_t, total / (fs->period_us / FRAME_SCHED_BUCKET_DIV),
+                   FRAME_SCHED_BUCKETS - 1);
+    fs->hist[bucket]++;
+
+    fs->window_frames++;
+    fs->window_compose_us += compose;
+    fs->window_flush_us += flush;
+    elapsed = min_t(u64, now - fs->window_start, U32_MAX);
+    if (elapsed < FRAME_SCHED_WINDOW_US)
+        return;
+
+    fs->stats.fps_x100 = fs->window_frames * 100000 / (elapsed / 1000);
+    fs->stats.compose_avg_us = fs->window_compose_us / fs->window_frames;
+    fs->stats.flush_avg_us = fs->window_flush_us / fs->window_frames;
+    fs->window_start = now;
+    fs->window_frames = 0;
+    fs->window_compose_us = 0;
+    fs->window_flush_us = 0;
+}
+
+/* the upper edge of the bucket the 99th percentile frame is in */
+static uint32_t frame_sched_p99(const struct frame_sched *fs)
+{
+    uint32_t count = 0, target;
+    int i;
+
+    if (fs->stats.frames == 0)
+        return 0;
+
+    target = fs->stats.frames - fs->stats.frames / 100;
+    for (i = 0; i < FRAME_SCHED_BUCKETS - 1; i++) {
+        count += fs->hist[i];
+        if (count >= target)
+            return (i + 1) * (fs->period_us / FRAME_SCHED_BUCKET_DIV);
+    }
+
+    return fs->stats.frame_max_us;
+}
+
+void frame_sched_get_stats(const struct frame_sched *fs, struct frame_stats *stats)
+{
+    memcpy(stats, &fs->stats, sizeof(struct frame_stats));
+    stats->frame_p99_us = frame_sched_p99(fs);
+}
+
+void frame_sched_clear_stats(struct frame_sched *fs)
+{
+    uint32_t target_fps = fs->stats.target_fps;
+
+    memset(&fs->stats, 0, sizeof(struct frame_stats));
+    memset(fs->hist, 0, sizeof(fs->hist));
+    fs->stats.target_fps = target_fps;
+    fs->window_start = cpu_run_time_us();
+    fs->window_frames = 0;
+    fs->window_compose_us = 0;
+    fs->window_flush_us = 0;
+}
+
+void frame_sched_dump(const struct frame_sched *fs, const char *name)
+{
+    struct frame_stats stats;
+
+    frame_sched_get_stats(fs, &stats);
+    pr_info("%s: %u.%02u fps, target=%u, frames=%u, dropped=%u, late=%u\r\n", name,
+            stats.fps_x100 / 100, stats.fps_x100 % 100, stats.target_fps,
+            stats.frames, stats.dropped, stats.late);
+    pr_info("%s: frame p99=%uus max=%uus, compose avg=%uus, flush avg=%uus\r\n", name,
+            stats.frame_p99_us, stats.frame_max_us, stats.compose_avg_us,
+            stats.flush_avg_us);
+}
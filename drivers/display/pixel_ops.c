@@ -0,0 +1,200 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#include <kernel/kernel.h>
+#include <string.h>
+#include <display/display.h>
+#include <display/pixel_ops.h>
+
+#if PIXEL_OPS_SIMD
+/* the cmsis simd intrinsics */
+#include <board/board.h>
+#endif
+
+/*
+ * On the m4 a word of 4 bytes is split by UXTB16 into its even and odd
+ * bytes in two 16 bit lanes, and one MUL scales both lanes of a half.
+ * d * (256 - a) + s * a is at most 255 * 256, so a lane never carries into
+ * the next, and its top byte is d + ((s - d) * a >> 8) exactly. An alpha
+ * of 128 is UHADD8, the average of 4 byte pairs in one instruction.
+ *
+ * The m3 has no simd, it runs the byte loops. Fill and the conversions
+ * are plain C on both, there is no simd instruction that helps them.
+ */
+
+#if PIXEL_OPS_SIMD
+static inline uint32_t pixel_load(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void pixel_store(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t pixel_blend_word(uint32_t d, uint32_t s, uint32_t alpha)
+{
+    uint32_t na = 256 - alpha;
+    uint32_t even = __UXTB16(d) * na + __UXTB16(s) * alpha;
+    uint32_t odd = __UXTB16(d >> 8) * na + __UXTB16(s >> 8) * alpha;
+
+    return ((even >> 8) & 0x00ff00ff) | (odd & 0xff00ff00);
+}
+
+static inline uint32_t pixel_scale_word(uint32_t v, uint32_t scale)
+{
+    uint32_t even = __UXTB16(v) * scale;
+    uint32_t odd = __UXTB16(v >> 8) * scale;
+
+    return ((even >> 8) & 0x00ff00ff) | (odd & 0xff00ff00);
+}
+#endif
+
+static inline uint8_t pixel_blend_byte(uint8_t d, uint8_t s, uint16_t alpha)
+{
+    return d + (((s - d) * alpha) >> 8);
+}
+
+/**
+ * This function will blend src over dst.
+ *
+ * @param dst the bytes blended into.
+ * @param src the bytes blended, it may be dst.
+ * @param bytes the byte count.
+ * @param alpha 0 to 256, 256 copies src.
+ */
+void pixel_blend(uint8_t *dst, const uint8_t *src, int bytes, uint16_t alpha)
+{
+    int i = 0;
+
+    if (alpha == PIXEL_ALPHA_COPY) {
+        memmove(dst, src, bytes);
+        return;
+    }
+
+#if PIXEL_OPS_SIMD
+    if (alpha == 128) {
+        for (; i + 4 <= bytes; i += 4)
+            pixel_store(dst + i, __UHADD8(pixel_load(dst + i), pixel_load(src + i)));
+    } else {
+        for (; i + 4 <= bytes; i += 4)
+            pixel_store(dst + i, pixel_blend_word(pixel_load(dst + i), pixel_load(src + i), alpha));
+    }
+#endif
+    for (; i < bytes; i++)
+        dst[i] = pixel_blend_byte(dst[i], src[i], alpha);
+}
+
+/**
+ * This function will scale bytes, for a brightness.
+ *
+ * @param dst the scaled bytes, it may be src.
+ * @param src the bytes scaled.
+ * @param bytes the byte count.
+ * @param scale 0 to 256, 256 copies src.
+ */
+void pixel_scale(uint8_t *dst, const uint8_t *src, int bytes, uint16_t scale)
+{
+    int i = 0;
+
+    if (scale == 256) {
+        memmove(dst, src, bytes);
+        return;
+    }
+
+#if PIXEL_OPS_SIMD
+    for (; i + 4 <= bytes; i += 4)
+        pixel_store(dst + i, pixel_scale_word(pixel_load(src + i), scale));
+#endif
+    for (; i < bytes; i++)
+        dst[i] = (src[i] * scale) >> 8;
+}
+
+/* the color repeated over 4 pixels, 3 words */
+static void pixel_pattern(uint32_t *pat, const uint8_t *color)
+{
+    uint8_t bytes[DS_COLOR_DATA_MAX * 4];
+    int i;
+
+    for (i = 0; i < sizeof(bytes); i++)
+        bytes[i] = color[i % DS_COLOR_DATA_MAX];
+    memcpy(pat, bytes, sizeof(bytes));
+}
+
+void pixel_fill_rgb888(uint8_t *dst, const uint8_t *color, int num)
+{
+    uint32_t pat[DS_COLOR_DATA_MAX];
+    int i;
+
+    pixel_pattern(pat, color);
+    for (i = 0; i + 4 <= num; i += 4, dst += sizeof(pat))
+        memcpy(dst, pat, sizeof(pat));
+    for (; i < num; i++, dst += DS_COLOR_DATA_MAX)
+        memcpy(dst, color, DS_COLOR_DATA_MAX);
+}
+
+/**
+ * This function will blend one color over a run of pixels.
+ *
+ * @param dst the pixels.
+ * @param color the color, DS_COLOR_DATA_MAX bytes.
+ * @param num the pixel count.
+ * @param alpha 0 to 256, 256 fills.
+ */
+void pixel_blend_color_rgb888(uint8_t *dst, const uint8_t *color, int num, uint16_t alpha)
+{
+    int bytes = num * DS_COLOR_DATA_MAX;
+    int i = 0;
+#if PIXEL_OPS_SIMD
+    uint32_t pat[DS_COLOR_DATA_MAX];
+    int k;
+#endif
+
+    if (alpha == PIXEL_ALPHA_COPY) {
+        pixel_fill_rgb888(dst, color, num);
+        return;
+    }
+
+#if PIXEL_OPS_SIMD
+    pixel_pattern(pat, color);
+    for (; i + sizeof(pat) <= bytes; i += sizeof(pat)) {
+        for (k = 0; k < DS_COLOR_DATA_MAX; k++)
+            pixel_store(dst + i + k * 4, pixel_blend_word(pixel_load(dst + i + k * 4), pat[k], alpha));
+    }
+#endif
+    for (; i < bytes; i++)
+        dst[i] = pixel_blend_byte(dst[i], color[i % DS_COLOR_DATA_MAX], alpha);
+}
+
+void pixel_rgb888_to_rgb565(uint16_t *dst, const uint8_t *src, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++, src += DS_COLOR_DATA_MAX) {
+        dst[i] = ((src[DS_COLOR_R] & 0xf8) << 8) | ((src[DS_COLOR_G] & 0xfc) << 3) |
+                 (src[DS_COLOR_B] >> 3);
+    }
+}
+
+/* the top bits are repeated in the low ones, so 0x1f is 0xff */
+void pixel_rgb565_to_rgb888(uint8_t *dst, const uint16_t *src, int num)
+{
+    uint16_t v;
+    int i;
+
+    for (i = 0; i < num; i++, dst += DS_COLOR_DATA_MAX) {
+        v = src[i];
+        dst[DS_COLOR_R] = ((v >> 8) & 0xf8) | (v >> 13);
+        dst[DS_COLOR_G] = ((v >> 3) & 0xfc) | ((v >> 9) & 0x03);
+        dst[DS_COLOR_B] = ((v << 3) & 0xf8) | ((v >> 2) & 0x07);
+    }
+}
@@ -29,94 +29,271 @@
 #define LED_WIDTH 64
 #define LED_HEIGHT 64
 #define LED_BUF_SZIE (LED_WIDTH * LED_HEIGHT * DS_COLOR_DATA_MAX)
+/* rows y and y + LED_SCAN are shifted and lit together */
+#define LED_SCAN (LED_HEIGHT / 2)
+
+/* bits per channel, a frame is RGB_MATRIX_BITS * 4KB and there are two */
+#ifdef CONFIG_RGB_MATRIX_BITS
+#define RGB_MATRIX_BITS CONFIG_RGB_MATRIX_BITS
+#else
+#define RGB_MATRIX_BITS 4
+#endif
+#if RGB_MATRIX_BITS < 1 || RGB_MATRIX_BITS > 8
+#error "RGB_MATRIX_BITS is 1 to 8"
+#endif
+
+/* TIM8 ticks at 72MHz per pixel clock */
+#define RGB_MATRIX_CLK_DIV 36
+/* TIM3 ticks at 72MHz oe is on for the lowest bit, bit n is on RGB_MATRIX_OE_BASE << n */
+#define RGB_MATRIX_OE_BASE 144
+
+#define RGB_R1_PIN GPIO_Pin_0
+#define RGB_G1_PIN GPIO_Pin_1
+#define RGB_B1_PIN GPIO_Pin_2
+#define RGB_R2_PIN GPIO_Pin_3
+#define RGB_B2_PIN GPIO_Pin_6
+#define RGB_CLK_PIN GPIO_Pin_5
+#define RGB_LAT_PIN GPIO_Pin_7
+#define RGB_DATA_PINS (RGB_R1_PIN | RGB_G1_PIN | RGB_B1_PIN | RGB_R2_PIN | RGB_B2_PIN)
+#define RGB_TOP_PINS (RGB_R1_PIN | RGB_G1_PIN | RGB_B1_PIN)
+#define RGB_BOTTOM_PINS (RGB_R2_PIN | RGB_B2_PIN)
+/* row address A PA5, B PA6, C PA7, E PA4 and D PC4 */
+#define RGB_ADDR_PA_PINS (GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7)
+#define RGB_D_PIN GPIO_Pin_4
+
+/*
+ * G2 is on PA1, away from the other colors on GPIOC. It is TIM2_CH2 forced
+ * inactive, a write of CCER picks the level by the output polarity.
+ */
+#define RGB_G2_LOW  TIM_CCER_CC2E
+#define RGB_G2_HIGH (TIM_CCER_CC2E | TIM_CCER_CC2P)
 
-#define RGB_R1(value)  (PCout(0) = !!(value))
-#define RGB_G1(value)  (PCout(1) = !!(value))
-#define RGB_B1(value)  (PCout(2) = !!(value))
-
-#define RGB_R2(value)  (PCout(3) = !!(value))
-#define RGB_G2(value)  (PAout(1) = !!(value))
-#define RGB_B2(value)  (PCout(6) = !!(value))
-
-#define RGB_A(value)  (PAout(5) = !!(value))
-#define RGB_B(value)  (PAout(6) = !!(value))
-#define RGB_C(value)  (PAout(7) = !!(value))
-#define RGB_D(value)  (PCout(4) = !!(value))
-#define RGB_E(value)  (PAout(4) = !!(value))
-
-#define RGB_CLK(value)  (PCout(5) = !!(value))
-#define RGB_LAT(value)  (PCout(7) = !!(value))
-#define RGB_OE(value)   (PCout(8) = !!(value))
+/*
+ * The frame is cut into bit planes ahead, a byte per pixel clock in the
+ * layout of the port. pc is written to GPIOC->BSRR and sets the colors of
+ * both rows, g2 is written to TIM2->CCER.
+ */
+struct rgb_matrix_frame {
+    uint8_t pc[RGB_MATRIX_BITS][LED_SCAN][LED_WIDTH];
+    uint8_t g2[RGB_MATRIX_BITS][LED_SCAN][LED_WIDTH];
+};
 
+/*
+ * TIM8 clocks the pixels of a row, each period four dma requests write
+ * the colors (CC1, CC2), raise CLK (CC4) and clear the colors and CLK
+ * (update). The last transfer ends the shift. OE is TIM3_CH3 in one pulse
+ * mode on PC8, the pulse of bit n is 2^n long. A row and bit is latched
+ * once both its shift and the pulse before are over, then the next one is
+ * shifted during its pulse. The planes are double buffered, the front is
+ * only swapped before row 0 bit 0.
+ */
 struct rgb_matrix {
-    struct task_struct *task;
     struct mutex lock;
     struct device dev;
-    uint8_t buf[LED_BUF_SZIE];
+    sem_t sem;
+    struct rgb_matrix_frame *frame[2];
+    /* the frame the dma reads */
+    uint8_t front;
+    /* set by a refresh, cleared by the irq on the swap */
+    volatile bool swap;
+    /* the swap was asked and its completion not taken from sem yet */
+    bool swap_pending;
+
+    /* the row and bit being shifted */
+    uint8_t row;
+    uint8_t bit;
+    bool shift_done;
+    bool oe_done;
+    /* the row and bit in the shift registers, to be latched */
+    uint8_t latch_row;
+    uint8_t latch_bit;
 
     bool enable;
 };
 
-void rgb_matrix_display(struct rgb_matrix *led)
+static struct rgb_matrix *g_rgb_matrix;
+
+/* the update clears the colors and CLK by BRR, CC4 raises CLK by BSRR */
+static const uint32_t rgb_matrix_clear = RGB_DATA_PINS | RGB_CLK_PIN;
+static const uint32_t rgb_matrix_clk = RGB_CLK_PIN;
+
+static void rgb_matrix_dma_set(DMA_Channel_TypeDef *ch, const void *mem)
 {
-    int i, j;
+    DMA_Cmd(ch, DISABLE);
+    ch->CMAR = (uint32_t)mem;
+    DMA_SetCurrDataCounter(ch, LED_WIDTH);
+    DMA_Cmd(ch, ENABLE);
+}
 
-    for (j = 0; j < 32; j++) {
-        for (i = 0; i < LED_WIDTH; i++) {
-            RGB_R1(led->buf[(i + (j * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_R]);
-            RGB_G1(led->buf[(i + (j * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_G]);
-            RGB_B1(led->buf[(i + (j * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_B]);
+static void rgb_matrix_shift_start(struct rgb_matrix *led)
+{
+    struct rgb_matrix_frame *frame;
 
-            RGB_R2(led->buf[(i + ((j + 32) * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_R]);
-            RGB_G2(led->buf[(i + ((j + 32) * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_G]);
-            RGB_B2(led->buf[(i + ((j + 32) * LED_WIDTH)) * DS_COLOR_DATA_MAX + DS_COLOR_B]);
-            
-            RGB_CLK(0); //data input
-            RGB_CLK(1); 
-        }
+    if (led->row == 0 && led->bit == 0 && led->swap) {
+        led->front ^= 1;
+        led->swap = false;
+        sem_send_one(&led->sem);
+    }
+    frame = led->frame[led->front];
+
+    led->shift_done = false;
+    rgb_matrix_dma_set(DMA2_Channel3, frame->pc[led->bit][led->row]);
+    rgb_matrix_dma_set(DMA2_Channel5, frame->g2[led->bit][led->row]);
+    rgb_matrix_dma_set(DMA2_Channel2, &rgb_matrix_clk);
+    rgb_matrix_dma_set(DMA2_Channel1, &rgb_matrix_clear);
+    TIM_SetCounter(TIM8, 0);
+    TIM_Cmd(TIM8, ENABLE);
+}
+
+/* in the irqs, once the shift and the pulse before are over */
+static void rgb_matrix_step(struct rgb_matrix *led)
+{
+    uint32_t addr;
+
+    if (!led->shift_done || !led->oe_done)
+        return;
+
+    led->latch_row = led->row;
+    led->latch_bit = led->bit;
+
+    /* oe is off, the rows and the address change unseen */
+    GPIOC->BSRR = RGB_LAT_PIN;
+    GPIOC->BRR = RGB_LAT_PIN;
+    addr = ((led->latch_row & 0x7) << 5) | ((led->latch_row & 0x10) ? GPIO_Pin_4 : 0);
+    GPIOA->BSRR = addr | ((~addr & RGB_ADDR_PA_PINS) << 16);
+    GPIOC->BSRR = (led->latch_row & 0x8) ? RGB_D_PIN : (RGB_D_PIN << 16);
+
+    led->oe_done = false;
+    TIM_SetAutoreload(TIM3, 1 + (RGB_MATRIX_OE_BASE << led->latch_bit));
+    TIM_SetCounter(TIM3, 0);
+    TIM_Cmd(TIM3, ENABLE);
+
+    if (++led->bit == RGB_MATRIX_BITS) {
+        led->bit = 0;
+        if (++led->row == LED_SCAN)
+            led->row = 0;
+    }
+    rgb_matrix_shift_start(led);
+}
+
+/* the last clear of a row, the shift is over */
+void DMA2_Channel1_IRQHandler(void)
+{
+    struct rgb_matrix *led = g_rgb_matrix;
+
+    DMA_ClearITPendingBit(DMA2_IT_TC1);
+    TIM_Cmd(TIM8, DISABLE);
+    led->shift_done = true;
+    rgb_matrix_step(led);
+}
+
+/* the oe pulse is over */
+void TIM3_IRQHandler(void)
+{
+    struct rgb_matrix *led = g_rgb_matrix;
+
+    TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
+    led->oe_done = true;
+    rgb_matrix_step(led);
+}
+
+static void rgb_matrix_frame_clear(struct rgb_matrix_frame *frame)
+{
+    memset(frame->pc, 0, sizeof(frame->pc));
+    memset(frame->g2, RGB_G2_LOW, sizeof(frame->g2));
+}
+
+/* the caller holds led->lock, the back frame is the front one after it */
+static void rgb_matrix_swap_wait(struct rgb_matrix *led)
+{
+    if (!led->swap_pending)
+        return;
+
+    sem_get(&led->sem);
+    led->swap_pending = false;
+    memcpy(led->frame[led->front ^ 1], led->frame[led->front], sizeof(struct rgb_matrix_frame));
+}
+
+/* cut a pixel into the back planes */
+static void rgb_matrix_pixel_set(struct rgb_matrix *led, int index, const uint8_t *color)
+{
+    struct rgb_matrix_frame *frame = led->frame[led->front ^ 1];
+    int x = index % LED_WIDTH;
+    int y = index / LED_WIDTH;
+    int row = y % LED_SCAN;
+    bool top = y < LED_SCAN;
+    uint8_t level[DS_COLOR_DATA_MAX];
+    uint8_t pc;
+    int i, bit;
+
+    for (i = 0; i < DS_COLOR_DATA_MAX; i++) {
+        level[i] = min_t(uint16_t, led_gamma[color[i]] + ((1 << (8 - RGB_MATRIX_BITS)) >> 1),
+                         U8_MAX) >> (8 - RGB_MATRIX_BITS);
+    }
 
-        RGB_A(j & 0x1);
-        RGB_B(j & 0x2);
-        RGB_C(j & 0x4);
-        RGB_D(j & 0x8);
-        RGB_E(j & 0x10);
-
-        RGB_LAT(1);
-        RGB_LAT(0);
-        
-        RGB_OE(0);
-        usleep(30);
-        RGB_OE(1);
+    for (bit = 0; bit < RGB_MATRIX_BITS; bit++) {
+        pc = frame->pc[bit][row][x];
+        if (top) {
+            pc &= ~RGB_TOP_PINS;
+            pc |= ((level[DS_COLOR_R] >> bit) & 1) ? RGB_R1_PIN : 0;
+            pc |= ((level[DS_COLOR_G] >> bit) & 1) ? RGB_G1_PIN : 0;
+            pc |= ((level[DS_COLOR_B] >> bit) & 1) ? RGB_B1_PIN : 0;
+        } else {
+            pc &= ~RGB_BOTTOM_PINS;
+            pc |= ((level[DS_COLOR_R] >> bit) & 1) ? RGB_R2_PIN : 0;
+            pc |= ((level[DS_COLOR_B] >> bit) & 1) ? RGB_B2_PIN : 0;
+            frame->g2[bit][row][x] = ((level[DS_COLOR_G] >> bit) & 1) ? RGB_G2_HIGH : RGB_G2_LOW;
+        }
+        frame->pc[bit][row][x] = pc;
     }
 }
 
 static void rgb_matrix_buf_init(struct rgb_matrix *led)
 {
     mutex_lock(&led->lock);
-    memset(led->buf, 0, LED_BUF_SZIE);
+    rgb_matrix_swap_wait(led);
+    rgb_matrix_frame_clear(led->frame[0]);
+    rgb_matrix_frame_clear(led->frame[1]);
     mutex_unlock(&led->lock);
 }
 
 static ssize_t rgb_matrix_buf_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
 {
     struct rgb_matrix *led = dev->priv;
+    const uint8_t *color = buffer;
+    size_t i;
 
-    if (size != LED_BUF_SZIE) {
-        pr_err("data size error\r\n");
+    /* any run of whole pixels, pos is the byte offset in the frame */
+    if (pos % DS_COLOR_DATA_MAX || size % DS_COLOR_DATA_MAX || pos + size > LED_BUF_SZIE) {
+        pr_err("data size error, pos=%u, size=%u\r\n", (unsigned int)pos, (unsigned int)size);
         return -EINVAL;
     }
 
     mutex_lock(&led->lock);
-    memcpy(led->buf, buffer, LED_BUF_SZIE);
+    rgb_matrix_swap_wait(led);
+    for (i = 0; i < size; i += DS_COLOR_DATA_MAX)
+        rgb_matrix_pixel_set(led, (pos + i) / DS_COLOR_DATA_MAX, color + i);
     mutex_unlock(&led->lock);
 
     return size;
 }
 
+/* the back frame is shown from the next frame of the refresh on */
+static void rgb_matrix_refresh(struct rgb_matrix *led)
+{
+    mutex_lock(&led->lock);
+    rgb_matrix_swap_wait(led);
+    led->swap_pending = true;
+    led->swap = true;
+    mutex_unlock(&led->lock);
+}
+
 static int rgb_matrix_control(struct device *dev, int cmd, void *args)
 {
     struct rgb_matrix *led = dev->priv;
-    struct display_dev_info info = {.width = LED_WIDTH, .height = LED_HEIGHT};
+    struct display_dev_info info = {
+        .width = LED_WIDTH, .height = LED_HEIGHT, .flags = DISPLAY_DEV_PARTIAL_WRITE,
+    };
 
     switch (cmd) {
     case LED_CTRL_ENABLE:
@@ -129,7 +306,10 @@ static int rgb_matrix_control(struct device *dev, int cmd, void *args)
     case LED_CTRL_GET_ENABLE_STATUS:
         return led->enable;
     case LED_CTRL_REFRESH:
+        rgb_matrix_refresh(led);
         break;
+    case LED_CTRL_GET_BUSY:
+        return led->swap;
     case DS_CTRL_GET_DEV_INFO:
         memcpy(args, &info, sizeof(struct display_dev_info));
         break;
@@ -148,6 +328,7 @@ static int rgb_matrix_gpio_init(void)
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOE, ENABLE);
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
 
     GPIO_InitStructure.GPIO_Pin = GPIO_Pin_6;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
@@ -155,31 +336,118 @@ static int rgb_matrix_gpio_init(void)
     GPIO_Init(GPIOE, &GPIO_InitStructure);
     GPIO_ResetBits(GPIOE, GPIO_Pin_6);
 
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7;
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7;
     GPIO_Init(GPIOA, &GPIO_InitStructure);
-    GPIO_ResetBits(GPIOA, GPIO_Pin_0 | GPIO_Pin_1 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7);
+    GPIO_ResetBits(GPIOA, GPIO_Pin_0 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7);
 
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0 | GPIO_Pin_1 | GPIO_Pin_2 | GPIO_Pin_3 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7 | GPIO_Pin_8;
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0 | GPIO_Pin_1 | GPIO_Pin_2 | GPIO_Pin_3 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7;
     GPIO_Init(GPIOC, &GPIO_InitStructure);
-    GPIO_ResetBits(GPIOC, GPIO_Pin_0 | GPIO_Pin_1 | GPIO_Pin_2 | GPIO_Pin_3 | GPIO_Pin_4 | GPIO_Pin_6 | GPIO_Pin_7);
-    GPIO_SetBits(GPIOC, GPIO_Pin_5 | GPIO_Pin_8);
+    GPIO_ResetBits(GPIOC, GPIO_Pin_0 | GPIO_Pin_1 | GPIO_Pin_2 | GPIO_Pin_3 | GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_6 | GPIO_Pin_7);
 
-    RGB_CLK(1);
-    RGB_OE(1);
+    /* G2 TIM2_CH2 and OE TIM3_CH3, remapped to PC8 */
+    GPIO_PinRemapConfig(GPIO_FullRemap_TIM3, ENABLE);
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1;
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_8;
+    GPIO_Init(GPIOC, &GPIO_InitStructure);
 
     return 0;
 }
 
-static void rgb_matrix_task_entry(void* parameter)
+static int rgb_matrix_tim_init(void)
 {
-    struct rgb_matrix *led = parameter;
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 | RCC_APB1Periph_TIM3, ENABLE);
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM8, ENABLE);
+
+    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+    TIM_OCStructInit(&TIM_OCInitStructure);
+
+    /* G2, the counter never runs */
+    TIM_OCInitStructure.TIM_OCMode = TIM_ForcedAction_InActive;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OC2Init(TIM2, &TIM_OCInitStructure);
+    TIM2->CCER = RGB_G2_LOW;
+
+    /* OE is low from 1 to ARR, high once the counter stops at 0 */
+    TIM_TimeBaseStructure.TIM_Prescaler = 0;
+    TIM_TimeBaseStructure.TIM_Period = 1 + RGB_MATRIX_OE_BASE;
+    TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+    TIM_SelectOnePulseMode(TIM3, TIM_OPMode_Single);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = 1;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_Low;
+    TIM_OC3Init(TIM3, &TIM_OCInitStructure);
+    TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
+    TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
+
+    /* the pixel clock, only the dma requests are used */
+    TIM_TimeBaseStructure.TIM_Period = RGB_MATRIX_CLK_DIV - 1;
+    TIM_TimeBaseInit(TIM8, &TIM_TimeBaseStructure);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = 1;
+    TIM_OC1Init(TIM8, &TIM_OCInitStructure);
+    TIM_OC2Init(TIM8, &TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_Pulse = RGB_MATRIX_CLK_DIV / 2;
+    TIM_OC4Init(TIM8, &TIM_OCInitStructure);
+    TIM_DMACmd(TIM8, TIM_DMA_Update | TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC4, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = TIM3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
 
-    while(true) {
-        mutex_lock(&led->lock);
-        rgb_matrix_display(led);
-        mutex_unlock(&led->lock);
-        msleep(10);
-    }
+    return 0;
+}
+
+static void rgb_matrix_dma_ch_init(DMA_Channel_TypeDef *ch, volatile void *periph,
+                                   uint32_t periph_size, bool mem_inc)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    DMA_DeInit(ch);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)periph;
+    DMA_InitStructure.DMA_MemoryBaseAddr = 0;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = mem_inc ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    DMA_InitStructure.DMA_PeripheralDataSize = periph_size;
+    /* a byte of the planes or a word of the constants, the dma pads it to the register */
+    DMA_InitStructure.DMA_MemoryDataSize = mem_inc ? DMA_MemoryDataSize_Byte : DMA_MemoryDataSize_Word;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(ch, &DMA_InitStructure);
+}
+
+static int rgb_matrix_dma_init(void)
+{
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
+
+    /* TIM8 update, CC1, CC2 and CC4 */
+    rgb_matrix_dma_ch_init(DMA2_Channel1, &GPIOC->BRR, DMA_PeripheralDataSize_Word, false);
+    rgb_matrix_dma_ch_init(DMA2_Channel3, &GPIOC->BSRR, DMA_PeripheralDataSize_Word, true);
+    rgb_matrix_dma_ch_init(DMA2_Channel5, &TIM2->CCER, DMA_PeripheralDataSize_HalfWord, true);
+    rgb_matrix_dma_ch_init(DMA2_Channel2, &GPIOC->BSRR, DMA_PeripheralDataSize_Word, false);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA2_Channel1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(DMA2_Channel1, DMA_IT_TC, ENABLE);
+
+    return 0;
 }
 
 static int rgb_matrix_init(void)
@@ -192,11 +460,25 @@ static int rgb_matrix_init(void)
         return -ENOMEM;
     }
 
-    rgb_matrix_gpio_init();
-    memset(led->buf, 0, LED_BUF_SZIE);
+    memset(led, 0, sizeof(struct rgb_matrix));
+    led->frame[0] = kmalloc(sizeof(struct rgb_matrix_frame), GFP_KERNEL);
+    led->frame[1] = kmalloc(sizeof(struct rgb_matrix_frame), GFP_KERNEL);
+    if (led->frame[0] == NULL || led->frame[1] == NULL) {
+        pr_err("alloc rgb_matrix frame error\r\n");
+        return -ENOMEM;
+    }
+    rgb_matrix_frame_clear(led->frame[0]);
+    rgb_matrix_frame_clear(led->frame[1]);
 
     mutex_init(&led->lock);
+    sem_init(&led->sem, 0);
     led->enable = false;
+    led->oe_done = true;
+    g_rgb_matrix = led;
+
+    rgb_matrix_gpio_init();
+    rgb_matrix_tim_init();
+    rgb_matrix_dma_init();
 
     device_init(&led->dev);
     led->dev.name = "rgb-matrix";
@@ -205,13 +487,8 @@ static int rgb_matrix_init(void)
     led->dev.priv = led;
     device_register(&led->dev);
 
-    led->task = task_create("rgb-matrix", rgb_matrix_task_entry, led, 10, 512, 10, NULL);
-    if (led->task == NULL) {
-        pr_fatal("creat rgb_matrix task err\r\n");
-        BUG_ON(true);
-        return -EINVAL;
-    }
-    task_ready(led->task);
+    /* from here on the refresh runs in the irqs */
+    rgb_matrix_shift_start(led);
 
     return 0;
 }
@@ -27,7 +27,14 @@
 
 #define OLED_WIDTH 128
 #define OLED_HEIGHT 64
-#define OLED_BUF_SIZE (OLED_WIDTH * OLED_HEIGHT / 8)
+#define OLED_PAGES (OLED_HEIGHT / 8)
+#define OLED_BUF_SIZE (OLED_WIDTH * OLED_PAGES)
+/* the panel shows ram from this column on */
+#define OLED_COLUMN_OFFSET 1
+/* a run shorter than this is sent by the cpu, the dma irq costs more */
+#define OLED_DMA_MIN 16
+/* equal columns a run goes over rather than setting the position again */
+#define OLED_RUN_GAP 4
 #define USE_SOFT_SPI 0
 
 #define oled_clk(value) (PAout(5) = !!(value))
@@ -36,14 +43,22 @@
 #define oled_dc(value)  (PBout(1) = !!(value))
 #define oled_cs(value)  (PBout(2) = !!(value))
 
+/*
+ * The shadow is what the panel shows, a page is 8 rows of OLED_WIDTH
+ * column bytes. A write only sends the column runs of a page that differ
+ * from it.
+ */
 struct ssd1106_oled {
     struct mutex lock;
     struct device dev;
-    //char *buf[OLED_BUF_SIZE];
+    sem_t sem;
+    u8 shadow[OLED_BUF_SIZE];
 
     bool enable;
 };
 
+static struct ssd1106_oled *g_ssd1106_oled;
+
 static int ssd1106_oled_spi_write_byte(u8 data)
 {
 #if USE_SOFT_SPI
@@ -100,9 +115,10 @@ static int ssd1106_oled_write_data(u8 data)
 
 static void ssd1106_oled_set_pos(unsigned char x, unsigned char y)
 {
+    x += OLED_COLUMN_OFFSET;
     ssd1106_oled_write_cmd(0xb0 + y);
     ssd1106_oled_write_cmd(((x & 0xf0) >> 4) | 0x10);
-    ssd1106_oled_write_cmd((x & 0x0f) | 0x01);
+    ssd1106_oled_write_cmd(x & 0x0f);
 }
 
 void ssd1106_oled_display_on(void)
@@ -131,27 +147,102 @@ void ssd1106_oled_clear(void)
     }
 }
 
+/* the caller holds oled->lock, len columns of the shadow from x on go to the panel */
+static void ssd1106_oled_send(struct ssd1106_oled *oled, u8 page, u8 x, u8 len)
+{
+    const u8 *data = oled->shadow + page * OLED_WIDTH + x;
+    u8 i;
+
+    ssd1106_oled_set_pos(x, page);
+    oled_dc(1);
+    oled_cs(0);
+#if !USE_SOFT_SPI
+    if (len >= OLED_DMA_MIN) {
+        DMA_Cmd(DMA1_Channel3, DISABLE);
+        DMA1_Channel3->CMAR = (uint32_t)data;
+        DMA_SetCurrDataCounter(DMA1_Channel3, len);
+        DMA_Cmd(DMA1_Channel3, ENABLE);
+        sem_get(&oled->sem);
+        /* the dma is done when the last byte is in DR, not when it is out */
+        while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET);
+        while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_BSY) == SET);
+        oled_cs(1);
+        return;
+    }
+#endif
+    for (i = 0; i < len; i++)
+        ssd1106_oled_spi_write_byte(data[i]);
+    oled_cs(1);
+}
+
+/*
+ * data is the new columns [lo, hi) of a page. The columns that differ from
+ * the shadow are sent in runs, a run goes over up to OLED_RUN_GAP equal
+ * columns as that is cheaper than the three commands of a new position.
+ */
+static void ssd1106_oled_update_page(struct ssd1106_oled *oled, u8 page, int lo, int hi,
+                                     const u8 *data)
+{
+    u8 *shadow = oled->shadow + page * OLED_WIDTH;
+    int x = lo, start, end, same;
+
+    while (x < hi) {
+        if (shadow[x] == data[x - lo]) {
+            x++;
+            continue;
+        }
+
+        start = x;
+        end = x + 1;
+        same = 0;
+        for (x = start + 1; x < hi && same <= OLED_RUN_GAP; x++) {
+            if (shadow[x] == data[x - lo]) {
+                same++;
+            } else {
+                same = 0;
+                end = x + 1;
+            }
+        }
+        x = end;
+
+        memcpy(shadow + start, data + start - lo, end - start);
+        ssd1106_oled_send(oled, page, start, end - start);
+    }
+}
+
 static void ssd1106_oled_buf_init(struct ssd1106_oled *oled)
 {
+    u8 page;
+
     mutex_lock(&oled->lock);
-    //memset(oled->buf, 0, OLED_BUF_SIZE);
+    memset(oled->shadow, 0, OLED_BUF_SIZE);
+    for (page = 0; page < OLED_PAGES; page++)
+        ssd1106_oled_send(oled, page, 0, OLED_WIDTH);
     mutex_unlock(&oled->lock);
 }
 
+/*
+ * pos is the byte offset in the page major frame, page * OLED_WIDTH plus
+ * the column, and each byte is 8 rows of a column, lsb on top.
+ */
 static ssize_t ssd1106_oled_buf_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
 {
     struct ssd1106_oled *oled = dev->priv;
-    u8 x, y;
-    size_t i;
     const u8 *data = buffer;
+    size_t end = pos + size;
+    size_t next;
+    u8 page;
 
-    x = pos % OLED_WIDTH;
-    y = pos / OLED_WIDTH;
+    if (buffer == NULL || pos >= OLED_BUF_SIZE || size > OLED_BUF_SIZE - pos)
+        return -EINVAL;
 
     mutex_lock(&oled->lock);
-    ssd1106_oled_set_pos(x, y);
-    for (i = 0; i < size; i++) {
-        ssd1106_oled_write_data(data[i]);
+    while (pos < end) {
+        page = pos / OLED_WIDTH;
+        next = min_t(size_t, (page + 1) * OLED_WIDTH, end);
+        ssd1106_oled_update_page(oled, page, pos % OLED_WIDTH, next - page * OLED_WIDTH, data);
+        data += next - pos;
+        pos = next;
     }
     mutex_unlock(&oled->lock);
 
@@ -231,11 +322,53 @@ static int ssd1106_oled_spi_init(void)
     SPI_InitStructure.SPI_CRCPolynomial = 7;
     SPI_Init(SPI1, &SPI_InitStructure);
     SPI_Cmd(SPI1, ENABLE);
+    SPI_I2S_DMACmd(SPI1, SPI_I2S_DMAReq_Tx, ENABLE);
 #endif
 
     return 0;
 }
 
+#if !USE_SOFT_SPI
+static int ssd1106_oled_dma_init(void)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    DMA_DeInit(DMA1_Channel3);
+
+    /* spi1 tx, the memory address and count are set for every run */
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&SPI1->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = 0;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel3, &DMA_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(DMA1_Channel3, DMA_IT_TC, ENABLE);
+
+    return 0;
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    DMA_ClearITPendingBit(DMA1_IT_TC3);
+    DMA_Cmd(DMA1_Channel3, DISABLE);
+    sem_send_one(&g_ssd1106_oled->sem);
+}
+#endif
+
 static int ssd1106_oled_hw_init(void)
 {
     oled_rst(1);
@@ -289,11 +422,18 @@ static int ssd1106_oled_init(void)
     }
 
     mutex_init(&oled->lock);
+    sem_init(&oled->sem, 0);
     oled->enable = false;
+    g_ssd1106_oled = oled;
 
     ssd1106_oled_gpio_init();
     ssd1106_oled_spi_init();
+#if !USE_SOFT_SPI
+    ssd1106_oled_dma_init();
+#endif
     ssd1106_oled_hw_init();
+    /* the clear is not shifted by OLED_COLUMN_OFFSET, send the shadow once to match it */
+    ssd1106_oled_buf_init(oled);
 
     device_init(&oled->dev);
     oled->dev.name = "ssd1106-oled";
@@ -23,6 +23,7 @@
 #include <kernel/sem.h>
 #include <kernel/mutex.h>
 
+#include <display/led.h>
 #include <display/display.h>
 
 #define LCD_WIDTH 240
@@ -30,6 +31,8 @@
 #define LCD_COLOR_WIDTH sizeof(u16)
 #define LCD_BUF_SZIE (LCD_WIDTH * LCD_HEIGHT * LCD_COLOR_WIDTH)
 #define USE_SOFT_SPI 0
+/* half words a dma transfer can count */
+#define LCD_DMA_CHUNK 0xffff
 
 #define lcd_clk(value) (PAout(5) = !!(value))
 #define lcd_din(value) (PAout(7) = !!(value))
@@ -40,9 +43,22 @@
 struct st7789_lcd {
     struct mutex lock;
     struct device dev;
+    sem_t sem;
+
+    /* the part of the window not handed to the dma yet */
+    const u16 *dma_next;
+    size_t dma_left;
+    /* a window was started and its completion not taken from sem yet */
+    bool dma_pending;
+    /* set by the dma irq */
+    volatile bool dma_done;
+    /* the window is the last of a write, its end runs flush_done */
+    bool dma_last;
+    struct display_flush_done flush_done;
 
     bool enable;
 };
+static struct st7789_lcd *g_st7789_lcd;
 
 static int st7789_lcd_spi_write_byte(u8 data)
 {
@@ -118,32 +134,116 @@ static void st7789_lcd_clear(u16 color)
     }
 }
 
+#if !USE_SOFT_SPI
+/* the spi is off while the frame size changes */
+static void st7789_lcd_spi_data_size(u16 size)
+{
+    SPI_Cmd(SPI1, DISABLE);
+    SPI_DataSizeConfig(SPI1, size);
+    SPI_Cmd(SPI1, ENABLE);
+}
+
+static void st7789_lcd_dma_start(struct st7789_lcd *lcd)
+{
+    u16 num = min_t(size_t, lcd->dma_left, LCD_DMA_CHUNK);
+
+    DMA_Cmd(DMA1_Channel3, DISABLE);
+    DMA1_Channel3->CMAR = (uint32_t)lcd->dma_next;
+    DMA_SetCurrDataCounter(DMA1_Channel3, num);
+    lcd->dma_next += num;
+    lcd->dma_left -= num;
+    DMA_Cmd(DMA1_Channel3, ENABLE);
+}
+#endif
+
+/* the caller holds lcd->lock, the spi is back in 8 bit mode after it */
+static void st7789_lcd_dma_wait(struct st7789_lcd *lcd)
+{
+#if !USE_SOFT_SPI
+    if (!lcd->dma_pending)
+        return;
+
+    sem_get(&lcd->sem);
+    lcd->dma_pending = false;
+    /* the dma is done when the last half word is in DR, not when it is out */
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET);
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_BSY) == SET);
+    st7789_lcd_spi_data_size(SPI_DataSize_8b);
+#endif
+}
+
+/*
+ * Send num pixels into a window. The address is set by the cpu, then the
+ * pixels go out by dma in 16 bit frames, a window larger than a dma count
+ * is sent in chunks chained from the irq. It returns once the dma runs.
+ * last is set for the last window of a write.
+ */
+static void st7789_lcd_window_write(struct st7789_lcd *lcd, u16 x1, u16 y1, u16 x2, u16 y2,
+                                    const u16 *data, size_t num, bool last)
+{
+    st7789_lcd_dma_wait(lcd);
+    st7789_lcd_address_set(x1, y1, x2, y2);
+#if USE_SOFT_SPI
+    while (num--)
+        st7789_lcd_write_half_word(*data++);
+#else
+    lcd_dc(1);
+    st7789_lcd_spi_data_size(SPI_DataSize_16b);
+    lcd->dma_next = data;
+    lcd->dma_left = num;
+    lcd->dma_done = false;
+    lcd->dma_last = last;
+    lcd->dma_pending = true;
+    st7789_lcd_dma_start(lcd);
+#endif
+}
+
 static void st7789_lcd_buf_init(struct st7789_lcd *lcd)
 {
+    mutex_lock(&lcd->lock);
+    st7789_lcd_dma_wait(lcd);
+    mutex_unlock(&lcd->lock);
 }
 
+/*
+ * pos is the first pixel and size the bytes of native endian RGB565. The
+ * run is sent as a part row, whole rows and a part row, one window each.
+ * The last window is still being sent when this returns.
+ */
 static ssize_t st7789_lcd_buf_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
 {
     struct st7789_lcd *lcd = dev->priv;
-    u16 x_s, y_s, x_e, y_e;
-    const u16 *data;
-    size_t index;
-
-    x_s = pos % LCD_WIDTH;
-    y_s = pos / LCD_WIDTH;
-    if (y_s >= LCD_HEIGHT)
-        y_s = LCD_HEIGHT;
-    x_e = (pos + size / LCD_COLOR_WIDTH) % LCD_WIDTH;
-    y_e = (pos + size / LCD_COLOR_WIDTH) / LCD_WIDTH;
-    if (y_e >= LCD_HEIGHT)
-        y_e = LCD_HEIGHT;
+    const u16 *data = buffer;
+    size_t num = size / LCD_COLOR_WIDTH;
+    size_t len;
+    u16 x, y;
+
+    if (size % LCD_COLOR_WIDTH || pos + num > LCD_WIDTH * LCD_HEIGHT) {
+        pr_err("data size error, pos=%u, size=%u\r\n", (unsigned int)pos, (unsigned int)size);
+        return -EINVAL;
+    }
+
+    x = pos % LCD_WIDTH;
+    y = pos / LCD_WIDTH;
 
     mutex_lock(&lcd->lock);
-    st7789_lcd_address_set(x_s, y_s, x_e, y_e);
-    data = (u16 *)buffer;
-    for (index = 0; index < size / LCD_COLOR_WIDTH; index++) {
-        st7789_lcd_write_half_word(data[index]);
+    if (x != 0 && num > 0) {
+        len = min_t(size_t, num, LCD_WIDTH - x);
+        st7789_lcd_window_write(lcd, x, y, x + len - 1, y, data, len, len == num);
+        data += len;
+        num -= len;
+        y++;
     }
+    if (num >= LCD_WIDTH) {
+        len = num - num % LCD_WIDTH;
+        st7789_lcd_window_write(lcd, 0, y, LCD_WIDTH - 1, y + len / LCD_WIDTH - 1, data, len,
+                                len == num);
+        data += len;
+        num -= len;
+        y += len / LCD_WIDTH;
+    }
+    if (num > 0)
+        st7789_lcd_window_write(lcd, 0, y, num - 1, y, data, num, true);
     mutex_unlock(&lcd->lock);
 
     return size;
@@ -152,7 +252,10 @@ static ssize_t st7789_lcd_buf_write(struct device *dev, addr_t pos, const void *
 static int st7789_lcd_control(struct device *dev, int cmd, void *args)
 {
     struct st7789_lcd *lcd = dev->priv;
-    struct display_dev_info info = {.width = LCD_WIDTH, .height = LCD_HEIGHT};
+    struct display_dev_info info = {
+        .width = LCD_WIDTH, .height = LCD_HEIGHT,
+        .flags = DISPLAY_DEV_RGB565 | (USE_SOFT_SPI ? 0 : DISPLAY_DEV_ASYNC_WRITE),
+    };
 
     switch (cmd) {
     case DS_CTRL_ENABLE:
@@ -167,6 +270,17 @@ static int st7789_lcd_control(struct device *dev, int cmd, void *args)
     case DS_CTRL_GET_DEV_INFO:
         memcpy(args, &info, sizeof(struct display_dev_info));
         break;
+    case LED_CTRL_GET_BUSY:
+        return lcd->dma_pending && !lcd->dma_done;
+    case DS_CTRL_SET_FLUSH_DONE:
+        mutex_lock(&lcd->lock);
+        st7789_lcd_dma_wait(lcd);
+        if (args == NULL)
+            memset(&lcd->flush_done, 0, sizeof(struct display_flush_done));
+        else
+            memcpy(&lcd->flush_done, args, sizeof(struct display_flush_done));
+        mutex_unlock(&lcd->lock);
+        break;
     default:
         pr_err("unknown cmd: %d\r\n", cmd);
         return -EINVAL;
@@ -221,6 +335,7 @@ static int st7789_lcd_spi_init(void)
     SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
     SPI_InitStructure.SPI_CRCPolynomial = 7;
     SPI_Init(SPI1, &SPI_InitStructure);
+    SPI_I2S_DMACmd(SPI1, SPI_I2S_DMAReq_Tx, ENABLE);
     SPI_Cmd(SPI1, ENABLE);
     st7789_lcd_spi_write_byte(0xff);
 #endif
@@ -228,6 +343,57 @@ static int st7789_lcd_spi_init(void)
     return 0;
 }
 
+#if !USE_SOFT_SPI
+static int st7789_lcd_dma_init(void)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    DMA_DeInit(DMA1_Channel3);
+
+    /* spi1 tx, the memory address and count are set for every chunk */
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&SPI1->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = 0;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel3, &DMA_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(DMA1_Channel3, DMA_IT_TC, ENABLE);
+
+    return 0;
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    struct st7789_lcd *lcd = g_st7789_lcd;
+
+    DMA_ClearITPendingBit(DMA1_IT_TC3);
+    if (lcd->dma_left > 0) {
+        st7789_lcd_dma_start(lcd);
+        return;
+    }
+
+    DMA_Cmd(DMA1_Channel3, DISABLE);
+    lcd->dma_done = true;
+    if (lcd->dma_last && lcd->flush_done.done != NULL)
+        lcd->flush_done.done(lcd->flush_done.arg);
+    sem_send_one(&lcd->sem);
+}
+#endif
+
 static int st7789_lcd_hw_init(void)
 {
     lcd_rst(0);
@@ -323,11 +489,18 @@ static int st7789_lcd_init(void)
         return -ENOMEM;
     }
 
+    memset(lcd, 0, sizeof(struct st7789_lcd));
     mutex_init(&lcd->lock);
+    sem_init(&lcd->sem, 0);
     lcd->enable = false;
+    lcd->dma_done = true;
+    g_st7789_lcd = lcd;
 
     st7789_lcd_gpio_init();
     st7789_lcd_spi_init();
+#if !USE_SOFT_SPI
+    st7789_lcd_dma_init();
+#endif
     st7789_lcd_hw_init();
 
     device_init(&lcd->dev);
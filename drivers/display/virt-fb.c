@@ -0,0 +1,249 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[VIRT_FB]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/console.h>
+#include <kernel/device.h>
+#include <kernel/init.h>
+#include <kernel/mm.h>
+#include <kernel/mutex.h>
+#include <string.h>
+#include <lib/vsprintf.h>
+
+#include <display/led.h>
+#include <display/display.h>
+#include <display/virt_fb.h>
+
+/*
+ * A frame buffer in ram with no panel behind it, so the display server and
+ * the clients can be run and timed on qemu. It takes RGB888 writes like the
+ * led devices and a refresh ends a frame, there is no transfer so it is
+ * never busy. A dumped frame is a ppm, written to the host over semihosting
+ * with CONFIG_VIRT_FB_SEMIHOST, qemu needs -semihosting, else printed as an
+ * ascii ppm on the console between two marker lines.
+ */
+
+#define VIRT_FB_SIZE (VIRT_FB_WIDTH * VIRT_FB_HEIGHT * DS_COLOR_DATA_MAX)
+
+struct virt_fb {
+    struct device dev;
+    struct mutex lock;
+    uint8_t *buf;
+    /* a row in r, g, b order for a semihosting dump */
+    uint8_t *row;
+    bool enable;
+    bool dump;
+    struct virt_fb_stats stats;
+};
+
+#ifdef CONFIG_VIRT_FB_SEMIHOST
+#define SEMIHOST_SYS_OPEN  0x01
+#define SEMIHOST_SYS_CLOSE 0x02
+#define SEMIHOST_SYS_WRITE 0x05
+/* "wb" of fopen() */
+#define SEMIHOST_MODE_WB   5
+
+static int virt_fb_semihost(int op, void *args)
+{
+    register int r0 __asm__("r0") = op;
+    register void *r1 __asm__("r1") = args;
+
+    __asm__ volatile("bkpt 0xab" : "+r"(r0) : "r"(r1) : "memory");
+
+    return r0;
+}
+
+static void virt_fb_dump_frame(struct virt_fb *fb)
+{
+    char name[24], head[24];
+    uint32_t args[3];
+    int fd, y, x, len;
+    const uint8_t *src;
+
+    snprintf(name, sizeof(name), "virt_fb_%04u.ppm", (unsigned int)fb->stats.frames);
+    args[0] = (uint32_t)name;
+    args[1] = SEMIHOST_MODE_WB;
+    args[2] = strlen(name);
+    fd = virt_fb_semihost(SEMIHOST_SYS_OPEN, args);
+    if (fd < 0) {
+        pr_err("open %s error\r\n", name);
+        return;
+    }
+
+    len = snprintf(head, sizeof(head), "P6\n%u %u\n255\n", VIRT_FB_WIDTH, VIRT_FB_HEIGHT);
+    args[0] = fd;
+    args[1] = (uint32_t)head;
+    args[2] = len;
+    virt_fb_semihost(SEMIHOST_SYS_WRITE, args);
+    for (y = 0; y < VIRT_FB_HEIGHT; y++) {
+        src = fb->buf + y * VIRT_FB_WIDTH * DS_COLOR_DATA_MAX;
+        for (x = 0; x < VIRT_FB_WIDTH; x++, src += DS_COLOR_DATA_MAX) {
+            fb->row[x * 3 + 0] = src[DS_COLOR_R];
+            fb->row[x * 3 + 1] = src[DS_COLOR_G];
+            fb->row[x * 3 + 2] = src[DS_COLOR_B];
+        }
+        args[1] = (uint32_t)fb->row;
+        args[2] = VIRT_FB_WIDTH * 3;
+        virt_fb_semihost(SEMIHOST_SYS_WRITE, args);
+    }
+    virt_fb_semihost(SEMIHOST_SYS_CLOSE, args);
+    pr_info("frame %u dumped to %s\r\n", fb->stats.frames, name);
+}
+#else
+/* 4 pixels a line keep the lines short for a terminal log */
+static void virt_fb_dump_frame(struct virt_fb *fb)
+{
+    const uint8_t *src = fb->buf;
+    char line[64];
+    int i, len = 0;
+
+    pr_info("frame %u ppm begin\r\n", fb->stats.frames);
+    len = snprintf(line, sizeof(line), "P3\n%u %u\n255\n", VIRT_FB_WIDTH, VIRT_FB_HEIGHT);
+    console_write(line, len);
+    len = 0;
+    for (i = 0; i < VIRT_FB_WIDTH * VIRT_FB_HEIGHT; i++, src += DS_COLOR_DATA_MAX) {
+        len += snprintf(line + len, sizeof(line) - len, "%u %u %u%c", src[DS_COLOR_R],
+                        src[DS_COLOR_G], src[DS_COLOR_B], (i & 3) == 3 ? '\n' : ' ');
+        if ((i & 3) == 3) {
+            console_write(line, len);
+            len = 0;
+        }
+    }
+    if (len > 0)
+        console_write(line, len);
+    pr_info("frame %u ppm end\r\n", fb->stats.frames);
+}
+#endif
+
+static ssize_t virt_fb_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
+{
+    struct virt_fb *fb = dev->priv;
+
+    /* any run of whole pixels, pos is the byte offset in the frame */
+    if (pos % DS_COLOR_DATA_MAX || size % DS_COLOR_DATA_MAX || pos + size > VIRT_FB_SIZE) {
+        pr_err("data size error, pos=%u, size=%u\r\n", (unsigned int)pos, (unsigned int)size);
+        return -EINVAL;
+    }
+
+    mutex_lock(&fb->lock);
+    memcpy(fb->buf + pos, buffer, size);
+    fb->stats.writes++;
+    fb->stats.frame_pixels += size / DS_COLOR_DATA_MAX;
+    mutex_unlock(&fb->lock);
+
+    return size;
+}
+
+static void virt_fb_refresh(struct virt_fb *fb)
+{
+    struct virt_fb_stats *stats = &fb->stats;
+
+    mutex_lock(&fb->lock);
+    stats->frames++;
+    stats->last_pixels = stats->frame_pixels;
+    stats->max_pixels = max(stats->max_pixels, stats->frame_pixels);
+    stats->total_pixels += stats->frame_pixels;
+    if (stats->frame_pixels == 0)
+        stats->empty++;
+    stats->frame_pixels = 0;
+
+    if (VIRT_FB_DUMP_EVERY && stats->frames % VIRT_FB_DUMP_EVERY == 0)
+        fb->dump = true;
+    if (fb->dump) {
+        fb->dump = false;
+        stats->dumps++;
+        virt_fb_dump_frame(fb);
+    }
+    mutex_unlock(&fb->lock);
+}
+
+static int virt_fb_control(struct device *dev, int cmd, void *args)
+{
+    struct virt_fb *fb = dev->priv;
+    struct display_dev_info info = {
+        .width = VIRT_FB_WIDTH, .height = VIRT_FB_HEIGHT, .flags = DISPLAY_DEV_PARTIAL_WRITE,
+    };
+
+    switch (cmd) {
+    case LED_CTRL_ENABLE:
+        fb->enable = true;
+        break;
+    case LED_CTRL_DISABLE:
+        fb->enable = false;
+        mutex_lock(&fb->lock);
+        memset(fb->buf, 0, VIRT_FB_SIZE);
+        mutex_unlock(&fb->lock);
+        break;
+    case LED_CTRL_GET_ENABLE_STATUS:
+        return fb->enable;
+    case LED_CTRL_REFRESH:
+        virt_fb_refresh(fb);
+        break;
+    case LED_CTRL_GET_BUSY:
+        return 0;
+    case DS_CTRL_GET_DEV_INFO:
+        memcpy(args, &info, sizeof(struct display_dev_info));
+        break;
+    case VIRT_FB_CTRL_GET_STATS:
+        mutex_lock(&fb->lock);
+        memcpy(args, &fb->stats, sizeof(struct virt_fb_stats));
+        mutex_unlock(&fb->lock);
+        break;
+    case VIRT_FB_CTRL_CLEAR_STATS:
+        mutex_lock(&fb->lock);
+        memset(&fb->stats, 0, sizeof(struct virt_fb_stats));
+        mutex_unlock(&fb->lock);
+        break;
+    case VIRT_FB_CTRL_DUMP:
+        fb->dump = true;
+        break;
+    default:
+        pr_err("unknown cmd: %d\r\n", cmd);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int virt_fb_init(void)
+{
+    struct virt_fb *fb;
+
+    fb = kzalloc(sizeof(struct virt_fb), GFP_KERNEL);
+    if (fb == NULL) {
+        pr_err("alloc virt_fb error\r\n");
+        return -ENOMEM;
+    }
+    fb->buf = kzalloc(VIRT_FB_SIZE, GFP_KERNEL);
+    if (fb->buf == NULL) {
+        pr_err("alloc frame buf error\r\n");
+        return -ENOMEM;
+    }
+#ifdef CONFIG_VIRT_FB_SEMIHOST
+    fb->row = kmalloc(VIRT_FB_WIDTH * 3, GFP_KERNEL);
+    if (fb->row == NULL) {
+        pr_err("alloc row buf error\r\n");
+        return -ENOMEM;
+    }
+#endif
+    mutex_init(&fb->lock);
+
+    device_init(&fb->dev);
+    fb->dev.name = VIRT_FB_NAME;
+    fb->dev.ops.write = virt_fb_write;
+    fb->dev.ops.control = virt_fb_control;
+    fb->dev.priv = fb;
+    device_register(&fb->dev);
+
+    return 0;
+}
+task_init(virt_fb_init);
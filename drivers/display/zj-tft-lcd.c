@@ -28,6 +28,60 @@
 #include "zj-tft-lcd.h"
 #include "font.h"
 
+/*
+ * Blocks of pixels go to the lcd ram by a memory to memory dma, the pixels
+ * are the incrementing side and LCD_RAM the fixed one. A count is 16 bit,
+ * a larger block is sent in chunks chained from the irq.
+ */
+#define LCD_DMA_CH      DMA1_Channel6
+#define LCD_DMA_IRQn    DMA1_Channel6_IRQn
+#define LCD_DMA_IT_TC   DMA1_IT_TC6
+#define LCD_DMA_CHUNK   0xffff
+
+struct lcd_dma {
+    sem_t sem;
+    /* the part of the block not handed to the dma yet */
+    const u16 *next;
+    u32 left;
+    /* a block was started and its completion not taken from sem yet */
+    bool pending;
+    void (*done)(void *arg);
+    void *arg;
+};
+
+static struct lcd_dma lcd_dma;
+
+/*
+ * A glyph is expanded once into RGB565 in its colours and kept in a small
+ * lru cache, an opaque character is then one window and one dma block.
+ * The glyph being sent is always the most recent one, so a miss never
+ * expands into the slot the dma still reads.
+ */
+#if LCD_GLYPH_CACHE < 2
+#error "LCD_GLYPH_CACHE must be 2 or more"
+#endif
+/* the largest font is 12*24 */
+#define LCD_GLYPH_PIXELS (12 * 24)
+
+struct lcd_glyph {
+    /* lru stamp, 0 if the slot is empty */
+    u32 used;
+    u16 fg;
+    u16 bg;
+    u8 num;
+    u8 size;
+    u16 pixels[LCD_GLYPH_PIXELS];
+};
+
+struct lcd_glyph_cache {
+    u32 stamp;
+    u32 hits;
+    u32 misses;
+    struct lcd_glyph glyph[LCD_GLYPH_CACHE];
+};
+
+static struct lcd_glyph_cache lcd_glyph_cache;
+
 //LCD的画笔颜色和背景色
 u16 POINT_COLOR=0x0000;         //画笔颜色
 u16 BACK_COLOR=0xFFFF;          //背景色 
@@ -385,6 +439,7 @@ void LCD_Scan_Dir(u8 dir)
 //POINT_COLOR:此点的颜色
 void LCD_DrawPoint(u16 x, u16 y)
 {
+    LCD_DMA_Wait();
     LCD_SetCursor(x, y);        //设置光标位置
     LCD_WriteRAM_Prepare();     //开始写入GRAM
     LCD->LCD_RAM=POINT_COLOR; 
@@ -395,6 +450,7 @@ void LCD_DrawPoint(u16 x, u16 y)
 //color:颜色
 void LCD_Fast_DrawPoint(u16 x, u16 y, u16 color)
 {
+    LCD_DMA_Wait();
     if (lcddev.id == 0X5510)
     {
         LCD_WR_REG(lcddev.setxcmd);
@@ -2082,6 +2138,7 @@ void LCD_Init(void)
     
     LCD_Display_Dir(0);         //默认为竖屏
     LCD_LED = 1;                //点亮背光
+    LCD_DMA_Init();
     LCD_Clear(WHITE);
 }  
 
@@ -2108,21 +2165,19 @@ void LCD_Clear(u16 color)
 //color:要填充的颜色
 void LCD_Fill(u16 sx, u16 sy, u16 ex, u16 ey, u16 color)
 {
-    u16 i, j;
-    u16 xlen = 0;
+    u32 i;
+    u32 num = (u32)(ex - sx + 1) * (ey - sy + 1);
 
-    xlen = ex - sx + 1;
+    LCD_DMA_Wait();
+    LCD_Set_Window(sx, sy, ex - sx + 1, ey - sy + 1);
+    LCD_WriteRAM_Prepare();         //开始写入GRAM
 
-    for (i = sy; i <= ey; i++)
+    for (i = 0; i < num; i++)
     {
-        LCD_SetCursor(sx, i);       //设置光标位置
-        LCD_WriteRAM_Prepare();     //开始写入GRAM
-
-        for (j = 0; j < xlen; j++)
-        {
-            LCD->LCD_RAM=color;     //设置光标位置
-        }
+        LCD->LCD_RAM=color;
     }
+
+    LCD_Set_Window(0, 0, lcddev.width, lcddev.height);
 }
 
 //在指定区域内填充指定颜色块
@@ -2130,21 +2185,8 @@ void LCD_Fill(u16 sx, u16 sy, u16 ex, u16 ey, u16 color)
 //color:要填充的颜色
 void LCD_Color_Fill(u16 sx, u16 sy, u16 ex, u16 ey, u16 *color)
 {
-    u16 height, width;
-    u16 i, j;
-    width = ex - sx + 1;            //得到填充的宽度
-    height = ey - sy + 1;           //高度
-
-    for (i = 0; i < height; i++)
-    {
-        LCD_SetCursor(sx, sy + i);  //设置光标位置
-        LCD_WriteRAM_Prepare();     //开始写入GRAM
-
-        for (j = 0; j < width; j++)
-        {
-            LCD->LCD_RAM=color[i * width + j];  //写入数据
-        }
-    }
+    LCD_DMA_Write(sx, sy, ex - sx + 1, ey - sy + 1, color, NULL, NULL);
+    LCD_DMA_Wait();
 }
 
 //画线
@@ -2242,24 +2284,25 @@ void LCD_Draw_Circle(u16 x0, u16 y0, u8 r)
     }
 }
 
-//在指定位置显示一个字符
-//x,y:起始坐标
-//num:要显示的字符:" "--->"~"
-//size:字体大小 12/16/24
-//mode:叠加方式(1)还是非叠加方式(0)
-void LCD_ShowChar(u16 x, u16 y, u8 num, u8 size, u8 mode)
+static const u8 *LCD_Glyph_Font(u8 num, u8 size)
+{
+    if (size == 12)return asc2_1206[num];           //调用1206字体
+    else if (size == 16)return asc2_1608[num];      //调用1608字体
+    else if (size == 24)return asc2_2412[num];      //调用2412字体
+
+    return NULL;                                    //没有的字库
+}
+
+//逐点显示一个字符,用于超出屏幕的字符
+static void LCD_Glyph_Points(u16 x, u16 y, const u8 *font, u8 size, u8 mode)
 {
     u8 temp, t1, t;
     u16 y0 = y;
     u8 csize = (size / 8 + ((size % 8) ? 1 : 0)) * (size / 2);  //得到字体一个字符对应点阵集所占的字节数
-    num = num - ' ';    //得到偏移后的值（ASCII字库是从空格开始取模，所以-' '就是对应字符的字库）
 
     for (t = 0; t < csize; t++)
     {
-        if (size == 12)temp = asc2_1206[num][t];        //调用1206字体
-        else if (size == 16)temp = asc2_1608[num][t];   //调用1608字体
-        else if (size == 24)temp = asc2_2412[num][t];   //调用2412字体
-        else return;                                    //没有的字库
+        temp = font[t];
 
         for (t1 = 0; t1 < 8; t1++)
         {
@@ -2284,6 +2327,140 @@ void LCD_ShowChar(u16 x, u16 y, u8 num, u8 size, u8 mode)
     }
 }
 
+/* the glyph in POINT_COLOR on BACK_COLOR, expanded into the lru slot on a miss */
+static struct lcd_glyph *LCD_Glyph_Get(u8 num, u8 size, const u8 *font)
+{
+    struct lcd_glyph_cache *gc = &lcd_glyph_cache;
+    struct lcd_glyph *glyph, *lru = &gc->glyph[0];
+    u8 width = size / 2;
+    u8 bytes = (size + 7) / 8;
+    u16 *column;
+    u8 temp;
+    int i, t, bit, row;
+
+    for (i = 0; i < LCD_GLYPH_CACHE; i++) {
+        glyph = &gc->glyph[i];
+        if (glyph->used && glyph->num == num && glyph->size == size &&
+            glyph->fg == POINT_COLOR && glyph->bg == BACK_COLOR) {
+            gc->hits++;
+            glyph->used = ++gc->stamp;
+            return glyph;
+        }
+        if (glyph->used < lru->used)
+            lru = glyph;
+    }
+
+    /* the font is by columns of bytes, msb on top, the glyph by rows */
+    gc->misses++;
+    glyph = lru;
+    for (t = 0; t < width * bytes; t++) {
+        temp = font[t];
+        column = &glyph->pixels[t / bytes];
+        row = (t % bytes) * 8;
+        for (bit = 0; bit < 8 && row < size; bit++, row++, temp <<= 1)
+            column[row * width] = (temp & 0x80) ? POINT_COLOR : BACK_COLOR;
+    }
+    glyph->fg = POINT_COLOR;
+    glyph->bg = BACK_COLOR;
+    glyph->num = num;
+    glyph->size = size;
+    glyph->used = ++gc->stamp;
+
+    return glyph;
+}
+
+/* each run of set pixels in a column is one window, the rest is left as is */
+static void LCD_Glyph_Overlay(u16 x, u16 y, const u8 *font, u8 size)
+{
+    u8 width = size / 2;
+    u8 bytes = (size + 7) / 8;
+    u32 bits;
+    int col, row, start, t;
+
+    for (col = 0; col < width; col++, font += bytes) {
+        bits = 0;
+        for (t = 0; t < bytes; t++)
+            bits = (bits << 8) | font[t];
+        /* row 0 in bit 31 */
+        bits <<= 32 - bytes * 8;
+
+        row = 0;
+        while (bits != 0 && row < size) {
+            if (!(bits & 0x80000000)) {
+                bits <<= 1;
+                row++;
+                continue;
+            }
+            start = row;
+            while ((bits & 0x80000000) && row < size) {
+                bits <<= 1;
+                row++;
+            }
+            LCD_Set_Window(x + col, y + start, 1, row - start);
+            LCD_WriteRAM_Prepare();
+            for (t = start; t < row; t++)
+                LCD->LCD_RAM = POINT_COLOR;
+        }
+    }
+    /* the point functions need the whole screen as the window */
+    LCD_Set_Window(0, 0, lcddev.width, lcddev.height);
+}
+
+/* an opaque glyph may still be sent by the dma when this returns */
+static void LCD_Glyph_Draw(u16 x, u16 y, u8 num, u8 size, u8 mode)
+{
+    struct lcd_glyph *glyph;
+    const u8 *font;
+
+    if (num < ' ' || num > '~')
+        return;
+    num = num - ' ';    //得到偏移后的值（ASCII字库是从空格开始取模，所以-' '就是对应字符的字库）
+    font = LCD_Glyph_Font(num, size);
+    if (font == NULL)
+        return;
+
+    if (x + size / 2 > lcddev.width || y + size > lcddev.height) {
+        LCD_DMA_Wait();
+        LCD_Glyph_Points(x, y, font, size, mode);
+        return;
+    }
+    if (mode) {
+        LCD_DMA_Wait();
+        LCD_Glyph_Overlay(x, y, font, size);
+        return;
+    }
+
+    glyph = LCD_Glyph_Get(num, size, font);
+    LCD_DMA_Write(x, y, size / 2, size, glyph->pixels, NULL, NULL);
+}
+
+void LCD_Glyph_Stats(u32 *hits, u32 *misses)
+{
+    *hits = lcd_glyph_cache.hits;
+    *misses = lcd_glyph_cache.misses;
+}
+
+/* the slots are only read by a dma started from them, so it is waited first */
+void LCD_Glyph_Flush(void)
+{
+    int i;
+
+    LCD_DMA_Wait();
+    for (i = 0; i < LCD_GLYPH_CACHE; i++)
+        lcd_glyph_cache.glyph[i].used = 0;
+}
+
+//在指定位置显示一个字符
+//x,y:起始坐标
+//num:要显示的字符:" "--->"~"
+//size:字体大小 12/16/24
+//mode:叠加方式(1)还是非叠加方式(0)
+void LCD_ShowChar(u16 x, u16 y, u8 num, u8 size, u8 mode)
+{
+    LCD_Glyph_Draw(x, y, num, size, mode);
+    LCD_DMA_Wait();
+}
+
 
 //m^n函数
 //返回值:m^n次方.
@@ -2315,15 +2492,17 @@ void LCD_ShowNum(u16 x, u16 y, u32 num, u8 len, u8 size)
         {
             if (temp == 0)
             {
-                LCD_ShowChar(x + (size / 2)*t, y, ' ', size, 0);
+                LCD_Glyph_Draw(x + (size / 2)*t, y, ' ', size, 0);
                 continue;
             }
             else enshow = 1;
 
         }
 
-        LCD_ShowChar(x + (size / 2)*t, y, temp + '0', size, 0);
+        LCD_Glyph_Draw(x + (size / 2)*t, y, temp + '0', size, 0);
     }
+
+    LCD_DMA_Wait();
 }
 
 //显示数字,高位为0,还是显示
@@ -2348,8 +2527,8 @@ void LCD_ShowxNum(u16 x, u16 y, u32 num, u8 len, u8 size, u8 mode)
         {
             if (temp == 0)
             {
-                if (mode & 0X80)LCD_ShowChar(x + (size / 2)*t, y, '0', size, mode & 0X01);
-                else LCD_ShowChar(x + (size / 2)*t, y, ' ', size, mode & 0X01);
+                if (mode & 0X80)LCD_Glyph_Draw(x + (size / 2)*t, y, '0', size, mode & 0X01);
+                else LCD_Glyph_Draw(x + (size / 2)*t, y, ' ', size, mode & 0X01);
 
                 continue;
             }
@@ -2357,8 +2536,10 @@ void LCD_ShowxNum(u16 x, u16 y, u32 num, u8 len, u8 size, u8 mode)
 
         }
 
-        LCD_ShowChar(x + (size / 2)*t, y, temp + '0', size, mode & 0X01);
+        LCD_Glyph_Draw(x + (size / 2)*t, y, temp + '0', size, mode & 0X01);
     }
+
+    LCD_DMA_Wait();
 }
 
 //显示字符串
@@ -2382,10 +2563,110 @@ void LCD_ShowString(u16 x, u16 y, u16 width, u16 height, u8 size, u8 *p)
 
         if (y >= height)break; //退出
 
-        LCD_ShowChar(x, y, *p, size, 0);
+        LCD_Glyph_Draw(x, y, *p, size, 0);
         x += size / 2;
         p++;
     }
+
+    LCD_DMA_Wait();
+}
+
+static void LCD_DMA_Start(void)
+{
+    u16 num = min_t(u32, lcd_dma.left, LCD_DMA_CHUNK);
+
+    DMA_Cmd(LCD_DMA_CH, DISABLE);
+    LCD_DMA_CH->CPAR = (uint32_t)lcd_dma.next;
+    DMA_SetCurrDataCounter(LCD_DMA_CH, num);
+    lcd_dma.next += num;
+    lcd_dma.left -= num;
+    DMA_Cmd(LCD_DMA_CH, ENABLE);
+}
+
+void LCD_DMA_Init(void)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    sem_init(&lcd_dma.sem, 0);
+    lcd_dma.pending = false;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    DMA_DeInit(LCD_DMA_CH);
+
+    /* the pixel address and count are set for every chunk */
+    DMA_InitStructure.DMA_PeripheralBaseAddr = 0;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)&LCD->LCD_RAM;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Disable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Enable;
+    DMA_Init(LCD_DMA_CH, &DMA_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = LCD_DMA_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(LCD_DMA_CH, DMA_IT_TC, ENABLE);
+}
+
+/* it sleeps until the block started last is in the lcd ram */
+void LCD_DMA_Wait(void)
+{
+    if (!lcd_dma.pending)
+        return;
+
+    sem_get(&lcd_dma.sem);
+    lcd_dma.pending = false;
+    /* the point functions only move the cursor, they need the whole screen as the window */
+    LCD_Set_Window(0, 0, lcddev.width, lcddev.height);
+}
+
+/**
+ * This function will send a block of pixels into a window by dma, it waits
+ * for the block before and returns once this one is started.
+ *
+ * @param sx the window left.
+ * @param sy the window top.
+ * @param width the window width, more than 0.
+ * @param height the window height, more than 0.
+ * @param color width * height RGB565 pixels, kept until the block is sent.
+ * @param done called in the dma irq once the block is sent, or NULL.
+ * @param arg the argument of done.
+ */
+void LCD_DMA_Write(u16 sx, u16 sy, u16 width, u16 height, const u16 *color,
+                   void (*done)(void *arg), void *arg)
+{
+    LCD_DMA_Wait();
+    LCD_Set_Window(sx, sy, width, height);
+    LCD_WriteRAM_Prepare();
+
+    lcd_dma.next = color;
+    lcd_dma.left = (u32)width * height;
+    lcd_dma.done = done;
+    lcd_dma.arg = arg;
+    lcd_dma.pending = true;
+    LCD_DMA_Start();
+}
+
+void DMA1_Channel6_IRQHandler(void)
+{
+    DMA_ClearITPendingBit(LCD_DMA_IT_TC);
+    if (lcd_dma.left > 0) {
+        LCD_DMA_Start();
+        return;
+    }
+
+    DMA_Cmd(LCD_DMA_CH, DISABLE);
+    if (lcd_dma.done != NULL)
+        lcd_dma.done(lcd_dma.arg);
+    sem_send_one(&lcd_dma.sem);
 }
 
 struct tft_lcd {
@@ -2394,11 +2675,46 @@ struct tft_lcd {
     _lcd_dev *lcd;
 
     bool enable;
+    bool inited;
 };
 
+/* RGB565 pixels from pixel pos on, a part row, whole rows and a part row */
 static ssize_t tft_lcd_buf_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
 {
     struct tft_lcd *lcd = dev->priv;
+    const u16 *data = buffer;
+    size_t num = size / sizeof(u16);
+    u16 width = lcd->lcd->width;
+    size_t len;
+    u16 x, y;
+
+    if (!lcd->inited || size % sizeof(u16) ||
+        pos + num > (size_t)width * lcd->lcd->height) {
+        pr_err("data size error, pos=%u, size=%u\r\n", (unsigned int)pos, (unsigned int)size);
+        return -EINVAL;
+    }
+
+    x = pos % width;
+    y = pos / width;
+
+    mutex_lock(&lcd->lock);
+    while (num > 0) {
+        if (x == 0 && num >= width) {
+            len = num - num % width;
+            LCD_DMA_Write(0, y, width, len / width, data, NULL, NULL);
+            y += len / width;
+        } else {
+            len = min_t(size_t, num, width - x);
+            LCD_DMA_Write(x, y, len, 1, data, NULL, NULL);
+            x = 0;
+            y++;
+        }
+        data += len;
+        num -= len;
+    }
+    /* the pixels stay with the caller */
+    LCD_DMA_Wait();
+    mutex_unlock(&lcd->lock);
 
     return size;
 }
@@ -2406,10 +2722,15 @@ static ssize_t tft_lcd_buf_write(struct device *dev, addr_t pos, const void *buf
 static int tft_lcd_control(struct device *dev, int cmd, void *args)
 {
     struct tft_lcd *lcd = dev->priv;
-    struct display_dev_info info = {.width = lcd->lcd->width, .height = lcd->lcd->height};
+    struct display_dev_info info;
 
     switch (cmd) {
     case DS_CTRL_ENABLE:
+        /* the panel is set up on the first enable, not at boot */
+        if (!lcd->inited) {
+            LCD_Init();
+            lcd->inited = true;
+        }
         lcd->enable = true;
         break;
     case DS_CTRL_DISABLE:
@@ -2418,6 +2739,9 @@ static int tft_lcd_control(struct device *dev, int cmd, void *args)
     case DS_CTRL_GET_ENABLE_STATUS:
         return lcd->enable;
     case DS_CTRL_GET_DEV_INFO:
+        info.width = lcd->lcd->width;
+        info.height = lcd->lcd->height;
+        info.flags = DISPLAY_DEV_RGB565;
         memcpy(args, &info, sizeof(struct display_dev_info));
         break;
     default:
@@ -2442,6 +2766,7 @@ static int zj_tft_lcd_init(void)
 
     mutex_init(&lcd->lock);
     lcd->enable = false;
+    lcd->inited = false;
 
     device_init(&lcd->dev);
     lcd->dev.name = "zj-tft_lcd";
@@ -22,7 +22,14 @@
 //修改NT5510 ID读取方式,改为先发送秘钥,然后读取C500和C501,从而获取正确的ID(0X5510)
 //////////////////////////////////////////////////////////////////////////////////
 
-  
+
+//字符缓存的字符数,LRU替换
+#ifdef CONFIG_LCD_GLYPH_CACHE
+#define LCD_GLYPH_CACHE CONFIG_LCD_GLYPH_CACHE
+#else
+#define LCD_GLYPH_CACHE 12
+#endif
+
 //LCD重要参数集
 typedef struct
 {
@@ -125,7 +132,13 @@ void LCD_WriteRAM(u16 RGB_Code);
 void LCD_SSD_BackLightSet(u8 pwm);                          //SSD1963 背光控制
 void LCD_Scan_Dir(u8 dir);                                  //设置屏扫描方向
 void LCD_Display_Dir(u8 dir);                               //设置屏幕显示方向
-void LCD_Set_Window(u16 sx, u16 sy, u16 width, u16 height); //设置窗口//LCD分辨率设置
+void LCD_Set_Window(u16 sx, u16 sy, u16 width, u16 height); //设置窗口
+void LCD_DMA_Init(void);
+void LCD_DMA_Write(u16 sx, u16 sy, u16 width, u16 height, const u16 *color,
+                   void (*done)(void *arg), void *arg);     //dma写入窗口,完成时在中断里调用done
+void LCD_DMA_Wait(void);                                    //等待dma写完
+void LCD_Glyph_Stats(u32 *hits, u32 *misses);               //字符缓存命中/未命中次数
+void LCD_Glyph_Flush(void);                                 //清空字符缓存
 
 //LCD分辨率设置
 #define SSD_HOR_RESOLUTION      800     //LCD水平分辨率
@@ -0,0 +1,149 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[DEBOUNCE]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <string.h>
+#include <key/debounce.h>
+
+/*
+ * All keys of a 32 bit word are handled at once. Every key has a lockout
+ * counter, the counters are stored bit-sliced so loading and counting them
+ * down is a few word operations per bit plane, and nothing when no key of
+ * the word is counting.
+ */
+
+/* load val into the counters of the keys in mask */
+static inline void debounce_cnt_load(struct debounce *db, int w, uint32_t mask, uint8_t val)
+{
+    int n;
+
+    if (mask == 0)
+        return;
+
+    for (n = 0; n < DEBOUNCE_CNT_BITS; n++) {
+        if (val & (1 << n))
+            db->cnt[n][w] |= mask;
+        else
+            db->cnt[n][w] &= ~mask;
+    }
+}
+
+/* count the running counters down by one, returns the keys that reached 0 */
+static inline uint32_t debounce_cnt_tick(struct debounce *db, int w, uint32_t *running)
+{
+    uint32_t active = 0, borrow, bit, left = 0;
+    int n;
+
+    for (n = 0; n < DEBOUNCE_CNT_BITS; n++)
+        active |= db->cnt[n][w];
+    if (active == 0) {
+        *running = 0;
+        return 0;
+    }
+
+    borrow = active;
+    for (n = 0; n < DEBOUNCE_CNT_BITS; n++) {
+        bit = db->cnt[n][w];
+        db->cnt[n][w] = bit ^ borrow;
+        borrow &= ~bit;
+        left |= db->cnt[n][w];
+    }
+    *running = left;
+
+    return active & ~left;
+}
+
+/**
+ * This function will initialize a debounce object, all keys start released.
+ *
+ * @param db the debounce object.
+ * @param type the debounce algorithm.
+ * @param keys the number of keys, at most DEBOUNCE_MAX_KEYS.
+ * @param lockout_ms the lockout time, rounded up to whole scans.
+ * @param scan_hz the rate debounce_update() is called at.
+ *
+ * @return 0 on successful, -EINVAL on invalid parameters.
+ */
+int debounce_init(struct debounce *db, enum debounce_type type, int keys,
+                  uint32_t lockout_ms, uint32_t scan_hz)
+{
+    uint32_t lockout;
+
+    if (keys <= 0 || keys > DEBOUNCE_MAX_KEYS || scan_hz == 0 || type > DEBOUNCE_ASYM) {
+        pr_err("invalid param, keys=%d, scan_hz=%u\r\n", keys, scan_hz);
+        return -EINVAL;
+    }
+
+    memset(db, 0, sizeof(*db));
+    db->type = type;
+    db->words = (keys + 31) / 32;
+    lockout = (lockout_ms * scan_hz + 999) / 1000;
+    db->lockout = lockout > DEBOUNCE_CNT_MAX ? DEBOUNCE_CNT_MAX : lockout;
+
+    return 0;
+}
+
+/**
+ * This function will feed one scan of raw key bits to the debouncer.
+ *
+ * @param db the debounce object.
+ * @param raw the raw key bits of this scan, a set bit is a pressed key.
+ * @param state output of the debounced key bits.
+ *
+ * @return true if the debounced state changed.
+ */
+bool debounce_update(struct debounce *db, const uint32_t *raw, uint32_t *state)
+{
+    uint32_t r, s, diff, expired, running, edge;
+    bool changed = false;
+    int w;
+
+    for (w = 0; w < db->words; w++) {
+        r = raw[w];
+        s = db->state[w];
+        diff = r ^ db->last[w];
+        db->last[w] = r;
+        expired = debounce_cnt_tick(db, w, &running);
+
+        if (db->lockout == 0) {
+            s = r;
+        } else {
+            switch (db->type) {
+            case DEBOUNCE_SYM_DEFER:
+                /* an edge restarts the counter, the key settles when it expires */
+                debounce_cnt_load(db, w, diff, db->lockout);
+                expired &= ~diff;
+                s ^= expired & (r ^ s);
+                break;
+            case DEBOUNCE_EAGER:
+                edge = (r ^ s) & ~running;
+                s ^= edge;
+                debounce_cnt_load(db, w, edge, db->lockout);
+                break;
+            case DEBOUNCE_ASYM:
+                /* a release edge of a pressed key restarts its counter */
+                debounce_cnt_load(db, w, diff & ~r & s, db->lockout);
+                expired &= ~diff;
+                s = (s | r) & ~(expired & ~r);
+                break;
+            }
+        }
+
+        if (s != db->state[w]) {
+            db->state[w] = s;
+            changed = true;
+        }
+        state[w] = s;
+    }
+
+    return changed;
+}
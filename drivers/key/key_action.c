@@ -1,52 +1,383 @@
-#include <wk/task.h>
-#include <wk/err.h>
-#include <wk/delay.h>
-#include <init/init.h>
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[KEY_ACTION]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/sem.h>
+#include <kernel/timer.h>
+#include <kernel/spinlock.h>
+#include <kernel/clk.h>
+#include <kernel/cpu.h>
 #include <string.h>
-#include <cmd/cmd.h>
+#include <key/key_action.h>
 #include "keyboard.h"
 
+/*
+ * The keyboard task only posts the events of keys that have an action, the
+ * action task runs them and keeps a set of keys of its own that the keyboard
+ * task ors into every report. Nothing here sleeps: the hold time and every
+ * macro step is a deadline, the earliest one is armed on a one-shot timer
+ * and the timer only wakes the task.
+ */
+
+#define KEY_ACTION_TASK_PRIO  4
+#define KEY_ACTION_TASK_STACK 1024
+
 struct key_action_info {
     uint8_t type;
-    void (*action)(void);
+    /* run on the press, or on a release before the hold time if hold is set */
+    void (*tap)(const struct key_event *ev);
+    /* run when the key is held past the hold time and on its release */
+    void (*hold)(const struct key_event *ev, bool down);
+};
+
+struct key_macro {
+    const struct key_macro_step *steps;
+    int num;
+};
+
+struct key_action_engine {
+    struct task_struct *task;
+    sem_t sem;
+    struct timer timer;
+    struct key_event_queue queue;
+    bool ready;
+
+    /* the tap-hold key waiting for its release or the hold time */
+    struct key_event pending;
+    const struct key_action_info *pending_info;
+    uint32_t hold_deadline;
+    bool holding;
+
+    struct key_macro macro[KEY_MACRO_QUEUE];
+    uint8_t macro_head;
+    uint8_t macro_num;
+    int step;
+    uint32_t step_deadline;
+
+    /* keys sent by the actions, read by the keyboard task */
+    spinlock_t lock;
+    uint32_t keys[HID_NKRO_BITMAP_WORDS];
+    uint8_t mods;
+    u32 seq;
 };
 
-void key_action_led(void)
+static struct key_action_engine g_key_action;
+
+/* times are the low 32 bits of cpu_run_time_us(), compared across the wrap */
+static inline int32_t key_action_left(uint32_t deadline, uint32_t now)
+{
+    return (int32_t)(deadline - now);
+}
+
+static void key_action_out(struct key_action_engine *ka, uint8_t code, bool down)
+{
+    uint32_t keys[HID_NKRO_BITMAP_WORDS] = { 0 };
+    uint8_t mods = 0;
+    int i;
+
+    key_nkro_report_add(keys, &mods, code);
+    spin_lock_irq(&ka->lock);
+    for (i = 0; i < HID_NKRO_BITMAP_WORDS; i++) {
+        if (down)
+            ka->keys[i] |= keys[i];
+        else
+            ka->keys[i] &= ~keys[i];
+    }
+    if (down)
+        ka->mods |= mods;
+    else
+        ka->mods &= ~mods;
+    ka->seq++;
+    spin_unlock_irq(&ka->lock);
+}
+
+static void key_action_led(const struct key_event *ev)
 {
     static bool led_is_on = true;
-    uint8_t argc = 1;
-    char *argv[1];
 
     led_is_on = !led_is_on;
-    argv[0] = led_is_on ? "on" : "off";
+    pr_info("led %s\r\n", led_is_on ? "on" : "off");
+}
+
+/* caps lock on a tap, left ctrl while held */
+static void key_action_caps_tap(const struct key_event *ev)
+{
+    static const struct key_macro_step caps_tap[] = {
+        KEY_MACRO_TAP(KC_CAPSLOCK, KEY_MACRO_MIN_MS),
+    };
 
-    //pr_info("led %s\r\n", argv[0]);
-    cmd_run("led", argc, argv);
+    key_action_macro_play(caps_tap, sizeof(caps_tap) / sizeof(caps_tap[0]));
 }
 
-void key_action_caps(void)
+static void key_action_caps_hold(const struct key_event *ev, bool down)
 {
+    key_action_out(&g_key_action, KC_LCTRL, down);
 }
 
-void key_action_macro(void)
+static void key_action_macro(const struct key_event *ev)
 {
+    static const struct key_macro_step nos[] = {
+        KEY_MACRO_TAP(KC_N, KEY_MACRO_MIN_MS),
+        KEY_MACRO_TAP(KC_O, KEY_MACRO_MIN_MS),
+        KEY_MACRO_TAP(KC_S, KEY_MACRO_MIN_MS),
+    };
+
+    key_action_macro_play(nos, sizeof(nos) / sizeof(nos[0]));
 }
 
-static struct key_action_info key_action[] = {
-    { KA_LED, key_action_led },
-    { KA_CAPS, key_action_caps },
-    { KA_MACRO, key_action_macro},
+static const struct key_action_info key_action[] = {
+    { KA_LED, key_action_led, NULL },
+    { KA_CAPS, key_action_caps_tap, key_action_caps_hold },
+    { KA_MACRO, key_action_macro, NULL },
     {},
 };
 
-int key_action_run(enum key_action action)
+static const struct key_action_info *key_action_find(uint8_t type)
+{
+    const struct key_action_info *info = key_action;
+
+    for (; info->type != KA_NO; info++) {
+        if (info->type == type)
+            return info;
+    }
+
+    return NULL;
+}
+
+static void key_action_timeout(void *parameter)
+{
+    struct key_action_engine *ka = (struct key_action_engine *)parameter;
+
+    sem_send_one(&ka->sem);
+}
+
+static void key_action_event(struct key_action_engine *ka, const struct key_event *ev)
 {
-    struct key_action_info *info = key_action;
+    const struct key_action_info *info = key_action_find(ev->action);
+
+    if (info == NULL)
+        return;
+
+    if (info->hold == NULL) {
+        if (ev->down && info->tap != NULL)
+            info->tap(ev);
+        return;
+    }
+
+    if (ev->down) {
+        /* one tap-hold key at a time, a second one ends the first as a hold */
+        if (ka->pending_info != NULL && !ka->holding) {
+            ka->holding = true;
+            ka->pending_info->hold(&ka->pending, true);
+        }
+        ka->pending = *ev;
+        ka->pending_info = info;
+        ka->hold_deadline = ev->time_us + KEY_ACTION_HOLD_MS * 1000;
+        ka->holding = false;
+        return;
+    }
+
+    if (ka->pending_info == NULL || ka->pending.key != ev->key)
+        return;
+    /*
+     * Judged by the scan times, a late wakeup does not turn a tap into a
+     * hold. A hold released before the timer saw it did nothing to undo.
+     */
+    if (ka->holding)
+        info->hold(ev, false);
+    else if (key_action_left(ka->hold_deadline, ev->time_us) > 0)
+        info->tap(ev);
+    ka->pending_info = NULL;
+    ka->holding = false;
+}
+
+/* one step per wakeup, the next macro still waits for the last step of this one */
+static void key_action_macro_step(struct key_action_engine *ka, uint32_t now)
+{
+    const struct key_macro *macro;
+    const struct key_macro_step *step;
+
+    if (ka->macro_num == 0 || key_action_left(ka->step_deadline, now) > 0)
+        return;
+
+    macro = &ka->macro[ka->macro_head];
+    step = &macro->steps[ka->step];
+    key_action_out(ka, step->code, step->down);
+    ka->step_deadline = now + max_t(uint32_t, step->delay_ms, KEY_MACRO_MIN_MS) * 1000;
+    if (++ka->step < macro->num)
+        return;
+
+    ka->step = 0;
+    ka->macro_head = (ka->macro_head + 1) % KEY_MACRO_QUEUE;
+    ka->macro_num--;
+}
+
+static void key_action_arm(struct key_action_engine *ka, uint32_t now)
+{
+    int32_t left = S32_MAX;
+    uint32_t ms;
+
+    if (ka->pending_info != NULL && !ka->holding)
+        left = key_action_left(ka->hold_deadline, now);
+    if (ka->macro_num > 0)
+        left = min_t(int32_t, left, key_action_left(ka->step_deadline, now));
+    if (left == S32_MAX) {
+        timer_stop(&ka->timer);
+        return;
+    }
+
+    ms = left > 0 ? (left + 999) / 1000 : 0;
+    timer_start(&ka->timer, msec_to_tick(max_t(uint32_t, ms, CONFIG_SYS_TICK_MS)));
+}
+
+static void key_action_task_entry(void *parameter)
+{
+    struct key_action_engine *ka = (struct key_action_engine *)parameter;
+    struct key_event ev;
+    uint32_t now;
+
+    while (1) {
+        sem_get(&ka->sem);
+
+        while (key_event_pop(&ka->queue, &ev))
+            key_action_event(ka, &ev);
+
+        now = (uint32_t)cpu_run_time_us();
+        if (ka->pending_info != NULL && !ka->holding &&
+            key_action_left(ka->hold_deadline, now) <= 0) {
+            ka->holding = true;
+            ka->pending_info->hold(&ka->pending, true);
+        }
+        key_action_macro_step(ka, now);
+        key_action_arm(ka, now);
+    }
+}
+
+/**
+ * This function will queue a key event for the action task, it is called
+ * from the keyboard task only.
+ *
+ * @param ev the event, its action must not be KA_NO.
+ *
+ * @return false if the queue is full or the task is not running.
+ */
+bool key_action_post(const struct key_event *ev)
+{
+    struct key_action_engine *ka = &g_key_action;
+
+    if (!ka->ready)
+        return false;
+    if (!key_event_push(&ka->queue, ev)) {
+        pr_warning("key event queue full, dropped=%u\r\n", ka->queue.dropped);
+        return false;
+    }
+    sem_send_one(&ka->sem);
+
+    return true;
+}
+
+/**
+ * This function will play a macro after the ones already queued, it is
+ * called from an action.
+ *
+ * @param steps the steps, they must stay valid until played.
+ * @param num the step count.
+ *
+ * @return 0 on successful, -EBUSY if KEY_MACRO_QUEUE macros are waiting.
+ */
+int key_action_macro_play(const struct key_macro_step *steps, int num)
+{
+    struct key_action_engine *ka = &g_key_action;
+    struct key_macro *macro;
+    uint32_t now;
+    int32_t left;
+
+    if (num <= 0)
+        return -EINVAL;
+    if (ka->macro_num >= KEY_MACRO_QUEUE) {
+        pr_warning("macro queue full\r\n");
+        return -EBUSY;
+    }
+
+    macro = &ka->macro[(ka->macro_head + ka->macro_num) % KEY_MACRO_QUEUE];
+    macro->steps = steps;
+    macro->num = num;
+    if (ka->macro_num++ == 0) {
+        /* keep the gap after the last step of the previous macro, if any */
+        now = (uint32_t)cpu_run_time_us();
+        left = key_action_left(ka->step_deadline, now);
+        if (left <= 0 || left > U16_MAX * 1000)
+            ka->step_deadline = now;
+    }
+
+    return 0;
+}
+
+/* changes whenever the action keys change */
+u32 key_action_seq(void)
+{
+    return READ_ONCE(g_key_action.seq);
+}
+
+/**
+ * This function will or the keys held by the actions into a report.
+ *
+ * @param keys the nkro bitmap.
+ * @param mods the modifier byte.
+ *
+ * @return the seq of the keys that were added.
+ */
+u32 key_action_output(uint32_t *keys, uint8_t *mods)
+{
+    struct key_action_engine *ka = &g_key_action;
+    u32 seq;
+    int i;
+
+    spin_lock_irq(&ka->lock);
+    for (i = 0; i < HID_NKRO_BITMAP_WORDS; i++)
+        keys[i] |= ka->keys[i];
+    *mods |= ka->mods;
+    seq = ka->seq;
+    spin_unlock_irq(&ka->lock);
+
+    return seq;
+}
+
+/**
+ * This function will start the action task, every keyboard shares it.
+ *
+ * @return 0 on successful, < 0 on error.
+ */
+int key_action_init(void)
+{
+    struct key_action_engine *ka = &g_key_action;
+
+    if (ka->ready)
+        return 0;
+
+    key_event_queue_init(&ka->queue);
+    sem_init(&ka->sem, 0);
+    spin_lock_init(&ka->lock);
+    timer_init(&ka->timer, "key_action", key_action_timeout, ka);
 
-    for (; info->type != KA_NO && info->action != NULL; info++) {
-        if (info->type == action)
-            info->action();
+    ka->task = task_create("key_action", key_action_task_entry, ka,
+                           KEY_ACTION_TASK_PRIO, KEY_ACTION_TASK_STACK, 10, NULL);
+    if (ka->task == NULL) {
+        pr_fatal("creat key_action task err\r\n");
+        return -EINVAL;
     }
+    task_ready(ka->task);
+    ka->ready = true;
 
     return 0;
 }
@@ -0,0 +1,268 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[KEY_LAT]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/printk.h>
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
+#include <kernel/mm.h>
+#include <lib/vsprintf.h>
+#include <string.h>
+#include <key/latency.h>
+
+/*
+ * One sample is in flight at a time: it starts at the first raw matrix change
+ * seen while idle, every stage stamps the cycle counter, and it is committed
+ * at the usb in completion or, without usb, after the report stage.
+ */
+
+struct key_latency {
+    bool active;
+    uint8_t stamped;
+    u32 start;
+    u32 stamp[KEY_LAT_STAGE_NUM];
+    uint32_t raw[KEY_LAT_MAX_WORDS];
+
+    /* synthetic key, pressed and released every period */
+    int inject_key;
+    u64 inject_period_us;
+    u64 inject_next_us;
+    bool inject_down;
+
+    struct key_lat_report report;
+};
+
+static SPINLOCK(key_lat_lock);
+static struct key_latency key_lat = {
+    .inject_key = -1,
+};
+
+static const char * const key_lat_stage_name[KEY_LAT_STAGE_NUM] = {
+    "scan", "info", "report", "usb in",
+};
+
+static void key_lat_stat_add(struct key_lat_stat *stat, u32 cycles)
+{
+    uint32_t ns = cpu_cycles_to_ns(cycles);
+    uint32_t us = ns / 1000;
+    int bin = 0;
+
+    if (stat->count == 0 || ns < stat->min_ns)
+        stat->min_ns = ns;
+    if (ns > stat->max_ns)
+        stat->max_ns = ns;
+    stat->total_ns += ns;
+    stat->count++;
+
+    if (us != 0)
+        bin = min_t(int, 32 - __builtin_clz(us), KEY_LAT_HIST_BINS - 1);
+    stat->hist[bin]++;
+}
+
+/* must be called with key_lat_lock held */
+static void __key_latency_commit(void)
+{
+    u32 prev = key_lat.start;
+    int i;
+
+    for (i = 0; i < KEY_LAT_STAGE_NUM; i++) {
+        if (!(key_lat.stamped & (1 << i)))
+            continue;
+        key_lat_stat_add(&key_lat.report.stage[i], key_lat.stamp[i] - prev);
+        prev = key_lat.stamp[i];
+    }
+    key_lat_stat_add(&key_lat.report.total, prev - key_lat.start);
+    key_lat.report.samples++;
+    key_lat.active = false;
+}
+
+/* must be called with key_lat_lock held */
+static void __key_latency_inject(uint32_t *raw, int words)
+{
+    u64 now;
+
+    if (key_lat.inject_period_us == 0 || key_lat.inject_key / 32 >= words)
+        return;
+
+    now = cpu_run_time_us();
+    if (now >= key_lat.inject_next_us) {
+        key_lat.inject_down = !key_lat.inject_down;
+        key_lat.inject_next_us += key_lat.inject_period_us;
+        if (key_lat.inject_next_us <= now)
+            key_lat.inject_next_us = now + key_lat.inject_period_us;
+    }
+    if (key_lat.inject_down)
+        raw[key_lat.inject_key / 32] |= 1 << (key_lat.inject_key % 32);
+}
+
+/**
+ * This function will be called by the key task with every new matrix
+ * snapshot, it merges the synthetic key into it and starts a sample on a
+ * change.
+ *
+ * @param raw the raw key bits, the synthetic key is merged in place.
+ * @param words the word count of raw.
+ * @param cycles the cycle counter when the snapshot was sampled.
+ */
+void key_latency_scan(uint32_t *raw, int words, u32 cycles)
+{
+    bool changed;
+
+    words = min_t(int, words, KEY_LAT_MAX_WORDS);
+
+    spin_lock_irq(&key_lat_lock);
+    __key_latency_inject(raw, words);
+
+    if (key_lat.active &&
+        cpu_cycles_to_ns(cpu_cycles() - key_lat.start) > KEY_LAT_TIMEOUT_MS * 1000000) {
+        key_lat.report.lost++;
+        key_lat.active = false;
+    }
+
+    changed = memcmp(key_lat.raw, raw, words * sizeof(uint32_t)) != 0;
+    memcpy(key_lat.raw, raw, words * sizeof(uint32_t));
+    if (changed && !key_lat.active) {
+        key_lat.active = true;
+        key_lat.start = cycles;
+        key_lat.stamp[KEY_LAT_SCAN] = cpu_cycles();
+        key_lat.stamped = 1 << KEY_LAT_SCAN;
+    }
+    spin_unlock_irq(&key_lat_lock);
+}
+
+void key_latency_stamp(enum key_lat_stage stage)
+{
+    u32 now = cpu_cycles();
+
+    spin_lock_irq(&key_lat_lock);
+    if (key_lat.active) {
+        key_lat.stamp[stage] = now;
+        key_lat.stamped |= 1 << stage;
+    }
+    spin_unlock_irq(&key_lat_lock);
+}
+
+/* commit the sample at the last stamped stage, used when nothing goes to usb */
+void key_latency_finish(void)
+{
+    spin_lock_irq(&key_lat_lock);
+    if (key_lat.active)
+        __key_latency_commit();
+    spin_unlock_irq(&key_lat_lock);
+}
+
+/* drop the sample, the change never reaches the host */
+void key_latency_cancel(void)
+{
+    spin_lock_irq(&key_lat_lock);
+    key_lat.active = false;
+    spin_unlock_irq(&key_lat_lock);
+}
+
+/*
+ * The raw keys are back to the debounced state with no edge taken, a bounce
+ * or a change inside the eager lockout. A sample that has not reached the
+ * keymap is dropped, so it is not left to time out as lost and the next
+ * change can start one.
+ */
+void key_latency_settle(void)
+{
+    spin_lock_irq(&key_lat_lock);
+    if (key_lat.active && key_lat.stamped == (1 << KEY_LAT_SCAN))
+        key_lat.active = false;
+    spin_unlock_irq(&key_lat_lock);
+}
+
+/**
+ * This function is the hid in completion callback, the sample is committed
+ * when the last queued report, the one holding the change, has been sent.
+ *
+ * @param report_id the id of the report sent.
+ * @param last no newer report of that id is queued.
+ */
+void key_latency_in_done(__always_unused uint8_t report_id, bool last)
+{
+    u32 now = cpu_cycles();
+
+    spin_lock_irq(&key_lat_lock);
+    if (key_lat.active && last && (key_lat.stamped & (1 << KEY_LAT_REPORT))) {
+        key_lat.stamp[KEY_LAT_USB_IN] = now;
+        key_lat.stamped |= 1 << KEY_LAT_USB_IN;
+        __key_latency_commit();
+    }
+    spin_unlock_irq(&key_lat_lock);
+}
+
+/**
+ * This function will toggle a synthetic key every period, so the latency can
+ * be measured without pressing keys.
+ *
+ * @param key the key index.
+ * @param period_ms the toggle period, 0 stops the injection.
+ */
+void key_latency_inject(int key, uint32_t period_ms)
+{
+    spin_lock_irq(&key_lat_lock);
+    key_lat.inject_key = key;
+    key_lat.inject_period_us = (u64)period_ms * 1000;
+    key_lat.inject_next_us = cpu_run_time_us() + key_lat.inject_period_us;
+    key_lat.inject_down = false;
+    spin_unlock_irq(&key_lat_lock);
+}
+
+void key_latency_get(struct key_lat_report *report)
+{
+    spin_lock_irq(&key_lat_lock);
+    memcpy(report, &key_lat.report, sizeof(*report));
+    spin_unlock_irq(&key_lat_lock);
+}
+
+void key_latency_clear(void)
+{
+    spin_lock_irq(&key_lat_lock);
+    memset(&key_lat.report, 0, sizeof(key_lat.report));
+    spin_unlock_irq(&key_lat_lock);
+}
+
+static void key_lat_stat_dump(const char *name, const struct key_lat_stat *stat)
+{
+    char buf[KEY_LAT_HIST_BINS * 6 + 1];
+    int i, len = 0;
+
+    if (stat->count == 0) {
+        pr_info("%s: no sample\r\n", name);
+        return;
+    }
+
+    pr_info("%s: n=%u min=%uns avg=%uns max=%uns\r\n", name, stat->count,
+            stat->min_ns, (uint32_t)(stat->total_ns / stat->count), stat->max_ns);
+    for (i = 0; i < KEY_LAT_HIST_BINS && len < sizeof(buf); i++)
+        len += snprintf(buf + len, sizeof(buf) - len, " %u", stat->hist[i]);
+    pr_info("%s: log2 us hist:%s\r\n", name, buf);
+}
+
+void key_latency_dump(void)
+{
+    struct key_lat_report *report;
+    int i;
+
+    report = kmalloc(sizeof(*report), GFP_KERNEL);
+    if (report == NULL) {
+        pr_err("alloc report buf failed\r\n");
+        return;
+    }
+    key_latency_get(report);
+
+    pr_info("samples=%u, lost=%u\r\n", report->samples, report->lost);
+    for (i = 0; i < KEY_LAT_STAGE_NUM; i++)
+        key_lat_stat_dump(key_lat_stage_name[i], &report->stage[i]);
+    key_lat_stat_dump("total", &report->total);
+    kfree(report);
+}
@@ -1,6 +1,8 @@
 #ifndef __KEYBOARD_H__
 #define __KEYBOARD_H__
 
+#include <usb/usb_common.h>
+
 #define IS_FN(code) ((code) == KC_FN)
 #define IS_PN(code) ((code) == KC_PN)
 #define IS_MODIFIERS(code) ((code) >= KC_LCTRL && (code) <= KC_PN)
@@ -369,6 +371,13 @@ struct key_info {
     uint8_t action;
 };
 
-int key_action_run(enum key_action action);
+/* or a pressed key into an nkro report, fn and pn are not sent to the host */
+static inline void key_nkro_report_add(uint32_t *keys, uint8_t *mods, uint8_t code)
+{
+    if (code >= KC_LCTRL && code <= KC_RGUI)
+        *mods |= (uint8_t)(1 << (code - KC_LCTRL));
+    else if (code != KC_NO && code <= HID_NKRO_USAGE_MAX)
+        keys[code >> 5] |= 1u << (code & 31);
+}
 
 #endif /* __KEYBOARD_H__ */
\ No newline at end of file
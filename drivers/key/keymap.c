@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[KEYMAP]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/cpu.h>
+#include <string.h>
+#include <key/keymap.h>
+#include "keyboard.h"
+
+/*
+ * Only the keys whose raw bit changed since the last update are looked at.
+ * The keys that switch layers are kept in per layer bitmaps, so a change
+ * of layer is found by one AND of the changed bits, and whether a layer is
+ * still held by one AND against the raw bits.
+ */
+
+static void keymap_stack_remove(struct keymap *km, uint8_t layer)
+{
+    int i;
+
+    for (i = 0; i < km->depth; i++) {
+        if (km->stack[i] != layer)
+            continue;
+        memmove(&km->stack[i], &km->stack[i + 1], km->depth - i - 1);
+        km->depth--;
+        return;
+    }
+}
+
+static void keymap_stack_push(struct keymap *km, uint8_t layer)
+{
+    keymap_stack_remove(km, layer);
+    km->stack[km->depth++] = layer;
+}
+
+static bool keymap_stack_has(const struct keymap *km, uint8_t layer)
+{
+    int i;
+
+    for (i = 0; i < km->depth; i++) {
+        if (km->stack[i] == layer)
+            return true;
+    }
+
+    return false;
+}
+
+static bool keymap_layer_held(const struct keymap *km, const uint32_t *raw, int layer)
+{
+    int w;
+
+    for (w = 0; w < km->words; w++) {
+        if (raw[w] & km->momentary[layer][w])
+            return true;
+    }
+
+    return false;
+}
+
+static void keymap_layer_key_change(struct keymap *km, const uint32_t *raw,
+                                    int w, uint32_t bit, bool down)
+{
+    int layer;
+
+    for (layer = 1; layer < km->layers; layer++) {
+        if (km->momentary[layer][w] & bit) {
+            if (down)
+                keymap_stack_push(km, layer);
+            else if (!keymap_layer_held(km, raw, layer))
+                keymap_stack_remove(km, layer);
+        }
+        if ((km->toggle[layer][w] & bit) && down) {
+            if (keymap_stack_has(km, layer))
+                keymap_stack_remove(km, layer);
+            else
+                keymap_stack_push(km, layer);
+        }
+    }
+}
+
+/**
+ * This function will init a keymap, KC_FN and KC_PN on layer 0 hold layer 1
+ * and layer 2.
+ *
+ * @param km the keymap object.
+ * @param code the [layers][keys] key code table.
+ * @param action the [layers][keys] action table.
+ * @param layers the layer count.
+ * @param keys the key count.
+ *
+ * @return 0 on successful, -EINVAL on too many keys or layers.
+ */
+int keymap_init(struct keymap *km, const uint8_t *code, const uint8_t *action,
+                int layers, int keys)
+{
+    int i;
+
+    if (layers < 1 || layers > KEYMAP_MAX_LAYERS || keys < 1 || keys > KEYMAP_MAX_KEYS) {
+        pr_err("unsupported keymap, layers=%d, keys=%d\r\n", layers, keys);
+        return -EINVAL;
+    }
+
+    memset(km, 0, sizeof(*km));
+    km->code = code;
+    km->action = action;
+    km->layers = layers;
+    km->keys = keys;
+    km->words = (keys + 31) / 32;
+
+    for (i = 0; i < keys; i++) {
+        if (IS_FN(code[i]) && layers > 1)
+            keymap_set_layer_key(km, i, 1, KEYMAP_LAYER_MOMENTARY);
+        else if (IS_PN(code[i]) && layers > 2)
+            keymap_set_layer_key(km, i, 2, KEYMAP_LAYER_MOMENTARY);
+    }
+
+    return 0;
+}
+
+/**
+ * This function will make a key switch a layer, the key is not looked up in
+ * the code table of any other layer after that.
+ *
+ * @param km the keymap object.
+ * @param key the key index.
+ * @param layer the layer it switches, 1 to layers - 1.
+ * @param mode momentary or toggle.
+ *
+ * @return 0 on successful, -EINVAL on a bad key or layer.
+ */
+int keymap_set_layer_key(struct keymap *km, int key, int layer,
+                         enum keymap_layer_mode mode)
+{
+    uint32_t bit = 1u << (key % 32);
+    int w = key / 32;
+
+    if (key < 0 || key >= km->keys || layer < 1 || layer >= km->layers)
+        return -EINVAL;
+
+    km->layer_keys[w] |= bit;
+    if (mode == KEYMAP_LAYER_TOGGLE)
+        km->toggle[layer][w] |= bit;
+    else
+        km->momentary[layer][w] |= bit;
+
+    return 0;
+}
+
+static void keymap_event_set(struct keymap_event *event, int key,
+                             uint8_t code, uint8_t action, bool down)
+{
+    event->key = key;
+    event->code = code;
+    event->action = action;
+    event->down = down;
+}
+
+/**
+ * This function will resolve the keys changed since the last update. Layer
+ * keys are handled first, so a key pressed in the same scan as a layer key
+ * lands on the new layer.
+ *
+ * @param km the keymap object.
+ * @param raw the debounced key bits.
+ * @param event the event buffer, a release carries the code of the press.
+ * @param max the size of event, it must hold one event per key.
+ *
+ * @return the event count, -EINVAL if event is too small.
+ */
+int keymap_update(struct keymap *km, const uint32_t *raw,
+                  struct keymap_event *event, int max)
+{
+    uint32_t bits, bit;
+    int w, key, layer;
+    int n = 0;
+    bool down;
+
+    if (max < km->keys)
+        return -EINVAL;
+
+    for (w = 0; w < km->words; w++) {
+        bits = (raw[w] ^ km->prev[w]) & km->layer_keys[w];
+        while (bits) {
+            key = w * 32 + __ffs(bits) - 1;
+            bit = bits & -bits;
+            bits &= ~bit;
+            down = !!(raw[w] & bit);
+
+            keymap_layer_key_change(km, raw, w, bit, down);
+            keymap_event_set(&event[n++], key, km->code[key], km->action[key], down);
+        }
+    }
+
+    layer = keymap_layer(km);
+    for (w = 0; w < km->words; w++) {
+        bits = (raw[w] ^ km->prev[w]) & ~km->layer_keys[w];
+        km->prev[w] = raw[w];
+        while (bits) {
+            key = w * 32 + __ffs(bits) - 1;
+            bit = bits & -bits;
+            bits &= ~bit;
+            if (key >= km->keys)
+                break;
+
+            if (raw[w] & bit) {
+                km->down_code[key] = km->code[layer * km->keys + key];
+                km->down_action[key] = km->action[layer * km->keys + key];
+                keymap_event_set(&event[n++], key, km->down_code[key],
+                                 km->down_action[key], true);
+            } else {
+                keymap_event_set(&event[n++], key, km->down_code[key],
+                                 km->down_action[key], false);
+                km->down_code[key] = KC_NO;
+                km->down_action[key] = KA_NO;
+            }
+        }
+    }
+
+    return n;
+}
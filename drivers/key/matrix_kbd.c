@@ -0,0 +1,236 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[MATRIX_KBD]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/printk.h>
+#include <kernel/sleep.h>
+#include <kernel/cpu.h>
+#include <string.h>
+#include <key/matrix_kbd.h>
+#include <key/latency.h>
+#include <key/key_action.h>
+#include <display/led_effect.h>
+#include "keyboard.h"
+
+/*
+ * The board only scans, the core runs the rest of the pipeline: position
+ * map, debounce, layers and the nkro report. Keys with an action are posted
+ * to the action task, which owns what they send, and every press to the
+ * led effects for the reactive lighting. The task sleeps in the
+ * board scan and does nothing past the debouncer unless a key or the keys
+ * of the action task changed.
+ */
+
+#define MATRIX_KBD_HID_RETRY 100
+
+/* scan bits to key bits, only redone when the scan bits change */
+static void matrix_kbd_map(struct matrix_kbd *kbd, const uint32_t *bits)
+{
+    uint32_t set;
+    int w, pos, key;
+
+    if (kbd->position == NULL) {
+        memcpy(kbd->raw, bits, kbd->keymap.words * sizeof(uint32_t));
+        return;
+    }
+    if (memcmp(kbd->bits, bits, sizeof(kbd->bits)) == 0)
+        return;
+
+    memcpy(kbd->bits, bits, sizeof(kbd->bits));
+    memset(kbd->raw, 0, sizeof(kbd->raw));
+    for (w = 0; w < MATRIX_KBD_POS_WORDS; w++) {
+        set = bits[w];
+        while (set) {
+            pos = w * 32 + __ffs(set) - 1;
+            set &= set - 1;
+            if (pos >= kbd->positions)
+                break;
+            key = kbd->position[pos];
+            if (key >= 0)
+                kbd->raw[key / 32] |= 1u << (key % 32);
+        }
+    }
+}
+
+static void matrix_kbd_report(struct matrix_kbd *kbd, struct hid_nkro_report *report)
+{
+    uint32_t keys[HID_NKRO_BITMAP_WORDS] = { 0 };
+    uint8_t mods = 0;
+    uint32_t set;
+    int w, key;
+
+    for (w = 0; w < kbd->keymap.words; w++) {
+        set = kbd->state[w];
+        while (set) {
+            key = w * 32 + __ffs(set) - 1;
+            set &= set - 1;
+            if (kbd->keymap.down_action[key] == KA_NO)
+                key_nkro_report_add(keys, &mods, kbd->keymap.down_code[key]);
+        }
+    }
+    kbd->action_seq = key_action_output(keys, &mods);
+    report->mods = mods;
+    memcpy(report->bitmap, keys, sizeof(keys));
+}
+
+/*
+ * Never waits, an event that does not fit in the queue is dropped. The
+ * events are stamped with the time of the scan, cycles, not of the dispatch.
+ */
+static void matrix_kbd_dispatch(struct matrix_kbd *kbd, int n, u32 cycles)
+{
+    struct key_event ev;
+    int i;
+
+    ev.time_us = (uint32_t)(cpu_run_time_us() - cpu_cycles_to_ns(cpu_cycles() - cycles) / 1000);
+    for (i = 0; i < n; i++) {
+        ev.key = kbd->event[i].key;
+        ev.code = kbd->event[i].code;
+        ev.action = kbd->event[i].action;
+        ev.down = kbd->event[i].down;
+        led_effect_post(&ev);
+        if (ev.action == KA_NO)
+            continue;
+        key_action_post(&ev);
+    }
+}
+
+static int matrix_kbd_hid_find(struct matrix_kbd *kbd)
+{
+    int i;
+
+    for (i = 0; i < MATRIX_KBD_HID_RETRY; i++) {
+        kbd->hid_dev = device_find_by_name("hidd");
+        if (kbd->hid_dev != NULL)
+            break;
+        pr_err("%s: %s device not found, retry=%d\r\n", kbd->name, "hidd", i + 1);
+        sleep(1);
+    }
+    if (kbd->hid_dev == NULL)
+        return -ENODEV;
+
+    pr_info("%s: %s device found\r\n", kbd->name, "hidd");
+#ifdef CONFIG_KEY_LATENCY
+    kbd->hid_dev->ops.control(kbd->hid_dev, HID_CTRL_SET_IN_DONE, key_latency_in_done);
+#endif
+
+    return 0;
+}
+
+static ssize_t matrix_kbd_hid_write(struct matrix_kbd *kbd, const struct hid_nkro_report *report)
+{
+    ssize_t rc;
+
+    /* the hid driver queues the report and coalesces it with a pending one */
+    rc = kbd->hid_dev->ops.write(kbd->hid_dev, HID_REPORT_ID_NKRO, report, sizeof(*report));
+    if (rc < 0)
+        pr_err("%s: hid report write err, rc=%d\r\n", kbd->name, (int)rc);
+
+    return rc;
+}
+
+static void matrix_kbd_task_entry(void *parameter)
+{
+    struct matrix_kbd *kbd = (struct matrix_kbd *)parameter;
+    struct hid_nkro_report report;
+    uint32_t bits[MATRIX_KBD_POS_WORDS];
+    uint32_t raw[KEYMAP_MAX_WORDS];
+    u32 cycles;
+    bool changed;
+    int n;
+
+    if (matrix_kbd_hid_find(kbd) < 0) {
+        pr_err("%s: %s device not found, exit\r\n", kbd->name, "hidd");
+        return;
+    }
+
+    while (1) {
+        memset(bits, 0, sizeof(bits));
+        cycles = kbd->ops->scan(kbd, bits);
+        matrix_kbd_map(kbd, bits);
+
+        /* the latency module may merge a synthetic key into the copy */
+        memcpy(raw, kbd->raw, sizeof(raw));
+        key_latency_scan(raw, kbd->keymap.words, cycles);
+        changed = debounce_update(&kbd->db, raw, kbd->state);
+        /* a deferred change still pending keeps its sample */
+        if (!changed && memcmp(raw, kbd->state, kbd->keymap.words * sizeof(uint32_t)) == 0)
+            key_latency_settle();
+        if (!changed && key_action_seq() == kbd->action_seq)
+            continue;
+
+        if (changed) {
+            n = keymap_update(&kbd->keymap, kbd->state, kbd->event, KEYMAP_MAX_KEYS);
+            key_latency_stamp(KEY_LAT_INFO);
+            matrix_kbd_dispatch(kbd, n, cycles);
+        }
+
+        matrix_kbd_report(kbd, &report);
+        if (memcmp(&report, &kbd->report, sizeof(report)) != 0) {
+            memcpy(&kbd->report, &report, sizeof(report));
+            /* stamp first, the in completion may come before the write returns */
+            key_latency_stamp(KEY_LAT_REPORT);
+            if (matrix_kbd_hid_write(kbd, &report) <= 0)
+                key_latency_finish();
+        } else {
+            key_latency_cancel();
+        }
+    }
+}
+
+/**
+ * This function will init the board scan and start the keyboard task.
+ *
+ * @param kbd the keyboard, it must stay valid.
+ *
+ * @return 0 on successful, < 0 on error.
+ */
+int matrix_kbd_register(struct matrix_kbd *kbd)
+{
+    int rc;
+
+    if (kbd->keys > DEBOUNCE_MAX_KEYS || kbd->positions > MATRIX_KBD_MAX_POS) {
+        pr_err("%s: too many keys, keys=%d, positions=%d\r\n", kbd->name,
+               kbd->keys, kbd->positions);
+        return -EINVAL;
+    }
+
+    rc = keymap_init(&kbd->keymap, kbd->code, kbd->action, kbd->layers, kbd->keys);
+    if (rc < 0)
+        return rc;
+    rc = debounce_init(&kbd->db, DEBOUNCE_DEF_TYPE, kbd->keys, DEBOUNCE_DEF_MS, kbd->scan_hz);
+    if (rc < 0)
+        return rc;
+    memset(kbd->bits, 0, sizeof(kbd->bits));
+    memset(kbd->raw, 0, sizeof(kbd->raw));
+    memset(kbd->state, 0, sizeof(kbd->state));
+    memset(&kbd->report, 0, sizeof(kbd->report));
+    kbd->action_seq = 0;
+
+    rc = key_action_init();
+    if (rc < 0)
+        return rc;
+    rc = kbd->ops->init(kbd);
+    if (rc < 0) {
+        pr_err("%s: init err, rc=%d\r\n", kbd->name, rc);
+        return rc;
+    }
+
+    kbd->task = task_create(kbd->name, matrix_kbd_task_entry, kbd, kbd->prio,
+                            kbd->stack_size, 10, NULL);
+    if (kbd->task == NULL) {
+        pr_fatal("creat %s task err\r\n", kbd->name);
+        return -EINVAL;
+    }
+    task_ready(kbd->task);
+
+    return 0;
+}
@@ -10,36 +10,27 @@
 
 #include <kernel/task.h>
 #include <kernel/errno.h>
-#include <kernel/sleep.h>
 #include <kernel/cpu.h>
 #include <kernel/irq.h>
-#include <kernel/device.h>
 #include <kernel/init.h>
 #include <kernel/gpio.h>
+#include <kernel/sem.h>
+#include <kernel/spinlock.h>
 #include <string.h>
+#include <key/matrix_kbd.h>
 #include <board/board.h>
 #include "keyboard.h"
 
 #define HC595_EN   PBout(12)
 #define HC595_CLK  PBout(13)
 #define HC595_DATA PBout(15)
-#define KEY_DATA   PBin(14)
 
 #define KEY_NUM 61
-#define KEY_RAW_DATA_NUM ((KEY_NUM) / 32 + (((KEY_NUM) % 32) ? 1 : 0))
-#define KEY_RAW_DATA_GROUP(index) ((index) / 32)
-#define KEY_RAW_DATA_INDEX(index) ((index) % 32)
-
-#define KEY_UP   1
-#define KEY_DOWN 0
-
-#define DEF_LAYER 0
-#define FN_LAYER  1
-#define PN_LAYER  2
 
 #define HC595_BIT_NUM (8 * 9)
+#define KEY_SCAN_WORDS ((HC595_BIT_NUM + 31) / 32)
 
-static int def_key_code_layout[3][KEY_NUM] = {
+static const uint8_t def_key_code_layout[3][KEY_NUM] = {
     KEYMAP(
         ESC, 1,   2,   3,   4,   5,   6,   7,   8,   9,   0,   MINS,EQL, BSPC, \
         TAB, Q,   W,   E,   R,   T,   Y,   U,   I,   O,   P,   LBRC,RBRC,BSLS, \
@@ -60,7 +51,7 @@ static int def_key_code_layout[3][KEY_NUM] = {
         NO,  NO,  NO,            NO,                      NO,  NO,  NO,  NO   ),
 };
 
-static int def_action_layout[3][KEY_NUM] = {
+static const uint8_t def_action_layout[3][KEY_NUM] = {
     ACTION_MAP(
         NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,   \
         NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,   \
@@ -81,12 +72,7 @@ static int def_action_layout[3][KEY_NUM] = {
         NO,  NO,  NO,            NO,                      NO,  NO,  NO,  NO    ),
 };
 
-static struct key_info def_key_info[KEY_NUM];
-
-static struct task_struct *key_task;
-static struct device *g_hid_dev;
-
-static int position_index[HC595_BIT_NUM] = {
+static const int8_t position_index[HC595_BIT_NUM] = {
      0,  1,  2,  3,  4,  5,  6,  7,
      8,  9, 10, 11, 12, 13, -1, -1,
     14, 15, 16, 17, 18, 19, 20, 21,
@@ -98,265 +84,248 @@ static int position_index[HC595_BIT_NUM] = {
     28, 29, 30, 31, 32, 33, 34, 35
 };
 
-static void hc595_load(void)
-{
-    HC595_EN = 1;
-	usleep(1);
-    HC595_EN = 0;
-	usleep(10);
-}
+/*
+ * One scan walks a single low bit through the 74HC595 chain, each output
+ * selects one key onto KEY_DATA. A scan step is KEY_SCAN_PHASES periods of
+ * TIM1: the update event writes the next GPIOB BSRR word by DMA and CC1, at
+ * the end of the same period, samples GPIOB IDR by DMA. TIM11 starts a scan
+ * KEY_SCAN_HZ times per second, the CPU only decodes the samples when the
+ * scan completes.
+ */
+#ifdef CONFIG_NK60_V2_KEY_SCAN_HZ
+#define KEY_SCAN_HZ CONFIG_NK60_V2_KEY_SCAN_HZ
+#else
+#define KEY_SCAN_HZ 1000
+#endif
+
+/*
+ * A phase is 1.25 us. The 595 outputs switch at the start of the third
+ * phase of a step and KEY_DATA is sampled at the end of the last one, so a
+ * pull-up column gets 8 phases, the 10 us the bit-banged scan waited, to
+ * settle. 72 steps * 10 phases take 900 us, which only fits the 1 kHz period.
+ */
+#define KEY_SCAN_PHASE_HZ      800000
+#define KEY_SCAN_SETTLE_PHASES 8
+#define KEY_SCAN_PHASES        (2 + KEY_SCAN_SETTLE_PHASES)
+#define KEY_SCAN_LEN           (HC595_BIT_NUM * KEY_SCAN_PHASES)
+
+#if KEY_SCAN_HZ < 1000 || KEY_SCAN_LEN * KEY_SCAN_HZ > KEY_SCAN_PHASE_HZ
+#error "nk60 key scan rate must be 1000 Hz, a faster scan cuts the settle time"
+#endif
+
+#define HC595_EN_PIN   GPIO_Pin_12
+#define HC595_CLK_PIN  GPIO_Pin_13
+#define HC595_DATA_PIN GPIO_Pin_15
+/* KEY_DATA(PB14) is sampled from the high byte of GPIOB IDR */
+#define KEY_DATA_MASK  (GPIO_Pin_14 >> 8)
+
+#define BSRR_SET(pin)   ((uint32_t)(pin))
+#define BSRR_RESET(pin) ((uint32_t)(pin) << 16)
+
+struct nk60_v2_key_scan {
+    spinlock_t lock;
+    sem_t sem;
+    uint32_t bits[KEY_SCAN_WORDS];
+    u32 cycles;
+    bool waiting;
+    bool busy;
+};
+
+static struct nk60_v2_key_scan key_scan;
+static uint32_t key_scan_wave[KEY_SCAN_LEN];
+static uint8_t key_scan_sample[KEY_SCAN_LEN];
 
-static void hc595_send(uint8_t data)
+static void nk60_v2_key_scan_wave_init(void)
 {
-    uint8_t i;
+    uint32_t *wave = key_scan_wave;
+    int i, j;
 
-    for (i = 8; i > 0; i--) {
-        if(data & 0x1)
-            HC595_DATA = 1;
+    for (i = 0; i < HC595_BIT_NUM; i++) {
+        /* the first step shifts in the low bit, the others push it along */
+        if (i == 0)
+            *wave++ = BSRR_RESET(HC595_DATA_PIN) | BSRR_RESET(HC595_CLK_PIN);
         else
-            HC595_DATA = 0;
-        usleep(1);
-        HC595_CLK = 1;
-        usleep(1);
-        data >>= 1;
-        HC595_CLK = 0;
+            *wave++ = BSRR_SET(HC595_DATA_PIN) | BSRR_RESET(HC595_CLK_PIN);
+        *wave++ = BSRR_SET(HC595_CLK_PIN);
+        *wave++ = BSRR_RESET(HC595_CLK_PIN) | BSRR_SET(HC595_EN_PIN);
+        *wave++ = BSRR_RESET(HC595_EN_PIN);
+        /* let KEY_DATA settle, the last phase of the step is sampled */
+        for (j = 4; j < KEY_SCAN_PHASES; j++)
+            *wave++ = 0;
     }
-    hc595_load();
 }
 
-static void hc595_send_bit(uint8_t data)
+static uint32_t nk60_v2_key_tim_clk(void)
 {
-    HC595_DATA = data;
-    usleep(1);
-    HC595_CLK = 1;
-    usleep(1);
-    HC595_CLK = 0;
-    hc595_load();
-}
+    RCC_ClocksTypeDef clocks;
 
-static void nk60_v2_key_scan(uint32_t *raw_data)
-{
-    uint32_t raw_data_old[KEY_RAW_DATA_NUM] = { 0 };
-    int i;
-    int index;
+    RCC_GetClocksFreq(&clocks);
+    /* apb2 timers run at twice pclk2 when apb2 is divided */
+    if (clocks.PCLK2_Frequency != clocks.HCLK_Frequency)
+        return clocks.PCLK2_Frequency * 2;
 
-    memset(raw_data, 0, KEY_RAW_DATA_NUM * sizeof(uint32_t));
-
-    for (i = 0; i < HC595_BIT_NUM; i++) {
-        hc595_send_bit(i != 0);
-        index = position_index[i];
-        if (index < 0)
-            continue;
-        if (KEY_DATA == KEY_DOWN)
-            raw_data_old[KEY_RAW_DATA_GROUP(index)] |= 1 << KEY_RAW_DATA_INDEX(index);
-    }
-    msleep(10);
-    for (i = 0; i < HC595_BIT_NUM; i++) {
-        hc595_send_bit(i != 0);
-        index = position_index[i];
-        if (index < 0)
-            continue;
-        if (KEY_DATA == KEY_DOWN)
-            raw_data[KEY_RAW_DATA_GROUP(index)] |= 1 << KEY_RAW_DATA_INDEX(index);
-    }
-
-    for (index = 0; index < KEY_RAW_DATA_NUM; index++) {
-        raw_data[index] &= raw_data_old[index];
-        // pr_info("data[%d]=0x%x\r\n", index, raw_data[index]);
-    }
+    return clocks.PCLK2_Frequency;
 }
 
-static int nk60_v2_get_key_layer(uint32_t *raw_data, struct key_info *old_info, int *special_key_layout)
+static void nk60_v2_key_dma_init(void)
 {
-    int layer = DEF_LAYER;
-    int i;
-
-    for (i = 0; i < KEY_NUM; i++) {
-        if (IS_FN(special_key_layout[i]) && ((raw_data[KEY_RAW_DATA_GROUP(i)] >> KEY_RAW_DATA_INDEX(i)) & 0x01)) {
-            if (old_info[i].code == KC_FN)
-                return FN_LAYER;
-            layer = FN_LAYER;
-        }
-        if (IS_PN(special_key_layout[i]) && ((raw_data[KEY_RAW_DATA_GROUP(i)] >> KEY_RAW_DATA_INDEX(i)) & 0x01)) {
-            if (old_info[i].code == KC_PN)
-                return PN_LAYER;
-            if (layer == DEF_LAYER) /* FN和PN同时按下优先使用FN */
-                layer = PN_LAYER;
-        }
-    }
+    DMA_InitTypeDef init_type;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+    /* TIM1_UP: pattern -> GPIOB BSRR, only DMA2 reaches the AHB1 GPIO */
+    DMA_DeInit(DMA2_Stream5);
+    DMA_StructInit(&init_type);
+    init_type.DMA_Channel = DMA_Channel_6;
+    init_type.DMA_PeripheralBaseAddr = (uint32_t)&GPIOB->BSRRL;
+    init_type.DMA_Memory0BaseAddr = (uint32_t)key_scan_wave;
+    init_type.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+    init_type.DMA_BufferSize = KEY_SCAN_LEN;
+    init_type.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    init_type.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    init_type.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    init_type.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    init_type.DMA_Mode = DMA_Mode_Normal;
+    init_type.DMA_Priority = DMA_Priority_VeryHigh;
+    init_type.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(DMA2_Stream5, &init_type);
+
+    /* TIM1_CH1: GPIOB IDR[15:8] -> samples */
+    DMA_DeInit(DMA2_Stream1);
+    init_type.DMA_PeripheralBaseAddr = (uint32_t)&GPIOB->IDR + 1;
+    init_type.DMA_Memory0BaseAddr = (uint32_t)key_scan_sample;
+    init_type.DMA_DIR = DMA_DIR_PeripheralToMemory;
+    init_type.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    init_type.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_Init(DMA2_Stream1, &init_type);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA2_Stream1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(DMA2_Stream1, DMA_IT_TC, ENABLE);
+}
 
-    return layer;
+static void nk60_v2_key_tim_init(void)
+{
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+    uint32_t clk = nk60_v2_key_tim_clk();
+    uint16_t period = clk / KEY_SCAN_PHASE_HZ - 1;
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1 | RCC_APB2Periph_TIM11, ENABLE);
+
+    /* TIM1 paces the scan phases */
+    TIM_TimeBaseStructInit(&TIM_TimeBaseInitStructure);
+    TIM_TimeBaseInitStructure.TIM_Period = period;
+    TIM_TimeBaseInitStructure.TIM_Prescaler = 0;
+    TIM_TimeBaseInit(TIM1, &TIM_TimeBaseInitStructure);
+
+    TIM_OCStructInit(&TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OCInitStructure.TIM_Pulse = period;
+    TIM_OC1Init(TIM1, &TIM_OCInitStructure);
+    TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC1, ENABLE);
+
+    /* TIM11 starts a scan at KEY_SCAN_HZ */
+    TIM_TimeBaseInitStructure.TIM_Period = 1000000 / KEY_SCAN_HZ - 1;
+    TIM_TimeBaseInitStructure.TIM_Prescaler = clk / 1000000 - 1;
+    TIM_TimeBaseInit(TIM11, &TIM_TimeBaseInitStructure);
+    TIM_ITConfig(TIM11, TIM_IT_Update, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = TIM1_TRG_COM_TIM11_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
 }
 
-static void nk60_v2_key_info_update(uint32_t *raw_data, struct key_info *info)
+static void nk60_v2_key_scan_init(void)
 {
-    int i;
-    int layer;
-
-    layer = nk60_v2_get_key_layer(raw_data, info, def_key_code_layout[DEF_LAYER]);
-    for (i = 0; i < KEY_NUM; i++) {
-        if ((raw_data[KEY_RAW_DATA_GROUP(i)] >> KEY_RAW_DATA_INDEX(i)) & 0x01) {
-            if (info[i].val != KEY_DOWN) {
-                info[i].code = def_key_code_layout[layer][i];
-                info[i].val = KEY_DOWN;
-                info[i].action = def_action_layout[layer][i];
-                pr_info("key down: layer=%d, index=%d, code=0x%02x, action=%d\r\n", layer, i, info[i].code, info[i].action);
-                if (((layer == FN_LAYER) && (def_key_code_layout[DEF_LAYER][i] == KC_FN)) ||
-                    ((layer == PN_LAYER) && (def_key_code_layout[DEF_LAYER][i] == KC_PN))) {
-                    info[i].code = def_key_code_layout[DEF_LAYER][i];
-                    info[i].action = def_action_layout[DEF_LAYER][i];
-                }
-            }
-        } else {
-            info[i].code = KC_NO;
-            info[i].val = KEY_UP;
-            info[i].action = KA_NO;
-        }
-    }
+    spin_lock_init(&key_scan.lock);
+    sem_init(&key_scan.sem, 0);
+    nk60_v2_key_scan_wave_init();
+    nk60_v2_key_dma_init();
+    nk60_v2_key_tim_init();
+    TIM_Cmd(TIM11, ENABLE);
 }
 
-static void nk60_v2_hid_data_update(struct key_info *info, uint8_t *hid_data)
+/* wait for the next completed scan and copy its hc595 bits, returns its cycle stamp */
+static u32 nk60_v2_key_scan(__always_unused struct matrix_kbd *kbd, uint32_t *bits)
 {
-    int i, n, m;
-    uint8_t data_bck[6] = { 0 };
-    uint8_t data_new[6] = { 0 };
-    int bck_num, new_num;
-    bool old_data;
-
-    hid_data[0] = 0;
-    bck_num = 0;
-    new_num = 0;
-    for (i = 0; i < 64; i++) {
-        if (info[i].val != KEY_DOWN)
-            continue;
-        switch (info[i].code) {
-        case KC_LSHIFT:
-            hid_data[0] |= (uint8_t)(1 << 1);
-            break;
-        case KC_RSHIFT:
-            hid_data[0] |= (uint8_t)(1 << 5);
-            break;
-        case KC_LCTRL:
-            hid_data[0] |= (uint8_t)1;
-            break;
-        case KC_LGUI:
-            hid_data[0] |= (uint8_t)(1 << 3);
-            break;
-        case KC_RGUI:
-            hid_data[0] |= (uint8_t)(1 << 7);
-            break;
-        case KC_LALT:
-            hid_data[0] |= (uint8_t)(1 << 2);
-            break;
-        case KC_RALT:
-            hid_data[0] |= (uint8_t)(1 << 6);
-            break;
-        case KC_RCTRL:
-            hid_data[0] |= (uint8_t)(1 << 4);
-            break;
-        case KC_FN:
-        case KC_PN:
-        case KC_NO:
-            break;
-        default:
-            old_data = false;
-            for (n = 2; n < 8; n++) {
-                if (hid_data[n] == KC_NO)
-                    continue;
-                if (hid_data[n] == info[i].code) {
-                    old_data = true;
-                    for (m = 0; m < bck_num; m++) {
-                        if (data_bck[m] == info[i].code)
-                            break;
-                    }
-                    if (m == bck_num && bck_num < 6) {
-                        data_bck[bck_num] = info[i].code;
-                        bck_num++;
-                    }
-                    break;
-                }
-            }
-            if (old_data)
-                break;
-            for (m = 0; m < new_num; m++) {
-                if (data_new[m] == info[i].code)
-                    break;
-            }
-            if (m == new_num && new_num < 6) {
-                data_new[new_num] = info[i].code;
-                new_num++;
-            }
-            break;
-        }
-    }
+    u32 cycles;
+
+    spin_lock_irq(&key_scan.lock);
+    key_scan.waiting = true;
+    spin_unlock_irq(&key_scan.lock);
+
+    sem_get(&key_scan.sem);
+
+    spin_lock_irq(&key_scan.lock);
+    memcpy(bits, key_scan.bits, sizeof(key_scan.bits));
+    cycles = key_scan.cycles;
+    spin_unlock_irq(&key_scan.lock);
 
-    memset(&hid_data[2], 0, 6);
-    if (bck_num > 0)
-        memcpy(&hid_data[2], data_bck, bck_num > 6 ? 6 : bck_num);
-    if (new_num > 0 && bck_num < 6)
-        memcpy(&hid_data[2 + bck_num], data_new, 6 - bck_num);
+    return cycles;
 }
 
-static ssize_t nc60_v2_key_hid_write(const void *buffer, size_t size)
+void TIM1_TRG_COM_TIM11_IRQHandler(void)
 {
-    return g_hid_dev->ops.write(g_hid_dev, 1, buffer, size);
+    TIM_ClearITPendingBit(TIM11, TIM_IT_Update);
+
+    if (key_scan.busy)
+        return;
+    key_scan.busy = true;
+
+    DMA_ClearFlag(DMA2_Stream5, DMA_FLAG_TCIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TEIF5 |
+                  DMA_FLAG_DMEIF5 | DMA_FLAG_FEIF5);
+    DMA_ClearFlag(DMA2_Stream1, DMA_FLAG_TCIF1 | DMA_FLAG_HTIF1 | DMA_FLAG_TEIF1 |
+                  DMA_FLAG_DMEIF1 | DMA_FLAG_FEIF1);
+    DMA_SetCurrDataCounter(DMA2_Stream5, KEY_SCAN_LEN);
+    DMA_SetCurrDataCounter(DMA2_Stream1, KEY_SCAN_LEN);
+
+    /* drop the requests left over from the previous scan */
+    TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC1, DISABLE);
+    TIM_ClearFlag(TIM1, TIM_FLAG_Update | TIM_FLAG_CC1);
+    DMA_Cmd(DMA2_Stream5, ENABLE);
+    DMA_Cmd(DMA2_Stream1, ENABLE);
+    TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC1, ENABLE);
+
+    /* the update event writes the first phase, its sample follows at CC1 */
+    TIM_GenerateEvent(TIM1, TIM_EventSource_Update);
+    TIM_Cmd(TIM1, ENABLE);
 }
 
-static void nc60_v2_key_task_entry(void* parameter)
+void DMA2_Stream1_IRQHandler(void)
 {
-    uint8_t hid_data[8] = { 0 };
-    uint8_t hid_data_old[8] = { 0 };
-    uint32_t key_raw_data[KEY_RAW_DATA_NUM] = { 0 };
-    uint32_t key_raw_data_old[KEY_RAW_DATA_NUM] = { 0 };
-    bool update = false;
-    int i = 0;
-
-    memset(def_key_info, 0, sizeof(struct key_info) * KEY_NUM);
-
-    g_hid_dev = NULL;
-    for (i = 0; i < 100; i ++) {
-        g_hid_dev = device_find_by_name("hidd");
-        if (g_hid_dev == NULL) {
-            i++;
-            pr_err("%s device not found, retry=%d\r\n", "hidd", i);
-            sleep(1);
-            continue;
-        } else {
-            pr_info("%s device found\r\n", "hidd");
-            break;
-        }
-    }
-    if (i >= 100) {
-        pr_err("%s device not found, exit\r\n", "hidd");
-        return;
-    }
+    uint32_t bits[KEY_SCAN_WORDS] = { 0 };
+    const uint8_t *sample = &key_scan_sample[KEY_SCAN_PHASES - 1];
+    u32 cycles = cpu_cycles();
+    bool wake;
+    int i;
+
+    DMA_ClearITPendingBit(DMA2_Stream1, DMA_IT_TCIF1);
+    TIM_Cmd(TIM1, DISABLE);
 
-    while (1) {
-        nk60_v2_key_scan(key_raw_data);
-        for (i = 0; i < KEY_RAW_DATA_NUM; i++) {
-            if (key_raw_data[i] != key_raw_data_old[i]) {
-                key_raw_data_old[i] = key_raw_data[i];
-                update = true;
-            }
-        }
-        if (update) {
-            update = false;
-            nk60_v2_key_info_update(key_raw_data, def_key_info);
-            // key_action(def_key_info);
-            nk60_v2_hid_data_update(def_key_info, hid_data);
-            for (i = 0; i < 8; i++) {
-                if (hid_data[i] != hid_data_old[i]) {
-                    hid_data_old[i] = hid_data[i];
-                    update = true;
-                }
-            }
-            if (update) {
-                update = false;
-                nc60_v2_key_hid_write(hid_data, 8);
-            }
-        }
-        msleep(10);
+    /* the core maps the hc595 bits to keys, and only when they change */
+    for (i = 0; i < HC595_BIT_NUM; i++, sample += KEY_SCAN_PHASES) {
+        if (!(*sample & KEY_DATA_MASK))
+            bits[i / 32] |= 1u << (i % 32);
     }
+
+    spin_lock_irq(&key_scan.lock);
+    memcpy(key_scan.bits, bits, sizeof(bits));
+    key_scan.cycles = cycles;
+    wake = key_scan.waiting;
+    key_scan.waiting = false;
+    key_scan.busy = false;
+    spin_unlock_irq(&key_scan.lock);
+
+    if (wake)
+        sem_send_one(&key_scan.sem);
 }
 
 static int nk60_v2_key_gpio_init(void)
@@ -390,17 +359,43 @@ static int nk60_v2_key_gpio_init(void)
     return 0;
 }
 
-static int nk60_v2_key_init(void)
+static int nk60_v2_key_hw_init(__always_unused struct matrix_kbd *kbd)
 {
     nk60_v2_key_gpio_init();
+    nk60_v2_key_scan_init();
+
+    return 0;
+}
+
+static const struct matrix_kbd_ops nk60_v2_key_ops = {
+    .init = nk60_v2_key_hw_init,
+    .scan = nk60_v2_key_scan,
+};
+
+static struct matrix_kbd nk60_v2_kbd = {
+    .name = "nc60_v2-key",
+    .ops = &nk60_v2_key_ops,
+    .position = position_index,
+    .positions = HC595_BIT_NUM,
+    .keys = KEY_NUM,
+    .layers = sizeof(def_key_code_layout) / sizeof(def_key_code_layout[0]),
+    .code = &def_key_code_layout[0][0],
+    .action = &def_action_layout[0][0],
+    .scan_hz = KEY_SCAN_HZ,
+    .prio = 3,
+    .stack_size = 1024,
+};
+
+static int nk60_v2_key_init(void)
+{
+    int rc;
 
-    key_task = task_create("nc60_v2-key", nc60_v2_key_task_entry, NULL, 3, 1024, 10, NULL);
-    if (key_task == NULL) {
-        pr_fatal("creat nc60_v2-key task err\r\n");
+    rc = matrix_kbd_register(&nk60_v2_kbd);
+    if (rc < 0) {
+        pr_fatal("register nc60_v2-key err, rc=%d\r\n", rc);
         BUG_ON(true);
-        return -EINVAL;
+        return rc;
     }
-    task_ready(key_task);
 
     return 0;
 }
@@ -25,28 +25,62 @@
 
 #include <display/led.h>
 #include <display/display.h>
+#include <display/pixel_ops.h>
 
 #define LED_VCC_EN PBout(0)
 
 #define LED_DATA_0 0xc0
 #define LED_DATA_1 0xf0
 #define LED_COLOR_BIT_WIDTH 8
+#define LED_SYMBOL(bit) ((bit) ? LED_DATA_1 : LED_DATA_0)
+#define LED_NIBBLE(n) { LED_SYMBOL((n) & 8), LED_SYMBOL((n) & 4), LED_SYMBOL((n) & 2), LED_SYMBOL((n) & 1) }
+#define LED_NIBBLE_WIDTH (LED_COLOR_BIT_WIDTH / 2)
 
 #define LED_NUM 61
 #define LED_BUF_SZIE (LED_NUM * COLOR_MAX * LED_COLOR_BIT_WIDTH)
+/* zero bytes after a frame, the leds latch on a line kept low for 300us */
+#define LED_RESET_SIZE 200
+#define LED_FRAME_SIZE (LED_BUF_SZIE + LED_RESET_SIZE)
 
 #define LED_WIDTH 14
 #define LED_HEIGHT 5
 
-static uint8_t g_led_buf[LED_BUF_SZIE];
+/*
+ * A write encodes into the back frame while the dma sends the front one.
+ * A refresh marks the back frame ready, the dma irq swaps the two and
+ * starts the new front once the frame before is out. The back frame is
+ * brought up to date with the front one before the next write.
+ */
+static uint8_t g_led_buf[2][LED_FRAME_SIZE];
+/* the spi symbols of a color nibble, msb first, a byte is two of them */
+static const uint8_t g_led_symbol[16][LED_NIBBLE_WIDTH] = {
+    LED_NIBBLE(0), LED_NIBBLE(1), LED_NIBBLE(2), LED_NIBBLE(3),
+    LED_NIBBLE(4), LED_NIBBLE(5), LED_NIBBLE(6), LED_NIBBLE(7),
+    LED_NIBBLE(8), LED_NIBBLE(9), LED_NIBBLE(10), LED_NIBBLE(11),
+    LED_NIBBLE(12), LED_NIBBLE(13), LED_NIBBLE(14), LED_NIBBLE(15),
+};
 
 struct nk60_led {
     struct mutex lock;
     struct device dev;
     sem_t sem;
-    uint8_t *buf;
+    uint8_t *buf[2];
+    /* the frame the dma sends */
+    uint8_t front;
+    /* the colors written, they are encoded again when the brightness changes */
+    uint8_t color[LED_NUM][COLOR_MAX];
+    /* gamma and brightness of a color byte */
+    uint8_t level[256];
+    uint8_t brightness;
 
     bool enable;
+    /* the back frame is complete, cleared by the swap */
+    volatile bool ready;
+    volatile bool dma_busy;
+    /* the back frame is older than the front one after a swap */
+    volatile bool stale;
+    /* a swap was asked and its completion not taken from sem yet */
+    bool swap_pending;
 };
 struct nk60_led *g_led;
 
@@ -58,10 +92,19 @@ static unsigned int g_nk60_led_buf_index[LED_WIDTH * LED_HEIGHT] = {
     53, 54, 55, 56, 56, 56, 56, 56, 56, 56, 57, 58, 59, 60
 };
 
-static void nk60_v2_led_dma_start(void)
+/* brightness 255 is a scale of 256, so full brightness is the gamma table itself */
+static void nk60_v2_led_level_init(struct nk60_led *led)
+{
+    pixel_scale(led->level, led_gamma, sizeof(led->level),
+                led->brightness + (led->brightness >> 7));
+}
+
+static void nk60_v2_led_dma_start(const uint8_t *buf)
 {
     DMA_Cmd(DMA1_Stream4, DISABLE);
-    DMA_SetCurrDataCounter(DMA1_Stream4, LED_BUF_SZIE);
+    while (DMA_GetCmdStatus(DMA1_Stream4) == ENABLE);
+    DMA1_Stream4->M0AR = (uint32_t)buf;
+    DMA_SetCurrDataCounter(DMA1_Stream4, LED_FRAME_SIZE);
     DMA_Cmd(DMA1_Stream4, ENABLE);
 }
 
@@ -70,41 +113,40 @@ static void nk60_v2_led_dma_stop(void)
     DMA_Cmd(DMA1_Stream4, DISABLE);
 }
 
-static void nk60_v2_led_write_single_color_buf(uint8_t data, uint8_t color_type, int index)
+/* in the dma irq, or with the dma idle */
+static void nk60_v2_led_swap(struct nk60_led *led)
 {
-    int i;
-    uint8_t tmp;
+    led->front ^= 1;
+    led->ready = false;
+    led->stale = true;
+    led->dma_busy = true;
+    nk60_v2_led_dma_start(led->buf[led->front]);
+    sem_send_one(&led->sem);
+}
 
-    for (i = 0; i < 8; i++) {
-        tmp = (0x80 & (data << i)) ? LED_DATA_1 : LED_DATA_0;
-        g_led_buf[index * (COLOR_MAX * LED_COLOR_BIT_WIDTH) + (color_type * LED_COLOR_BIT_WIDTH) + i] = tmp;
+/* the caller holds led->lock, the back frame may be written after it */
+static void nk60_v2_led_back_get(struct nk60_led *led)
+{
+    if (led->swap_pending) {
+        sem_get(&led->sem);
+        led->swap_pending = false;
+    }
+    if (led->stale) {
+        memcpy(led->buf[led->front ^ 1], led->buf[led->front], LED_BUF_SZIE);
+        led->stale = false;
     }
 }
 
-static void nk60_v2_led_write_buf(uint8_t r, uint8_t g, uint8_t b, int index)
+static void nk60_v2_led_encode(struct nk60_led *led, int index)
 {
+    uint8_t *buf = led->buf[led->front ^ 1] + index * (COLOR_MAX * LED_COLOR_BIT_WIDTH);
+    uint8_t level;
     int i;
-    uint8_t data;
-
-    if (unlikely(index >= LED_NUM))
-        return;
-
-    /* green */
-    for (i = 0; i < 8; i++) {
-        data = (0x80 & (g << i)) ? LED_DATA_1 : LED_DATA_0;
-        g_led_buf[index * (COLOR_MAX * LED_COLOR_BIT_WIDTH) + i + LED_COLOR_BIT_WIDTH * COLOR_G] = data;
-    }
-
-    /* red */
-    for (i = 0; i < 8; i++) {
-        data = (0x80 & (r << i)) ? LED_DATA_1 : LED_DATA_0;
-        g_led_buf[index * (COLOR_MAX * LED_COLOR_BIT_WIDTH) + i + LED_COLOR_BIT_WIDTH * COLOR_R] = data;
-    }
 
-    /* blue */
-    for (i = 0; i < 8; i++) {
-        data = (0x80 & (b << i)) ? LED_DATA_1 : LED_DATA_0;
-        g_led_buf[index * (COLOR_MAX * LED_COLOR_BIT_WIDTH) + i + LED_COLOR_BIT_WIDTH * COLOR_B] = data;
+    for (i = 0; i < COLOR_MAX; i++, buf += LED_COLOR_BIT_WIDTH) {
+        level = led->level[led->color[index][i]];
+        memcpy(buf, g_led_symbol[level >> 4], LED_NIBBLE_WIDTH);
+        memcpy(buf + LED_NIBBLE_WIDTH, g_led_symbol[level & 0xf], LED_NIBBLE_WIDTH);
     }
 }
 
@@ -114,15 +156,21 @@ static ssize_t nk60_v2_led_buf_write(struct device *dev, addr_t pos, const void
     const uint8_t *buf = buffer;
     int i, index;
 
-    if (size != LED_WIDTH * LED_HEIGHT * DS_COLOR_DATA_MAX) {
-        pr_err("data size error\r\n");
+    /* any run of whole pixels, pos is the byte offset in the frame */
+    if (pos % DS_COLOR_DATA_MAX || size % DS_COLOR_DATA_MAX ||
+        pos + size > LED_WIDTH * LED_HEIGHT * DS_COLOR_DATA_MAX) {
+        pr_err("data size error, pos=%u, size=%u\r\n", (unsigned int)pos, (unsigned int)size);
         return -EINVAL;
     }
 
     mutex_lock(&led->lock);
-    for (i = 0; i < (LED_WIDTH * LED_HEIGHT * DS_COLOR_DATA_MAX); i += DS_COLOR_DATA_MAX) {
-        index = g_nk60_led_buf_index[i / DS_COLOR_DATA_MAX];
-        nk60_v2_led_write_buf(buf[i + DS_COLOR_R], buf[i + DS_COLOR_G], buf[i + DS_COLOR_B], index);
+    nk60_v2_led_back_get(led);
+    for (i = 0; i < size; i += DS_COLOR_DATA_MAX) {
+        index = g_nk60_led_buf_index[(pos + i) / DS_COLOR_DATA_MAX];
+        led->color[index][COLOR_R] = buf[i + DS_COLOR_R];
+        led->color[index][COLOR_G] = buf[i + DS_COLOR_G];
+        led->color[index][COLOR_B] = buf[i + DS_COLOR_B];
+        nk60_v2_led_encode(led, index);
     }
     mutex_unlock(&led->lock);
 
@@ -132,14 +180,43 @@ static ssize_t nk60_v2_led_buf_write(struct device *dev, addr_t pos, const void
 static void nk60_v2_led_buf_init(struct nk60_led *led)
 {
     mutex_lock(&led->lock);
-    memset(led->buf, LED_DATA_0, LED_BUF_SZIE);
+    nk60_v2_led_back_get(led);
+    memset(led->color, 0, sizeof(led->color));
+    memset(led->buf[led->front ^ 1], LED_DATA_0, LED_BUF_SZIE);
+    mutex_unlock(&led->lock);
+}
+
+static void nk60_v2_led_refresh(struct nk60_led *led)
+{
+    mutex_lock(&led->lock);
+    nk60_v2_led_back_get(led);
+    led->swap_pending = true;
+    led->ready = true;
+    /* else the irq of the frame being sent swaps */
+    if (!led->dma_busy)
+        nk60_v2_led_swap(led);
+    mutex_unlock(&led->lock);
+}
+
+static void nk60_v2_led_set_brightness(struct nk60_led *led, uint8_t brightness)
+{
+    int i;
+
+    mutex_lock(&led->lock);
+    nk60_v2_led_back_get(led);
+    led->brightness = brightness;
+    nk60_v2_led_level_init(led);
+    for (i = 0; i < LED_NUM; i++)
+        nk60_v2_led_encode(led, i);
     mutex_unlock(&led->lock);
 }
 
 static int nk60_v2_led_control(struct device *dev, int cmd, void *args)
 {
     struct nk60_led *led = dev->priv;
-    struct display_dev_info info = {.width = 14, .height = 5};
+    struct display_dev_info info = {
+        .width = 14, .height = 5, .flags = DISPLAY_DEV_PARTIAL_WRITE,
+    };
 
     switch (cmd) {
     case LED_CTRL_ENABLE:
@@ -154,10 +231,12 @@ static int nk60_v2_led_control(struct device *dev, int cmd, void *args)
     case LED_CTRL_GET_ENABLE_STATUS:
         return led->enable;
     case LED_CTRL_REFRESH:
-        mutex_lock(&led->lock);
-        nk60_v2_led_dma_start();
-        sem_get(&led->sem);
-        mutex_unlock(&led->lock);
+        nk60_v2_led_refresh(led);
+        break;
+    case LED_CTRL_GET_BUSY:
+        return led->ready;
+    case LED_CTRL_SET_BRIGHTNESS:
+        nk60_v2_led_set_brightness(led, *(uint8_t *)args);
         break;
     case DS_CTRL_GET_DEV_INFO:
         memcpy(args, &info, sizeof(struct display_dev_info));
@@ -240,9 +319,9 @@ static int nk60_v2_led_dma_init(void)
 
     init_type.DMA_Channel = DMA_Channel_0;
     init_type.DMA_PeripheralBaseAddr = (uint32_t)&SPI2->DR;
-    init_type.DMA_Memory0BaseAddr = (uint32_t)g_led_buf;
+    init_type.DMA_Memory0BaseAddr = (uint32_t)g_led_buf[0];
     init_type.DMA_DIR = DMA_DIR_MemoryToPeripheral;
-    init_type.DMA_BufferSize = LED_BUF_SZIE;
+    init_type.DMA_BufferSize = LED_FRAME_SIZE;
     init_type.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
     init_type.DMA_MemoryInc = DMA_MemoryInc_Enable;
     init_type.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
@@ -270,7 +349,10 @@ void DMA1_Stream4_IRQHandler(void)
 {
     DMA_ClearITPendingBit(DMA1_Stream4, DMA_FLAG_TCIF4);
 
-    sem_send_one(&g_led->sem);
+    if (g_led->ready)
+        nk60_v2_led_swap(g_led);
+    else
+        g_led->dma_busy = false;
 }
 
 static int nk60_v2_led_init(void)
@@ -282,13 +364,18 @@ static int nk60_v2_led_init(void)
         pr_err("alloc led buf error\r\n");
         return -ENOMEM;
     }
+    memset(led, 0, sizeof(struct nk60_led));
     g_led = led;
-    led->buf = (uint8_t *)g_led_buf;
+    led->buf[0] = g_led_buf[0];
+    led->buf[1] = g_led_buf[1];
 
     nk60_v2_led_dma_init();
     nk60_v2_led_gpio_init();
     nk60_v2_led_spi_init();
-    memset(led->buf, LED_DATA_0, LED_BUF_SZIE);
+    memset(led->buf[0], LED_DATA_0, LED_BUF_SZIE);
+    memset(led->buf[1], LED_DATA_0, LED_BUF_SZIE);
+    led->brightness = U8_MAX;
+    nk60_v2_led_level_init(led);
 
     mutex_init(&led->lock);
     sem_init(&led->sem, 0);
@@ -69,7 +69,7 @@ struct vcom {
     uep_t ep_out;
     uep_t ep_in;
     uep_t ep_cmd;
-    sem_t wait;
+    struct ustream in_stream;
     sem_t tx_ready;
     bool connected;
     uint8_t rx_fifo_buf[CDC_RX_BUFSIZE];
@@ -250,41 +250,6 @@ static void _vcom_reset_state(ufunction_t func)
     data->connected = false;
 }
 
-/**
- * This function will handle cdc bulk in endpoint request.
- *
- * @param func the usb function object.
- * @param size request size.
- *
- * @return 0.
- */
-static int _ep_in_handler(ufunction_t func, size_t size)
-{
-    struct vcom *data;
-    size_t request_size;
-
-    if (func == NULL) {
-        pr_err("func is NULL\r\n");
-        return -EINVAL;
-    }
-
-    data = (struct vcom*)func->user_data;
-    request_size = data->ep_in->request.size;
-    pr_info("_ep_in_handler %d\r\n", request_size);
-    if ((request_size != 0) && ((request_size % EP_MAXPACKET(data->ep_in)) == 0)) {
-        data->ep_in->request.buffer = NULL;
-        data->ep_in->request.size = 0;
-        data->ep_in->request.req_type = UIO_REQUEST_WRITE;
-        usbd_io_request(func->device, data->ep_in, &data->ep_in->request);
-
-        return 0;
-    }
-
-    sem_send_one(&data->wait);
-
-    return 0;
-}
-
 /**
  * This function will handle cdc bulk out endpoint request.
  *
@@ -514,6 +479,7 @@ static int _function_disable(ufunction_t func)
     _vcom_reset_state(func);
 
     data = (struct vcom*)func->user_data;
+    usbd_stream_reset(&data->in_stream);
     if(data->ep_out->buffer != NULL) {
         kfree(data->ep_out->buffer);
         data->ep_out->buffer = NULL;
@@ -590,9 +556,6 @@ ufunction_t usbd_function_cdc_create(udevice_t device)
     func->user_data = (void*)data;
     data->func = func;
 
-    /* initilize vcom */
-    usb_vcom_init(func);
-
     /* create a cdc communication interface and a cdc data interface */
     intf_comm = usbd_interface_new(device, _interface_handler);
     intf_data = usbd_interface_new(device, _interface_handler);
@@ -626,7 +589,24 @@ ufunction_t usbd_function_cdc_create(udevice_t device)
     /* create a bulk in and a bulk endpoint */
     data_desc = (ucdc_data_desc_t)data_setting->desc;
     data->ep_out = usbd_endpoint_new(&data_desc->ep_out_desc, _ep_out_handler);
-    data->ep_in = usbd_endpoint_new(&data_desc->ep_in_desc, _ep_in_handler);
+    data->ep_in = usbd_endpoint_new(&data_desc->ep_in_desc, NULL);
+    if (usbd_stream_init(&data->in_stream, device, data->ep_in) < 0) {
+        pr_err("vcom in stream init error\r\n");
+        /* nothing is on the device yet, give the interface numbers back too */
+        device->nr_intf -= 2;
+        kfree(data->ep_in);
+        kfree(data->ep_out);
+        kfree(data->ep_cmd);
+        kfree(data_setting->desc);
+        kfree(data_setting);
+        kfree(comm_setting->desc);
+        kfree(comm_setting);
+        kfree(intf_data);
+        kfree(intf_comm);
+        kfree(data);
+        kfree(func);
+        return NULL;
+    }
 
     /* add the bulk out and bulk in endpoints to the data alternate setting */
     usbd_altsetting_add_endpoint(data_setting, data->ep_in);
@@ -640,6 +620,9 @@ ufunction_t usbd_function_cdc_create(udevice_t device)
     /* add the cdc data interface to cdc function */
     usbd_function_add_interface(func, intf_data);
 
+    /* initilize vcom last, its task uses data, which is freed if the stream fails */
+    usb_vcom_init(func);
+
     return func;
 }
 
@@ -649,21 +632,20 @@ static void vcom_tx_task_entry(void* parameter)
     struct ufunction *func = (struct ufunction *)parameter;
     struct vcom *data = (struct vcom*)func->user_data;
     uint8_t ch[CDC_BULKIN_MAXSIZE];
+    bool last;
 
     while (1) {
         sem_get(&data->tx_ready);
         pr_err("mask:%u\r\n", data->mask);
         while(kfifo_used(&data->tx_fifo) > 0) {
-            pr_info("used: %u\r\n", kfifo_used(&data->tx_fifo));
             rc = kfifo_out(&data->tx_fifo, ch, CDC_BULKIN_MAXSIZE);
             if (rc <= 0)
                 continue;
-            data->ep_in->request.buffer     = ch;
-            data->ep_in->request.size       = rc;
-            data->ep_in->request.req_type   = UIO_REQUEST_WRITE;
-            usbd_io_request(func->device, data->ep_in, &data->ep_in->request);
 
-            if (sem_get_timeout(&data->wait, msec_to_tick(VCOM_TX_TIMEOUT)) != 0) {
+            /* the stream keeps the endpoint busy, only the end of the fifo ends a transfer */
+            last = kfifo_used(&data->tx_fifo) == 0;
+            if (usbd_stream_write(&data->in_stream, ch, rc, last,
+                                  msec_to_tick(VCOM_TX_TIMEOUT)) != (ssize_t)rc) {
                 pr_info("vcom tx timeout\r\n");
             }
         }
@@ -688,7 +670,6 @@ static void usb_vcom_init(struct ufunction *func)
         return;
     }
 
-    sem_init(&data->wait, 0);
     sem_init(&data->tx_ready, 0);
 
     data->cdc_task = task_create("vcom", vcom_tx_task_entry, (void *)func, 5, 1024, 5, NULL);
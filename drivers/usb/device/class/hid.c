@@ -9,6 +9,9 @@
 #define pr_fmt(fmt) "[USB_HID]:%s[%d]:"fmt, __func__, __LINE__
 
 #include <kernel/kernel.h>
+#include <kernel/errno.h>
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
 #include <kernel/task.h>
 #include <kernel/msg_queue.h>
 #include <kernel/device.h>
@@ -19,6 +22,11 @@
 
 #include "hid.h"
 
+struct hid_in_report {
+    struct hid_report report;
+    u64 time;
+};
+
 struct hid_s {
     struct device dev;
     struct ufunction *func;
@@ -28,6 +36,19 @@ struct hid_s {
     uint16_t protocol;
     uint8_t report_buf[MAX_REPORT_SIZE];
     struct msg_queue hid_mq;
+
+    /* in report ring, in_tail is the one on the endpoint when in_busy */
+    spinlock_t in_lock;
+    struct hid_in_report in_queue[HID_IN_QUEUE_SIZE];
+    uint8_t in_head;
+    uint8_t in_tail;
+    uint8_t in_count;
+    bool in_busy;
+    struct hid_report_stats stats;
+    hid_in_done_t in_done;
+
+    /* keys of the last 6KRO report built from an nkro report */
+    uint8_t boot_keys[6];
 };
 
 /* CustomHID_ConfigDescriptor */
@@ -158,6 +179,32 @@ const uint8_t _report_desc[]=
 #endif
 #endif
 #endif
+#ifdef CONFIG_USB_DEVICE_HID_NKRO
+    /****n-key rollover keyboard*****/
+    USAGE_PAGE(1),      0x01,
+    USAGE(1),           0x06,
+    COLLECTION(1),      0x01,
+    REPORT_ID(1),       HID_REPORT_ID_NKRO,
+
+    USAGE_PAGE(1),      0x07,
+    USAGE_MINIMUM(1),   0xE0,
+    USAGE_MAXIMUM(1),   0xE7,
+    LOGICAL_MINIMUM(1), 0x00,
+    LOGICAL_MAXIMUM(1), 0x01,
+    REPORT_SIZE(1),     0x01,
+    REPORT_COUNT(1),    0x08,
+    INPUT(1),           0x02,
+
+    USAGE_PAGE(1),      0x07,
+    USAGE_MINIMUM(1),   0x00,
+    USAGE_MAXIMUM(1),   HID_NKRO_USAGE_MAX,
+    LOGICAL_MINIMUM(1), 0x00,
+    LOGICAL_MAXIMUM(1), 0x01,
+    REPORT_SIZE(1),     0x01,
+    REPORT_COUNT(1),    HID_NKRO_USAGE_MAX + 1,
+    INPUT(1),           0x02,
+    END_COLLECTION(0),
+#endif
 #endif
     // Media Control
 #ifdef USB_DEVICE_HID_MEDIA
@@ -343,7 +390,7 @@ static const struct uhid_comm_descriptor _hid_comm_desc =
         USB_DYNAMIC | USB_DIR_IN,
         USB_EP_ATTR_INT,
         0x40,
-        0x01,
+        HID_IN_INTERVAL,
     },
 
     /* Endpoint Descriptor OUT */
@@ -403,15 +450,102 @@ static int _ep_out_handler(ufunction_t func, size_t size)
     return 0;
 }
 
+/* keyboard and media reports carry the full state, only the latest one matters */
+static bool hid_report_is_state(uint8_t report_id)
+{
+    switch (report_id) {
+    case 0:
+    case HID_REPORT_ID_KEYBOARD1:
+    case HID_REPORT_ID_KEYBOARD2:
+    case HID_REPORT_ID_KEYBOARD3:
+    case HID_REPORT_ID_KEYBOARD4:
+    case HID_REPORT_ID_MEDIA:
+    case HID_REPORT_ID_NKRO:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* must be called with data->in_lock held, returns the report to put on the endpoint */
+static struct hid_in_report *__hid_in_next(struct hid_s *data)
+{
+    if (data->in_busy || data->in_count == 0)
+        return NULL;
+
+    data->in_busy = true;
+    return &data->in_queue[data->in_tail];
+}
+
+static void hid_in_send(struct hid_s *data, struct hid_in_report *in)
+{
+    uep_t ep = data->ep_in;
+
+    /* boot protocol reports have no report id */
+    if (in->report.report_id == 0) {
+        ep->request.buffer = (void *)in->report.report;
+        ep->request.size = in->report.size;
+    } else {
+        ep->request.buffer = (void *)&in->report;
+        ep->request.size = in->report.size + 1;
+    }
+    ep->request.req_type = UIO_REQUEST_WRITE;
+    usbd_io_request(data->func->device, ep, &ep->request);
+}
+
+static void hid_in_reset(struct hid_s *data)
+{
+    spin_lock_irq(&data->in_lock);
+    data->in_head = 0;
+    data->in_tail = 0;
+    data->in_count = 0;
+    data->in_busy = false;
+    spin_unlock_irq(&data->in_lock);
+}
+
 static int _ep_in_handler(ufunction_t func, __always_unused size_t size)
 {
-    __maybe_unused struct hid_s *data;
+    struct hid_s *data;
+    struct hid_in_report *in;
+    uint32_t latency;
+    uint8_t report_id = 0;
+    bool done = false, last = true;
+    uint8_t i;
+    u64 now;
 
     data = (struct hid_s *) func->user_data;
-    /*if(data->parent.tx_complete != NULL)
-    {
-        data->parent.tx_complete(&data->parent,NULL);
-    }*/
+    now = cpu_run_time_us();
+
+    spin_lock_irq(&data->in_lock);
+    if (data->in_busy) {
+        latency = (uint32_t)(now - data->in_queue[data->in_tail].time);
+        if (data->stats.sent == 0 || latency < data->stats.latency_min_us)
+            data->stats.latency_min_us = latency;
+        if (latency > data->stats.latency_max_us)
+            data->stats.latency_max_us = latency;
+        data->stats.latency_total_us += latency;
+        data->stats.sent++;
+
+        report_id = data->in_queue[data->in_tail].report.report_id;
+        data->in_tail = (data->in_tail + 1) % HID_IN_QUEUE_SIZE;
+        data->in_count--;
+        data->in_busy = false;
+        done = true;
+        for (i = 0; i < data->in_count; i++) {
+            if (data->in_queue[(data->in_tail + i) % HID_IN_QUEUE_SIZE].report.report_id == report_id) {
+                last = false;
+                break;
+            }
+        }
+    }
+    in = __hid_in_next(data);
+    spin_unlock_irq(&data->in_lock);
+
+    if (in != NULL)
+        hid_in_send(data, in);
+    if (done && data->in_done != NULL)
+        data->in_done(report_id, last);
+
     return 0;
 }
 
@@ -510,6 +644,10 @@ static int _function_enable(ufunction_t func)
     data = (struct hid_s *) func->user_data;
 
     pr_info("hid function enable\r\n");
+
+    /* a device comes up in report protocol, the host selects boot protocol */
+    data->protocol = HID_PROTOCOL_REPORT;
+    memset(data->boot_keys, 0, sizeof(data->boot_keys));
 //
 //    _vcom_reset_state(func);
 //
@@ -541,6 +679,8 @@ static int _function_disable(ufunction_t func)
 
     pr_info("hid function disable\r\n");
 
+    hid_in_reset(data);
+
     if(data->ep_out->buffer != NULL)
     {
         kfree(data->ep_out->buffer);
@@ -576,22 +716,151 @@ static int _hid_descriptor_config(__maybe_unused uhid_comm_desc_t hid, __maybe_u
 
     return 0;
 }
+
+/* the host reads nkro reports only in report protocol */
+#ifdef CONFIG_USB_DEVICE_HID_NKRO
+#define hid_nkro_active(hid)    ((hid)->protocol != HID_PROTOCOL_BOOT)
+#else
+#define hid_nkro_active(hid)    false
+#endif
+
+/*
+ * Build a 6KRO report from an nkro report. Keys of the last 6KRO report that
+ * are still down keep their slot, new keys fill the free slots in usage order.
+ */
+static void hid_nkro_to_6kro(struct hid_s *hid_dev, const struct hid_nkro_report *nkro,
+                             uint8_t *report)
+{
+    uint32_t keys[HID_NKRO_BITMAP_WORDS];
+    uint32_t old[HID_NKRO_BITMAP_WORDS] = { 0 };
+    uint32_t bits;
+    uint8_t code;
+    int i, n = 0;
+
+    memcpy(keys, nkro->bitmap, sizeof(keys));
+    report[0] = nkro->mods;
+    report[1] = 0;
+
+    for (i = 0; i < 6; i++) {
+        code = hid_dev->boot_keys[i];
+        if (code == 0 || code > HID_NKRO_USAGE_MAX)
+            continue;
+        if (keys[code >> 5] & (1u << (code & 31))) {
+            report[2 + n++] = code;
+            old[code >> 5] |= 1u << (code & 31);
+        }
+    }
+    for (i = 0; i < HID_NKRO_BITMAP_WORDS && n < 6; i++) {
+        bits = keys[i] & ~old[i];
+        while (bits != 0 && n < 6) {
+            report[2 + n++] = (i << 5) + __ffs(bits) - 1;
+            bits &= bits - 1;
+        }
+    }
+    memset(&report[2 + n], 0, 6 - n);
+    memcpy(hid_dev->boot_keys, &report[2], 6);
+}
+
+/**
+ * This function will queue an in report, pos is the report id. A keyboard or
+ * media report replaces the pending report of the same id if the host has not
+ * polled it yet, so the host always reads the latest state. An nkro report is
+ * sent as a 6KRO keyboard report when nkro is off or in boot protocol.
+ *
+ * @return the size on successful, 0 if not configured, -EINVAL on a short nkro
+ *         report, -ENOSPC if the queue is full.
+ */
 static ssize_t _hid_write(struct device *dev, addr_t pos, const void *buffer, size_t size)
 {
     struct hid_s *hid_dev;
-    struct hid_report report;
+    struct hid_in_report *in = NULL;
+    uint8_t boot[8];
+    ssize_t ret = size;
+    uint8_t i, slot;
+    u64 now;
 
     hid_dev = container_of(dev, struct hid_s, dev);
-    if (hid_dev->func->device->state == USB_STATE_CONFIGURED)
-    {
-        report.report_id = pos;
-        memcpy((void *)report.report,(void *)buffer, size);
-        report.size = size;
-        hid_dev->ep_in->request.buffer = (void *)&report;
-        hid_dev->ep_in->request.size = (size+1) > 64 ? 64 : size+1;
-        hid_dev->ep_in->request.req_type = UIO_REQUEST_WRITE;
-        usbd_io_request(hid_dev->func->device, hid_dev->ep_in, &hid_dev->ep_in->request);
-        return size;
+    if (hid_dev->func->device->state != USB_STATE_CONFIGURED)
+        return 0;
+
+    if (pos == HID_REPORT_ID_NKRO) {
+        if (size < sizeof(struct hid_nkro_report))
+            return -EINVAL;
+        if (!hid_nkro_active(hid_dev)) {
+            hid_nkro_to_6kro(hid_dev, buffer, boot);
+            buffer = boot;
+            size = sizeof(boot);
+            pos = HID_REPORT_ID_KEYBOARD1;
+        }
+    }
+    if (hid_dev->protocol == HID_PROTOCOL_BOOT) {
+        /* the host only parses the keyboard boot report, without report id */
+        if (pos != HID_REPORT_ID_KEYBOARD1)
+            return ret;
+        pos = 0;
+    }
+
+    size = min_t(size_t, size, sizeof(in->report.report));
+    now = cpu_run_time_us();
+
+    spin_lock_irq(&hid_dev->in_lock);
+    if (hid_report_is_state(pos)) {
+        /* the report in flight belongs to the endpoint, skip it */
+        for (i = hid_dev->in_busy ? 1 : 0; i < hid_dev->in_count; i++) {
+            slot = (hid_dev->in_tail + i) % HID_IN_QUEUE_SIZE;
+            if (hid_dev->in_queue[slot].report.report_id == pos) {
+                /* keep the time of the first change the host has not seen */
+                in = &hid_dev->in_queue[slot];
+                hid_dev->stats.coalesced++;
+                break;
+            }
+        }
+    }
+    if (in == NULL) {
+        if (hid_dev->in_count >= HID_IN_QUEUE_SIZE) {
+            hid_dev->stats.dropped++;
+            spin_unlock_irq(&hid_dev->in_lock);
+            return -ENOSPC;
+        }
+        in = &hid_dev->in_queue[hid_dev->in_head];
+        hid_dev->in_head = (hid_dev->in_head + 1) % HID_IN_QUEUE_SIZE;
+        hid_dev->in_count++;
+        in->report.report_id = pos;
+        in->time = now;
+    }
+    memcpy(in->report.report, buffer, size);
+    in->report.size = size;
+    in = __hid_in_next(hid_dev);
+    spin_unlock_irq(&hid_dev->in_lock);
+
+    if (in != NULL)
+        hid_in_send(hid_dev, in);
+
+    return ret;
+}
+
+static int _hid_control(struct device *dev, int cmd, void *args)
+{
+    struct hid_s *hid_dev = container_of(dev, struct hid_s, dev);
+
+    switch (cmd) {
+    case HID_CTRL_GET_STATS:
+        if (args == NULL)
+            return -EINVAL;
+        spin_lock_irq(&hid_dev->in_lock);
+        memcpy(args, &hid_dev->stats, sizeof(struct hid_report_stats));
+        spin_unlock_irq(&hid_dev->in_lock);
+        break;
+    case HID_CTRL_CLR_STATS:
+        spin_lock_irq(&hid_dev->in_lock);
+        memset(&hid_dev->stats, 0, sizeof(struct hid_report_stats));
+        spin_unlock_irq(&hid_dev->in_lock);
+        break;
+    case HID_CTRL_SET_IN_DONE:
+        hid_dev->in_done = (hid_in_done_t)args;
+        break;
+    default:
+        return -EINVAL;
     }
 
     return 0;
@@ -622,10 +891,12 @@ static void usb_hid_init(struct ufunction *func)
     hiddev = (struct hid_s *)func->user_data;
 
     hiddev->func = func;
+    spin_lock_init(&hiddev->in_lock);
 
     device_init(&hiddev->dev);
     hiddev->dev.name = "hidd";
     hiddev->dev.ops.write = _hid_write;
+    hiddev->dev.ops.control = _hid_control;
     device_register(&hiddev->dev);
 
     hid_task = task_create("hidd", hid_task_entry, (void *)hiddev, 5, 1024, 5, NULL);
@@ -33,6 +33,16 @@
 #define MAX_REPORT_SIZE             64
 #define HID_RX_BUFSIZE              64
 
+/* in reports waiting for the host to poll, including the one in flight */
+#define HID_IN_QUEUE_SIZE           8
+
+/* polling interval of the in endpoint in ms */
+#ifdef CONFIG_USB_HID_INTERVAL
+#define HID_IN_INTERVAL             CONFIG_USB_HID_INTERVAL
+#else
+#define HID_IN_INTERVAL             1
+#endif
+
 /* HID Report Types */
 #define HID_REPORT_INPUT            0x01
 #define HID_REPORT_OUTPUT           0x02
@@ -29,8 +29,8 @@ struct winusb_device {
     uint8_t cmd_buff[1024];
     uep_t ep_out;
     uep_t ep_in;
+    struct ustream in_stream;
     sem_t read_sem;
-    sem_t write_sem;
 };
 
 struct winusb_device *winusb_dev;
@@ -151,14 +151,6 @@ static int _ep_out_handler(ufunction_t func, size_t size)
     return 0;
 }
 
-static int _ep_in_handler(ufunction_t func, size_t size)
-{
-    struct winusb_device *winusb_device = (struct winusb_device *)func->user_data;
-
-    sem_send_one(&winusb_device->write_sem);
-
-    return 0;
-}
 static ufunction_t cmd_func = NULL;
 static int _ep0_cmd_handler(udevice_t device, size_t size)
 {
@@ -205,6 +197,9 @@ static int _function_enable(ufunction_t func)
 }
 static int _function_disable(ufunction_t func)
 {
+    struct winusb_device *winusb_device = (struct winusb_device *)func->user_data;
+
+    usbd_stream_reset(&winusb_device->in_stream);
     return 0;
 }
 
@@ -250,22 +245,12 @@ static ssize_t winusb_read(struct device *dev, addr_t pos,
 static ssize_t winusb_write(struct device *dev, addr_t pos,
     const void *buffer, size_t size)
 {
-    size_t write_size;
     struct winusb_device *win_dev = container_of(dev, struct winusb_device, dev);
 
     if (win_dev->func->device->state != USB_STATE_CONFIGURED)
         return 0;
 
-    win_dev->ep_in->buffer = (void *)buffer;
-    win_dev->ep_in->request.buffer = win_dev->ep_in->buffer;
-    win_dev->ep_in->request.size = size;
-    win_dev->ep_in->request.req_type = UIO_REQUEST_WRITE;
-    write_size = usbd_io_request(win_dev->func->device, win_dev->ep_in,
-        &win_dev->ep_in->request);
-
-    sem_get(&win_dev->write_sem);
-
-    return write_size;
+    return usbd_stream_write(&win_dev->in_stream, buffer, size, false, 0);
 }
 
 static ssize_t winusb_read_timeout(struct device *dev, addr_t pos,
@@ -298,28 +283,21 @@ static ssize_t winusb_read_timeout(struct device *dev, addr_t pos,
 static ssize_t winusb_write_timeout(struct device *dev, addr_t pos,
     const void *buffer, size_t size, uint32_t tick)
 {
-    size_t write_size;
     struct winusb_device *win_dev =
         container_of(dev, struct winusb_device, dev);
-    int rc;
+    ssize_t rc;
 
     if (win_dev->func->device->state != USB_STATE_CONFIGURED)
         return 0;
 
-    win_dev->ep_in->buffer = (void *)buffer;
-    win_dev->ep_in->request.buffer = win_dev->ep_in->buffer;
-    win_dev->ep_in->request.size = size;
-    win_dev->ep_in->request.req_type = UIO_REQUEST_WRITE;
-    write_size = usbd_io_request(win_dev->func->device, win_dev->ep_in,
-        &win_dev->ep_in->request);
-
-    rc = sem_get_timeout(&win_dev->write_sem, tick);
+    /* NDK frames its own packets, so no ZLP is appended */
+    rc = usbd_stream_write(&win_dev->in_stream, buffer, size, false, tick);
     if (rc < 0) {
         pr_err("write timeout\r\n");
         return -ETIMEDOUT;
     }
 
-    return write_size;
+    return rc;
 }
 
 static int  winusb_control(struct device *dev, int cmd, void *args)
@@ -370,7 +348,6 @@ ufunction_t usbd_function_winusb_create(udevice_t device)
     winusb_dev = winusb_device;
     memset((void *)winusb_device, 0, sizeof(*winusb_device));
     sem_init(&winusb_device->read_sem, 0);
-    sem_init(&winusb_device->write_sem, 0);
     func->user_data = (void*)winusb_device;
     /* create an interface object */
     winusb_intf = usbd_interface_new(device, _interface_handler);
@@ -387,7 +364,21 @@ ufunction_t usbd_function_winusb_create(udevice_t device)
     /* create endpoint */
     winusb_desc = (winusb_desc_t)winusb_setting->desc;
     winusb_device->ep_out = usbd_endpoint_new(&winusb_desc->ep_out_desc, _ep_out_handler);
-    winusb_device->ep_in  = usbd_endpoint_new(&winusb_desc->ep_in_desc, _ep_in_handler);
+    winusb_device->ep_in  = usbd_endpoint_new(&winusb_desc->ep_in_desc, NULL);
+    if (usbd_stream_init(&winusb_device->in_stream, device, winusb_device->ep_in) < 0) {
+        pr_err("winusb in stream init error\r\n");
+        /* nothing is on the device yet, give the interface number back too */
+        device->nr_intf--;
+        kfree(winusb_device->ep_in);
+        kfree(winusb_device->ep_out);
+        kfree(winusb_setting->desc);
+        kfree(winusb_setting);
+        kfree(winusb_intf);
+        winusb_dev = NULL;
+        kfree(winusb_device);
+        kfree(func);
+        return NULL;
+    }
 
     /* add the int out and int in endpoint to the alternate setting */
     usbd_altsetting_add_endpoint(winusb_setting, winusb_device->ep_out);
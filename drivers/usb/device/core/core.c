@@ -12,6 +12,7 @@
 #include <kernel/msg_queue.h>
 #include <kernel/mutex.h>
 #include <kernel/printk.h>
+#include <kernel/cpu.h>
 #include <usb/usb_common.h>
 #include <usb/usb_device.h>
 
@@ -528,6 +529,9 @@ static int _standard_request(struct udevice* device, ureq_t setup)
                 }
 
                 INIT_LIST_HEAD(&ep->request_list);
+
+                if (ep->stream != NULL)
+                    usbd_stream_resume(ep->stream);
             }
         }
         break;
@@ -738,6 +742,10 @@ static int _data_notify(udevice_t device, struct ep_msg* ep_msg)
     }
 
     if (EP_ADDRESS(ep) & USB_DIR_IN) {
+        if (ep->stream != NULL) {
+            usbd_stream_complete(ep->stream);
+            return 0;
+        }
         size = ep_msg->size;
         if(ep->request.remain_size >= EP_MAXPACKET(ep)) {
             dcd_ep_write(device->dcd, EP_ADDRESS(ep), ep->request.buffer, EP_MAXPACKET(ep));
@@ -770,6 +778,29 @@ static int _data_notify(udevice_t device, struct ep_msg* ep_msg)
     return 0;
 }
 
+#ifdef CONFIG_USB_BENCH
+/* times every data event of an endpoint for app/usb_bench.c */
+static void usbd_data_dispatch(udevice_t device, struct ep_msg *ep_msg)
+{
+    struct usbd_dispatch_stat *stat = &device->dispatch[USB_EP_TABLE_INDEX(ep_msg->ep_addr)];
+    u32 start, end;
+
+    start = cpu_cycles();
+    _data_notify(device, ep_msg);
+    end = cpu_cycles();
+
+    stat->count++;
+    stat->notify_total += end - start;
+    stat->notify_max = max_t(u32, stat->notify_max, end - start);
+    stat->event_total += end - ep_msg->cycles;
+}
+#else
+static inline void usbd_data_dispatch(udevice_t device, struct ep_msg *ep_msg)
+{
+    _data_notify(device, ep_msg);
+}
+#endif
+
 static int _ep0_out_notify(udevice_t device, struct ep_msg* ep_msg)
 {
     uep_t ep0;
@@ -1051,6 +1082,7 @@ uintf_t usbd_interface_new(udevice_t device, uintf_handler_t handler)
         pr_err("alloc memery failed\r\n");
         return NULL;
     }
+    intf->device = device;
     intf->intf_num = device->nr_intf;
     device->nr_intf++;
     intf->handler = handler;
@@ -1190,6 +1222,7 @@ uep_t usbd_endpoint_new(uep_desc_t ep_desc, udep_handler_t handler)
     ep->handler = handler;
     ep->buffer  = NULL;
     ep->stalled = false;
+    ep->stream  = NULL;
     INIT_LIST_HEAD(&ep->request_list);
 
     return ep;
@@ -1264,28 +1297,20 @@ uconfig_t usbd_find_config(udevice_t device, uint8_t value)
  */
 uintf_t usbd_find_interface(udevice_t device, uint8_t value, ufunction_t *pfunc)
 {
-    ufunction_t func;
-    uintf_t intf;
-
-    pr_info("usbd_find_interface\r\n");
+    struct ulookup_intf *entry;
 
     /* parameter check */
     // WK_ERROR(device != NULL);
-    // WK_ERROR(value < device->nr_intf);
 
-    /* search an interface in the current configuration */
-    list_for_each_entry(func, &device->curr_cfg->func_list, list) {
-        list_for_each_entry(intf, &func->intf_list, list) {
-            if(intf->intf_num == value) {
-                if (pfunc != NULL)
-                    *pfunc = func;
-                return intf;
-            }
-        }
+    if (value >= USB_MAX_INTERFACES || device->intf_table[value].intf == NULL) {
+        pr_err("can't find interface %d\r\n", value);
+        return NULL;
     }
 
-    pr_err("can't find interface %d\r\n", value);
-    return NULL;
+    entry = &device->intf_table[value];
+    if (pfunc != NULL)
+        *pfunc = entry->func;
+    return entry->intf;
 }
 
 /**
@@ -1335,37 +1360,21 @@ ualtsetting_t usbd_find_altsetting(uintf_t intf, uint8_t value)
  */
 uep_t usbd_find_endpoint(udevice_t device, ufunction_t* pfunc, uint8_t ep_addr)
 {
-    uep_t ep;
-    struct list_head *i, *j, *k;
-    ufunction_t func;
-    uintf_t intf;
+    struct ulookup_ep *entry;
 
     /* parameter check */
     // WK_ERROR(device != NULL);
 
-    /* search a endpoint in the current configuration */
-    for (i=device->curr_cfg->func_list.next; i!=&device->curr_cfg->func_list; i=i->next)
-    {
-        func = (ufunction_t)list_entry(i, struct ufunction, list);
-        for(j=func->intf_list.next; j!=&func->intf_list; j=j->next)
-        {
-            intf = (uintf_t)list_entry(j, struct uinterface, list);
-            for(k=intf->curr_setting->ep_list.next;
-                    k!=&intf->curr_setting->ep_list; k=k->next)
-            {
-                ep = (uep_t)list_entry(k, struct uendpoint, list);
-                if(EP_ADDRESS(ep) == ep_addr)
-                {
-                    if (pfunc != NULL)
-                        *pfunc = func;
-                    return ep;
-                }
-            }
-        }
+    /* the table only holds endpoints of the current configuration */
+    entry = &device->ep_table[USB_EP_TABLE_INDEX(ep_addr)];
+    if (entry->ep == NULL || EP_ADDRESS(entry->ep) != ep_addr) {
+        pr_err("can't find endpoint 0x%x\r\n", ep_addr);
+        return NULL;
     }
 
-    pr_err("can't find endpoint 0x%x\r\n", ep_addr);
-    return NULL;
+    if (pfunc != NULL)
+        *pfunc = entry->func;
+    return entry->ep;
 }
 
 /**
@@ -1527,6 +1536,66 @@ int usbd_os_comp_id_desc_add_os_func_comp_id_desc(usb_os_comp_id_desc_t os_comp_
     return 0;
 }
 
+static void usbd_lookup_table_add_setting(udevice_t device, ufunction_t func,
+                                          ualtsetting_t setting)
+{
+    struct ulookup_ep *entry;
+    uep_t ep;
+
+    list_for_each_entry(ep, &setting->ep_list, list) {
+        entry = &device->ep_table[USB_EP_TABLE_INDEX(EP_ADDRESS(ep))];
+        entry->ep = ep;
+        entry->func = func;
+    }
+}
+
+static void usbd_lookup_table_del_setting(udevice_t device, ualtsetting_t setting)
+{
+    struct ulookup_ep *entry;
+    uep_t ep;
+
+    list_for_each_entry(ep, &setting->ep_list, list) {
+        entry = &device->ep_table[USB_EP_TABLE_INDEX(EP_ADDRESS(ep))];
+        if (entry->ep == ep) {
+            entry->ep = NULL;
+            entry->func = NULL;
+        }
+    }
+}
+
+/**
+ * This function will rebuild the endpoint and interface lookup table
+ * from the current configuration.
+ *
+ * @param device the usb device object.
+ *
+ * @return none.
+ */
+static void usbd_lookup_table_build(udevice_t device)
+{
+    ufunction_t func;
+    uintf_t intf;
+
+    memset(device->ep_table, 0, sizeof(device->ep_table));
+    memset(device->intf_table, 0, sizeof(device->intf_table));
+
+    if (device->curr_cfg == NULL)
+        return;
+
+    list_for_each_entry(func, &device->curr_cfg->func_list, list) {
+        list_for_each_entry(intf, &func->intf_list, list) {
+            if (intf->intf_num >= USB_MAX_INTERFACES) {
+                pr_err("interface %d out of lookup table\r\n", intf->intf_num);
+                continue;
+            }
+            device->intf_table[intf->intf_num].intf = intf;
+            device->intf_table[intf->intf_num].func = func;
+            if (intf->curr_setting != NULL)
+                usbd_lookup_table_add_setting(device, func, intf->curr_setting);
+        }
+    }
+}
+
 /**
  * This function will set an alternate setting for an interface.
  *
@@ -1538,6 +1607,7 @@ int usbd_os_comp_id_desc_add_os_func_comp_id_desc(usb_os_comp_id_desc_t os_comp_
 int usbd_set_altsetting(uintf_t intf, uint8_t value)
 {
     ualtsetting_t setting;
+    udevice_t device;
 
     pr_info("usbd_set_altsetting\r\n");
 
@@ -1546,6 +1616,18 @@ int usbd_set_altsetting(uintf_t intf, uint8_t value)
 
     /* find an alternate setting */
     setting = usbd_find_altsetting(intf, value);
+    if (setting == NULL)
+        return -1;
+
+    /* swap the endpoints of an active interface in the lookup table */
+    device = intf->device;
+    if (device != NULL && intf->intf_num < USB_MAX_INTERFACES &&
+        device->intf_table[intf->intf_num].intf == intf) {
+        if (intf->curr_setting != NULL)
+            usbd_lookup_table_del_setting(device, intf->curr_setting);
+        usbd_lookup_table_add_setting(device, device->intf_table[intf->intf_num].func,
+                                      setting);
+    }
 
     /* set as current alternate setting */
     intf->curr_setting = setting;
@@ -1576,6 +1658,7 @@ int usbd_set_config(udevice_t device, uint8_t value)
 
     /* set as current configuration */
     device->curr_cfg = cfg;
+    usbd_lookup_table_build(device);
 
     dcd_set_config(device->dcd, value);
 
@@ -1840,6 +1923,9 @@ int usbd_ep_in_handler(udcd_t dcd, uint8_t address, size_t size)
     msg.dcd = dcd;
     msg.content.ep_msg.ep_addr = address;
     msg.content.ep_msg.size = size;
+#ifdef CONFIG_USB_BENCH
+    msg.content.ep_msg.cycles = cpu_cycles();
+#endif
     usbd_event_signal(&msg);
 
     return 0;
@@ -1855,6 +1941,9 @@ int usbd_ep_out_handler(udcd_t dcd, uint8_t address, size_t size)
     msg.dcd = dcd;
     msg.content.ep_msg.ep_addr = address;
     msg.content.ep_msg.size = size;
+#ifdef CONFIG_USB_BENCH
+    msg.content.ep_msg.cycles = cpu_cycles();
+#endif
     usbd_event_signal(&msg);
 
     return 0;
@@ -1999,7 +2088,7 @@ static void usbd_task_entry(__maybe_unused void* parameter)
         case USB_MSG_DATA_NOTIFY:
             /* some buggy drivers will have USB_MSG_DATA_NOTIFY before the core
              * got configured. */
-            _data_notify(device, &msg.content.ep_msg);
+            usbd_data_dispatch(device, &msg.content.ep_msg);
             break;
         case USB_MSG_SETUP_NOTIFY:
             _setup_request(device, &msg.content.setup);
@@ -0,0 +1,211 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#define pr_fmt(fmt) "[USB_STREAM]:%s[%d]:"fmt, __func__, __LINE__
+
+#include <kernel/kernel.h>
+#include <kernel/printk.h>
+#include <kernel/sem.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <usb/usb_common.h>
+#include <usb/usb_device.h>
+
+/*
+ * Bulk in stream: the writer copies data into ping-pong packet buffers and
+ * the in completion (_data_notify) arms the next queued packet, so the
+ * endpoint never waits for the writer task to be scheduled between packets.
+ */
+
+/* must be called with stream->lock held */
+static void __usbd_stream_arm(ustream_t stream)
+{
+    if (stream->busy || stream->queued == 0 || stream->ep->stalled)
+        return;
+
+    stream->busy = true;
+    dcd_ep_write(stream->device->dcd, EP_ADDRESS(stream->ep),
+                 stream->buf[stream->tail], stream->len[stream->tail]);
+}
+
+/* wait until no more than max_queued packets are pending */
+static int usbd_stream_wait(ustream_t stream, uint8_t max_queued, uint32_t tick)
+{
+    int rc;
+
+    spin_lock_irq(&stream->lock);
+    while (stream->queued > max_queued) {
+        stream->waiting = true;
+        spin_unlock_irq(&stream->lock);
+        rc = sem_get_timeout(&stream->space, tick);
+        if (rc < 0)
+            return rc;
+        spin_lock_irq(&stream->lock);
+    }
+    spin_unlock_irq(&stream->lock);
+
+    return 0;
+}
+
+/**
+ * This function will bind a stream to a bulk in endpoint.
+ *
+ * @param stream the stream object.
+ * @param device the usb device object.
+ * @param ep the bulk in endpoint, its max packet size must be configured.
+ *
+ * @return 0 on successful, -ENOMEM on no memory.
+ */
+int usbd_stream_init(ustream_t stream, udevice_t device, uep_t ep)
+{
+    uint8_t *buf;
+    int i;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->device = device;
+    stream->ep = ep;
+    stream->maxpacket = EP_MAXPACKET(ep);
+
+    buf = kmalloc(stream->maxpacket * USTREAM_NR_BUF, GFP_KERNEL);
+    if (buf == NULL) {
+        pr_err("alloc stream buffer failed\r\n");
+        return -ENOMEM;
+    }
+    for (i = 0; i < USTREAM_NR_BUF; i++)
+        stream->buf[i] = buf + i * stream->maxpacket;
+
+    spin_lock_init(&stream->lock);
+    sem_init(&stream->space, 0);
+    mutex_init(&stream->write_lock);
+    ep->stream = stream;
+
+    return 0;
+}
+
+/**
+ * This function will drop all queued packets, it should be called when the
+ * function is disabled because the pending completions will never come.
+ *
+ * @param stream the stream object.
+ */
+void usbd_stream_reset(ustream_t stream)
+{
+    bool wake;
+
+    spin_lock_irq(&stream->lock);
+    stream->head = 0;
+    stream->tail = 0;
+    stream->queued = 0;
+    stream->busy = false;
+    wake = stream->waiting;
+    stream->waiting = false;
+    spin_unlock_irq(&stream->lock);
+
+    if (wake)
+        sem_send_one(&stream->space);
+}
+
+/**
+ * This function will queue data on a stream, it returns as soon as the last
+ * packet is queued, the data has been copied at that point.
+ *
+ * @param stream the stream object.
+ * @param buffer the data.
+ * @param size the data size.
+ * @param zlp terminate the transfer with a zero length packet if the last
+ *            packet is a full one.
+ * @param tick timeout of waiting for a free buffer, 0 means forever.
+ *
+ * @return the queued size, less than size if the timeout hit after some
+ *         packets were queued, -ETIMEDOUT if none was.
+ */
+ssize_t usbd_stream_write(ustream_t stream, const void *buffer, size_t size,
+                          bool zlp, uint32_t tick)
+{
+    const uint8_t *data = buffer;
+    size_t remain = size;
+    size_t chunk;
+    int rc;
+
+    mutex_lock(&stream->write_lock);
+    do {
+        rc = usbd_stream_wait(stream, USTREAM_NR_BUF - 1, tick);
+        if (rc < 0) {
+            mutex_unlock(&stream->write_lock);
+            /* the queued packets are sent anyway, the caller must not resend them */
+            return remain < size ? (ssize_t)(size - remain) : rc;
+        }
+
+        /* the head buffer is not owned by the endpoint until queued++ */
+        chunk = min_t(size_t, remain, stream->maxpacket);
+        memcpy(stream->buf[stream->head], data, chunk);
+        stream->len[stream->head] = chunk;
+
+        spin_lock_irq(&stream->lock);
+        stream->head = (stream->head + 1) % USTREAM_NR_BUF;
+        stream->queued++;
+        __usbd_stream_arm(stream);
+        spin_unlock_irq(&stream->lock);
+
+        data += chunk;
+        remain -= chunk;
+    } while (remain > 0 || (zlp && chunk == stream->maxpacket));
+    mutex_unlock(&stream->write_lock);
+
+    return size;
+}
+
+/**
+ * This function will wait until all queued packets are sent.
+ *
+ * @param stream the stream object.
+ * @param tick timeout, 0 means forever.
+ *
+ * @return 0 on successful, -ETIMEDOUT on timeout.
+ */
+int usbd_stream_flush(ustream_t stream, uint32_t tick)
+{
+    return usbd_stream_wait(stream, 0, tick);
+}
+
+/**
+ * This function will handle the in completion of a stream endpoint and arm
+ * the next queued packet.
+ *
+ * @param stream the stream object.
+ */
+void usbd_stream_complete(ustream_t stream)
+{
+    bool wake;
+
+    spin_lock_irq(&stream->lock);
+    if (stream->busy) {
+        stream->busy = false;
+        stream->tail = (stream->tail + 1) % USTREAM_NR_BUF;
+        stream->queued--;
+    }
+    __usbd_stream_arm(stream);
+    wake = stream->waiting;
+    stream->waiting = false;
+    spin_unlock_irq(&stream->lock);
+
+    if (wake)
+        sem_send_one(&stream->space);
+}
+
+/**
+ * This function will restart a stream after the endpoint halt is cleared.
+ *
+ * @param stream the stream object.
+ */
+void usbd_stream_resume(ustream_t stream)
+{
+    spin_lock_irq(&stream->lock);
+    __usbd_stream_arm(stream);
+    spin_unlock_irq(&stream->lock);
+}
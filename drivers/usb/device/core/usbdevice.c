@@ -163,6 +163,9 @@ int usb_device_init(udcd_t udc)
     list_for_each_entry(udclass, &class_list, list) {
         /* create a function object */
         func = udclass->usbd_function_create(udevice);
+        /* a class that failed to create leaves the others working */
+        if (func == NULL)
+            continue;
         /* add the function to the configuration */
         usbd_config_add_function(cfg, func);
     }
@@ -12,10 +12,17 @@
 #include <kernel/kernel.h>
 #include <kernel/list.h>
 #include <kernel/spinlock.h>
+#include <kernel/mutex.h>
+#include <kernel/device.h>
+#include <display/frame_sched.h>
 
+/* a lower layer is drawn over a higher one */
 #define BACKGROUND_LAYER 255
+#define DEFAULT_LAYER    128
 #define TOP_LAYER        0
 
+#define DS_ALPHA_OPAQUE  255
+
 enum ds_data_type {
     DS_COLOR_G = 0,
     DS_COLOR_R,
@@ -31,15 +38,82 @@ enum ds_ctrl_cmd {
     DS_CTRL_UNLOCK,
     DS_CTRL_GET_DEV_INFO,
     DS_CTRL_REFRESH,
+    DS_CTRL_GET_STATS,
+    /* struct frame_stats */
+    DS_CTRL_GET_FRAME_STATS,
+    /* uint32_t fps, clears the frame stats */
+    DS_CTRL_SET_FRAME_RATE,
+    /* both stats to the console */
+    DS_CTRL_DUMP_STATS,
+    /* struct display_flush_done, for a DISPLAY_DEV_ASYNC_WRITE device */
+    DS_CTRL_SET_FLUSH_DONE,
 };
 
 enum ds_data_cmd {
     DS_DATA_CMD_TRANSPARENT = 1,
 };
 
+/* pixel format of an area, the frame itself is always DS_FMT_RGB888 */
+enum ds_pixel_format {
+    /* struct ds_data, 4 bytes a pixel with a transparent cmd */
+    DS_FMT_DATA,
+    /* 3 bytes in DS_COLOR_* order, the same as the frame */
+    DS_FMT_RGB888,
+    /* native endian uint16_t, red in the top 5 bits */
+    DS_FMT_RGB565,
+    /* 1 byte index into the area palette */
+    DS_FMT_PAL8,
+    /* 1 bit a pixel msb first, a set bit is drawn in the area fg color */
+    DS_FMT_MONO1,
+};
+
+/* a 1 bit a pixel mask follows the pixels, a clear bit is not drawn */
+#define DS_AREA_MASK      (1 << 0)
+/* a pixel whose raw value is the area key is not drawn */
+#define DS_AREA_COLOR_KEY (1 << 1)
+
+/* the device takes a write of any whole pixels, pos is the byte offset */
+#define DISPLAY_DEV_PARTIAL_WRITE (1 << 0)
+/*
+ * A write returns once the pixels are being sent, the buffer must not
+ * change until LED_CTRL_GET_BUSY is 0 or the flush done callback ran.
+ */
+#define DISPLAY_DEV_ASYNC_WRITE   (1 << 1)
+/*
+ * A write is native endian RGB565 pixels and pos is the pixel offset, they
+ * go straight to the panel and need no refresh. Without it a write is
+ * RGB888 in DS_COLOR_* order.
+ */
+#define DISPLAY_DEV_RGB565        (1 << 2)
+
 struct display_dev_info {
     uint16_t width;
     uint16_t height;
+    uint16_t flags;
+};
+
+/* run from the irq when an asynchronous write is out, done NULL to clear */
+struct display_flush_done {
+    void (*done)(void *arg);
+    void *arg;
+};
+
+struct ds_rect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+struct ds_stats {
+    /* frames written to the device, each is at least one damaged rect */
+    uint32_t frames;
+    uint32_t rects;
+    uint32_t pixels;
+    /* rects drawn from an opaque area down, the layers below it skipped */
+    uint32_t culled_rects;
+    /* of the display_server task in 1/100 %, task_get_cpu_usage() / 100 */
+    uint32_t cpu_usage;
 };
 
 struct ds_data {
@@ -52,7 +126,21 @@ struct ds_draw_area {
     uint16_t y;
     uint16_t width;
     uint16_t height;
-    struct ds_data *data;
+    union {
+        /* DS_FMT_DATA */
+        struct ds_data *data;
+        uint8_t *pixels;
+    };
+    uint8_t format;
+    uint8_t flags;
+    /* bytes a row of pixels and of mask */
+    uint16_t stride;
+    uint16_t mask_stride;
+    uint8_t *mask;
+    /* DS_FMT_PAL8, 256 colors in DS_COLOR_* order, owned by the client */
+    const uint8_t (*palette)[DS_COLOR_DATA_MAX];
+    uint32_t key;
+    uint8_t fg[DS_COLOR_DATA_MAX];
 };
 
 struct ds_draw_point {
@@ -61,24 +149,92 @@ struct ds_draw_point {
     struct ds_data data;
 };
 
+/* glyphs of height rows, (width + 7) / 8 bytes a row, msb first */
+struct ds_font {
+    uint8_t width;
+    uint8_t height;
+    /* the first char and the number of glyphs */
+    uint8_t first;
+    uint8_t num;
+    const uint8_t *glyphs;
+};
+
+/* 3*5 ascii 0x20 to 0x5f, lower case is drawn as upper case */
+extern const struct ds_font ds_font_3x5;
+
+/*
+ * The recording one, the last submitted one and the one being drawn, the
+ * client and the server only ever swap them.
+ */
+#define DS_CMD_LISTS 3
+
+/* list bytes a command takes at most, to size a command info */
+#define DS_CMD_FILL_RECT_SIZE   24
+#define DS_CMD_BLIT_SIZE        (16 + sizeof(struct ds_draw_area))
+#define DS_CMD_PIXELS_SIZE(num) (16 + sizeof(struct ds_draw_point) * (num))
+#define DS_CMD_TEXT_SIZE(len)   (32 + (len))
+
+struct ds_cmd_list {
+    uint8_t *buf;
+    uint16_t len;
+    /* every pixel the list draws, width 0 if it draws nothing */
+    struct ds_rect bounds;
+    /* the largest rect the list draws with no transparent pixel */
+    struct ds_rect opaque;
+};
+
 struct ds_draw_info {
     union {
         struct ds_draw_area area;
         struct ds_draw_point *point;
     };
-    bool point_num;
+    int point_num;
+    /* point infos, the points of the last commit, to damage only what changed */
+    struct ds_draw_point *point_last;
+    uint8_t layer;
+    /* applied on top of the per pixel transparency */
+    uint8_t alpha;
+    /* what the info covered when it was last damaged */
+    struct ds_rect footprint;
     struct list_head list;
+    /* held by point and area clients while they change them */
     struct mutex lock;
-    uint8_t buf[];
+    struct ds_cmd_list cmd[DS_CMD_LISTS];
+    uint16_t cmd_size;
+    uint8_t cmd_rec;
+    uint8_t cmd_ready;
+    uint8_t cmd_draw;
+    /* cmd_ready was submitted after the server took cmd_draw */
+    bool cmd_fresh;
+    spinlock_t cmd_lock;
+    uint8_t buf[] __aligned(4);
 };
 
 struct display_server;
 
 int ds_set_draw_point_loc(struct display_server *ds, struct ds_draw_info *info, struct ds_draw_point *point, uint16_t x, uint16_t y);
+int ds_commit_draw_info(struct display_server *ds, struct ds_draw_info *info);
+int ds_set_draw_info_layer(struct display_server *ds, struct ds_draw_info *info,
+                           uint8_t layer, uint8_t alpha);
 struct ds_draw_info *display_server_alloc_draw_point_info(struct display_server *ds, int point_num);
 struct ds_draw_info *display_server_alloc_draw_area_info(struct display_server *ds,
                                                          uint16_t x, uint16_t y,
                                                          uint16_t width, uint16_t height);
+struct ds_draw_info *display_server_alloc_draw_area_info_format(struct display_server *ds,
+                                                                uint16_t x, uint16_t y,
+                                                                uint16_t width, uint16_t height,
+                                                                enum ds_pixel_format format,
+                                                                uint8_t flags);
+struct ds_draw_info *display_server_alloc_draw_cmd_info(struct display_server *ds, uint16_t size);
+void ds_cmd_begin(struct ds_draw_info *info);
+int ds_cmd_fill_rect(struct ds_draw_info *info, const struct ds_rect *rect,
+                     const uint8_t color[DS_COLOR_DATA_MAX]);
+int ds_cmd_blit(struct ds_draw_info *info, const struct ds_draw_area *area);
+int ds_cmd_set_pixels(struct ds_draw_info *info, const struct ds_draw_point *point, int num);
+int ds_cmd_text(struct ds_draw_info *info, uint16_t x, uint16_t y,
+                const struct ds_font *font, const uint8_t color[DS_COLOR_DATA_MAX],
+                const char *text);
+int ds_cmd_submit(struct display_server *ds, struct ds_draw_info *info);
 void display_server_free_draw_info(struct display_server *ds, struct ds_draw_info *info);
 static inline struct display_server *display_dev_to_server(struct device *dev)
 {
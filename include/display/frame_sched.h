@@ -0,0 +1,66 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_FRAME_SCHED_H__
+#define __NOS_FRAME_SCHED_H__
+
+#include <kernel/types.h>
+
+#define FRAME_SCHED_FPS_MAX   1000
+/* bucket n of the frame time histogram is [n, n + 1) 1/16 periods, the last is open */
+#define FRAME_SCHED_BUCKETS   64
+#define FRAME_SCHED_BUCKET_DIV 16
+/* fps and the averages are taken over windows of this long */
+#define FRAME_SCHED_WINDOW_US 1000000
+
+struct frame_stats {
+    uint32_t target_fps;
+    /* over the last window, in 1/100 fps */
+    uint32_t fps_x100;
+    uint32_t frames;
+    /* slots skipped because the device still sent the frame before */
+    uint32_t dropped;
+    /* frames that took longer than a period */
+    uint32_t late;
+    /* a frame is compose and flush, from the histogram so a bucket wide */
+    uint32_t frame_p99_us;
+    uint32_t frame_max_us;
+    /* over the last window */
+    uint32_t compose_avg_us;
+    uint32_t flush_avg_us;
+};
+
+/*
+ * Frames start on a grid of absolute deadlines, a frame that runs long
+ * does not move the later ones. One task drives a scheduler.
+ */
+struct frame_sched {
+    uint32_t period_us;
+    u64 deadline;
+    u64 start;
+    u64 composed;
+
+    u64 window_start;
+    uint32_t window_frames;
+    uint32_t window_compose_us;
+    uint32_t window_flush_us;
+    uint32_t hist[FRAME_SCHED_BUCKETS];
+    struct frame_stats stats;
+};
+
+void frame_sched_init(struct frame_sched *fs, uint32_t fps);
+int frame_sched_set_rate(struct frame_sched *fs, uint32_t fps);
+void frame_sched_wait(struct frame_sched *fs);
+void frame_sched_skip(struct frame_sched *fs);
+void frame_sched_composed(struct frame_sched *fs);
+void frame_sched_done(struct frame_sched *fs);
+void frame_sched_get_stats(const struct frame_sched *fs, struct frame_stats *stats);
+void frame_sched_clear_stats(struct frame_sched *fs);
+void frame_sched_dump(const struct frame_sched *fs, const char *name);
+
+#endif
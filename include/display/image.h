@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_IMAGE_H__
+#define __NOS_IMAGE_H__
+
+#include <kernel/types.h>
+#include <kernel/device.h>
+#include <display/display.h>
+
+/*
+ * Bytes a file read. The spi sd card driver is only known to read single
+ * sectors right, so keep it a sector unless the card driver changes.
+ */
+#ifdef CONFIG_IMAGE_CHUNK
+#define IMAGE_CHUNK CONFIG_IMAGE_CHUNK
+#else
+#define IMAGE_CHUNK 512
+#endif
+
+#define IMAGE_MAX_WIDTH 1024
+
+/*
+ * The rle format is a header of "NRLE", the width and the height as little
+ * endian uint16_t, then packets up to the last pixel. A packet starts with
+ * a byte n, below 0x80 n + 1 literal pixels follow, else one pixel follows
+ * that is repeated (n & 0x7f) + 1 times. A pixel is 3 bytes r, g, b and a
+ * packet may go over the end of a row.
+ */
+#define IMAGE_RLE_MAGIC "NRLE"
+
+enum image_type {
+    IMAGE_QOI,
+    IMAGE_RLE,
+};
+
+/*
+ * Decoded rows are handed to a sink top down, in RGB888 in DS_COLOR_*
+ * order. A sink returning < 0 stops the decode.
+ */
+struct image_sink {
+    int (*begin)(struct image_sink *sink, uint16_t width, uint16_t height);
+    int (*line)(struct image_sink *sink, uint16_t y, const uint8_t *pixels, uint16_t width);
+    void (*end)(struct image_sink *sink);
+};
+
+/* rows go to a display device by its write, the part outside it is cut off */
+struct image_dev_sink {
+    struct image_sink sink;
+    struct device *dev;
+    struct display_dev_info info;
+    uint8_t *line;
+};
+
+/* rows go into an RGB888 or RGB565 area info, it is committed at the end */
+struct image_area_sink {
+    struct image_sink sink;
+    struct display_server *ds;
+    struct ds_draw_info *info;
+};
+
+struct image_stats {
+    uint16_t width;
+    uint16_t height;
+    uint32_t bytes;
+    uint32_t total_us;
+    /* the decoder waited for the reader this long */
+    uint32_t read_wait_us;
+    /* the sink took this long */
+    uint32_t sink_us;
+    uint32_t pixels_per_sec;
+    /*
+     * The most kmalloc() bytes in use over the decode, mem_base headers, the
+     * FatFs FIL and the reader stack included, less those in use before it.
+     * Other tasks allocating meanwhile are counted too.
+     */
+    uint32_t peak_ram;
+    /* the deepest the reader task stack went, of IMAGE_READER_STACK */
+    uint32_t reader_stack;
+};
+
+int image_draw_file(const char *path, enum image_type type, struct image_sink *sink,
+                    struct image_stats *stats);
+int image_dev_sink_init(struct image_dev_sink *ds, struct device *dev);
+int image_area_sink_init(struct image_area_sink *as, struct display_server *ds,
+                         struct ds_draw_info *info);
+void image_stats_dump(const struct image_stats *stats, const char *name);
+
+#endif
@@ -9,6 +9,8 @@
 #ifndef __NOS_LED_H__
 #define __NOS_LED_H__
 
+#include <kernel/types.h>
+
 enum color_type {
     COLOR_G = 0,
     COLOR_R,
@@ -21,6 +23,13 @@ enum led_ctrl_cmd {
     LED_CTRL_DISABLE,
     LED_CTRL_GET_ENABLE_STATUS,
     LED_CTRL_REFRESH,
+    /* > 0 while the device has not taken the last refresh yet, clear of enum ds_ctrl_cmd */
+    LED_CTRL_GET_BUSY = 0x10,
+    /* args is a uint8_t, 255 is full, from the next refresh on */
+    LED_CTRL_SET_BRIGHTNESS,
 };
 
+/* 8 bit gamma 2.2 */
+extern const uint8_t led_gamma[256];
+
 #endif
@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_LED_EFFECT_H__
+#define __NOS_LED_EFFECT_H__
+
+#include <kernel/types.h>
+#include <key/key_event.h>
+#include <display/display.h>
+#include <display/frame_sched.h>
+
+#define LED_EFFECT_MAX_PIXELS 128
+#define LED_EFFECT_MAX_KEYS   128
+/* a pixel that is not on a key, only the effect of the pixel is drawn */
+#define LED_EFFECT_NO_KEY     0xff
+/* the rate is not lowered below this for the budget */
+#define LED_EFFECT_FPS_MIN    10
+
+#ifdef CONFIG_LED_EFFECT_FPS
+#define LED_EFFECT_FPS CONFIG_LED_EFFECT_FPS
+#else
+#define LED_EFFECT_FPS 50
+#endif
+
+/* render time a frame may take at LED_EFFECT_FPS */
+#ifdef CONFIG_LED_EFFECT_BUDGET_US
+#define LED_EFFECT_BUDGET_US CONFIG_LED_EFFECT_BUDGET_US
+#else
+#define LED_EFFECT_BUDGET_US 1000
+#endif
+
+enum led_effect_type {
+    LED_EFFECT_OFF = 0,
+    LED_EFFECT_BREATH,
+    LED_EFFECT_WAVE,
+    LED_EFFECT_REACTIVE,
+    LED_EFFECT_GRADIENT,
+    LED_EFFECT_NUM,
+};
+
+/* hue, sat and val are Q8, 256 hues are a turn */
+struct led_effect_param {
+    uint8_t hue;
+    uint8_t sat;
+    uint8_t val;
+    /* a cycle of the effect, for reactive the fade of a press */
+    uint16_t period_ms;
+};
+
+/*
+ * Each pixel has its own effect, a key press lights the pixels of the key
+ * over any of them and fades out. Key events come in through a lock-free
+ * queue, the keyboard task never waits on the effects task.
+ */
+struct led_effect {
+    uint16_t width;
+    uint16_t height;
+    /* key of each pixel, row by row */
+    const uint8_t *key_map;
+    uint8_t effect[LED_EFFECT_MAX_PIXELS];
+    struct led_effect_param param[LED_EFFECT_NUM];
+    /* Q16 level of each key, a press sets it to the top */
+    uint16_t heat[LED_EFFECT_MAX_KEYS];
+    uint32_t last_ms;
+    struct key_event_queue queue;
+
+    struct frame_sched sched;
+    uint32_t fps;
+    uint32_t rate;
+    uint32_t budget_us;
+    /* render time over the last frames, in 1/16 us */
+    uint32_t cost_avg;
+    /* frames the render has fit a higher rate */
+    uint32_t calm;
+};
+
+int led_effect_init(struct led_effect *fx, uint16_t width, uint16_t height,
+                    const uint8_t *key_map, uint32_t fps, uint32_t budget_us);
+int led_effect_set(struct led_effect *fx, const struct ds_rect *rect,
+                   enum led_effect_type type);
+int led_effect_set_param(struct led_effect *fx, enum led_effect_type type,
+                         const struct led_effect_param *param);
+void led_effect_wait(struct led_effect *fx);
+void led_effect_render(struct led_effect *fx, uint8_t *pixels, uint16_t stride);
+void led_effect_done(struct led_effect *fx);
+void led_effect_dump(struct led_effect *fx);
+
+#ifdef CONFIG_LED_EFFECT
+bool led_effect_post(const struct key_event *ev);
+#else
+static inline bool led_effect_post(const struct key_event *ev) { return false; }
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_PIXEL_OPS_H__
+#define __NOS_PIXEL_OPS_H__
+
+#include <kernel/types.h>
+
+/*
+ * Row operations on RGB888 pixels in DS_COLOR_* order. Blend and scale are
+ * byte wise, so they take any byte run. An alpha or scale of 256 is a
+ * plain copy, the result of a byte is d + ((s - d) * alpha >> 8) and
+ * v * scale >> 8 on every cpu.
+ */
+
+/* 1 if blend and scale run on the cortex-m4 dsp simd instructions */
+#if defined(__ARM_FEATURE_DSP)
+#define PIXEL_OPS_SIMD 1
+#else
+#define PIXEL_OPS_SIMD 0
+#endif
+
+#define PIXEL_ALPHA_COPY 256
+
+void pixel_blend(uint8_t *dst, const uint8_t *src, int bytes, uint16_t alpha);
+void pixel_scale(uint8_t *dst, const uint8_t *src, int bytes, uint16_t scale);
+void pixel_fill_rgb888(uint8_t *dst, const uint8_t *color, int num);
+void pixel_blend_color_rgb888(uint8_t *dst, const uint8_t *color, int num, uint16_t alpha);
+void pixel_rgb888_to_rgb565(uint16_t *dst, const uint8_t *src, int num);
+void pixel_rgb565_to_rgb888(uint8_t *dst, const uint16_t *src, int num);
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2024-2024 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_VIRT_FB_H__
+#define __NOS_VIRT_FB_H__
+
+#include <kernel/types.h>
+
+#define VIRT_FB_NAME "virt-fb"
+
+#ifdef CONFIG_VIRT_FB_WIDTH
+#define VIRT_FB_WIDTH CONFIG_VIRT_FB_WIDTH
+#else
+#define VIRT_FB_WIDTH 320
+#endif
+
+#ifdef CONFIG_VIRT_FB_HEIGHT
+#define VIRT_FB_HEIGHT CONFIG_VIRT_FB_HEIGHT
+#else
+#define VIRT_FB_HEIGHT 240
+#endif
+
+/* every this many frames one is dumped, 0 only on VIRT_FB_CTRL_DUMP */
+#ifdef CONFIG_VIRT_FB_DUMP_EVERY
+#define VIRT_FB_DUMP_EVERY CONFIG_VIRT_FB_DUMP_EVERY
+#else
+#define VIRT_FB_DUMP_EVERY 0
+#endif
+
+enum virt_fb_ctrl_cmd {
+    /* struct virt_fb_stats, clear of enum ds_ctrl_cmd and enum led_ctrl_cmd */
+    VIRT_FB_CTRL_GET_STATS = 0x20,
+    VIRT_FB_CTRL_CLEAR_STATS,
+    /* the frame of the next refresh is dumped */
+    VIRT_FB_CTRL_DUMP,
+};
+
+/* a frame is what was written up to a LED_CTRL_REFRESH */
+struct virt_fb_stats {
+    uint32_t frames;
+    uint32_t writes;
+    /* pixels written in the frame so far, a pixel written twice counts twice */
+    uint32_t frame_pixels;
+    uint32_t last_pixels;
+    uint32_t max_pixels;
+    u64 total_pixels;
+    /* frames with nothing written */
+    uint32_t empty;
+    uint32_t dumps;
+};
+
+#endif
@@ -23,6 +23,8 @@ __init void cpu_init(void);
 void system_heartbeat_process(void);
 u64 cpu_run_ticks(void);
 u64 cpu_run_time_us(void);
+u32 cpu_cycles(void);
+u32 cpu_cycles_to_ns(u32 cycles);
 void cpu_reboot(u32 flag);
 void cpu_delay_ns(u32 ns);
 void cpu_delay_us(u32 us);
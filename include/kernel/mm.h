@@ -106,6 +106,9 @@ void mm_block_dump(void);
 struct memblock *find_block(void *addr);
 struct mem_base *find_base(struct memblock *block, void *addr);
 size_t mm_block_free_size(void);
+size_t mm_block_used_size(void);
+size_t mm_block_peak_size(void);
+void mm_block_peak_reset(void);
 
 #define ALIGNED(addr, align) (((addr) + (align) - 1) & ~((align) - 1))
 #define ALIGNED_PAGE(addr) ALIGNED(addr, CONFIG_PAGE_SIZE)
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_DEBOUNCE_H__
+#define __NOS_DEBOUNCE_H__
+
+#include <kernel/types.h>
+
+#define DEBOUNCE_MAX_KEYS  64
+#define DEBOUNCE_MAX_WORDS (DEBOUNCE_MAX_KEYS / 32)
+/* per key counters are bit-sliced, plane n holds bit n of every counter */
+#define DEBOUNCE_CNT_BITS  8
+#define DEBOUNCE_CNT_MAX   ((1 << DEBOUNCE_CNT_BITS) - 1)
+
+enum debounce_type {
+    /* report a change after the key is stable for the lockout time */
+    DEBOUNCE_SYM_DEFER,
+    /* report an edge at once, then ignore the key for the lockout time */
+    DEBOUNCE_EAGER,
+    /* report a press at once, a release after it is stable for the lockout time */
+    DEBOUNCE_ASYM,
+};
+
+#if defined(CONFIG_KEY_DEBOUNCE_SYM_DEFER)
+#define DEBOUNCE_DEF_TYPE DEBOUNCE_SYM_DEFER
+#elif defined(CONFIG_KEY_DEBOUNCE_ASYM)
+#define DEBOUNCE_DEF_TYPE DEBOUNCE_ASYM
+#else
+#define DEBOUNCE_DEF_TYPE DEBOUNCE_EAGER
+#endif
+
+#ifdef CONFIG_KEY_DEBOUNCE_MS
+#define DEBOUNCE_DEF_MS CONFIG_KEY_DEBOUNCE_MS
+#else
+#define DEBOUNCE_DEF_MS 5
+#endif
+
+struct debounce {
+    enum debounce_type type;
+    uint8_t words;
+    uint8_t lockout;
+    uint32_t state[DEBOUNCE_MAX_WORDS];
+    uint32_t last[DEBOUNCE_MAX_WORDS];
+    uint32_t cnt[DEBOUNCE_CNT_BITS][DEBOUNCE_MAX_WORDS];
+};
+
+int debounce_init(struct debounce *db, enum debounce_type type, int keys,
+                  uint32_t lockout_ms, uint32_t scan_hz);
+bool debounce_update(struct debounce *db, const uint32_t *raw, uint32_t *state);
+
+#endif
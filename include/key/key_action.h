@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_KEY_ACTION_H__
+#define __NOS_KEY_ACTION_H__
+
+#include <kernel/types.h>
+#include <key/key_event.h>
+
+/* a tap-hold key released before this is a tap */
+#ifdef CONFIG_KEY_ACTION_HOLD_MS
+#define KEY_ACTION_HOLD_MS CONFIG_KEY_ACTION_HOLD_MS
+#else
+#define KEY_ACTION_HOLD_MS 200
+#endif
+/* shortest macro step, the host must see every step in its own report */
+#define KEY_MACRO_MIN_MS   10
+/* macros started while one is playing wait for it */
+#define KEY_MACRO_QUEUE    4
+
+struct key_macro_step {
+    uint8_t code;
+    bool down;
+    /* wait after this step */
+    uint16_t delay_ms;
+};
+
+#define KEY_MACRO_TAP(code, ms) { code, true, ms }, { code, false, ms }
+
+int key_action_init(void);
+bool key_action_post(const struct key_event *ev);
+int key_action_macro_play(const struct key_macro_step *steps, int num);
+u32 key_action_seq(void);
+u32 key_action_output(uint32_t *keys, uint8_t *mods);
+
+#endif
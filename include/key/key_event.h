@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_KEY_EVENT_H__
+#define __NOS_KEY_EVENT_H__
+
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+#include <asm/barrier.h>
+
+/* must be a power of 2 */
+#define KEY_EVENT_QUEUE_SIZE 32
+#define KEY_EVENT_QUEUE_MASK (KEY_EVENT_QUEUE_SIZE - 1)
+
+struct key_event {
+    /* cpu_run_time_us() of the scan that saw the change */
+    uint32_t time_us;
+    uint8_t key;
+    uint8_t code;
+    uint8_t action;
+    bool down;
+};
+
+/*
+ * Single producer, single consumer ring, no lock and no irq masking. Only
+ * the producer writes head and only the consumer writes tail, the barriers
+ * keep the slot and the index stores in order.
+ */
+struct key_event_queue {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    struct key_event buf[KEY_EVENT_QUEUE_SIZE];
+};
+
+static inline void key_event_queue_init(struct key_event_queue *q)
+{
+    q->head = 0;
+    q->tail = 0;
+    q->dropped = 0;
+}
+
+/* producer side, returns false and counts a drop if the queue is full */
+static inline bool key_event_push(struct key_event_queue *q, const struct key_event *ev)
+{
+    uint32_t head = q->head;
+
+    if (head - READ_ONCE(q->tail) >= KEY_EVENT_QUEUE_SIZE) {
+        q->dropped++;
+        return false;
+    }
+
+    q->buf[head & KEY_EVENT_QUEUE_MASK] = *ev;
+    smp_wmb();
+    WRITE_ONCE(q->head, head + 1);
+
+    return true;
+}
+
+/* consumer side, returns false if the queue is empty */
+static inline bool key_event_pop(struct key_event_queue *q, struct key_event *ev)
+{
+    uint32_t tail = q->tail;
+
+    if (READ_ONCE(q->head) == tail)
+        return false;
+
+    smp_rmb();
+    *ev = q->buf[tail & KEY_EVENT_QUEUE_MASK];
+    smp_mb();
+    WRITE_ONCE(q->tail, tail + 1);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_KEYMAP_H__
+#define __NOS_KEYMAP_H__
+
+#include <kernel/types.h>
+
+#define KEYMAP_MAX_KEYS   128
+#define KEYMAP_MAX_WORDS  (KEYMAP_MAX_KEYS / 32)
+#define KEYMAP_MAX_LAYERS 8
+
+enum keymap_layer_mode {
+    /* the layer is active while the key is held */
+    KEYMAP_LAYER_MOMENTARY,
+    /* every press switches the layer on or off */
+    KEYMAP_LAYER_TOGGLE,
+};
+
+struct keymap_event {
+    uint8_t key;
+    uint8_t code;
+    uint8_t action;
+    bool down;
+};
+
+/*
+ * code and action are [layers][keys] tables, as built by KEYMAP() and
+ * ACTION_MAP(). Layer keys always resolve on layer 0, any other key keeps
+ * the code of the layer it was pressed on until it is released.
+ */
+struct keymap {
+    const uint8_t *code;
+    const uint8_t *action;
+    uint8_t layers;
+    uint8_t keys;
+    uint8_t words;
+
+    /* active layers, the last one is on top, layer 0 is always below */
+    uint8_t stack[KEYMAP_MAX_LAYERS];
+    uint8_t depth;
+
+    uint32_t layer_keys[KEYMAP_MAX_WORDS];
+    uint32_t momentary[KEYMAP_MAX_LAYERS][KEYMAP_MAX_WORDS];
+    uint32_t toggle[KEYMAP_MAX_LAYERS][KEYMAP_MAX_WORDS];
+
+    uint32_t prev[KEYMAP_MAX_WORDS];
+    uint8_t down_code[KEYMAP_MAX_KEYS];
+    uint8_t down_action[KEYMAP_MAX_KEYS];
+};
+
+int keymap_init(struct keymap *km, const uint8_t *code, const uint8_t *action,
+                int layers, int keys);
+int keymap_set_layer_key(struct keymap *km, int key, int layer,
+                         enum keymap_layer_mode mode);
+int keymap_update(struct keymap *km, const uint32_t *raw,
+                  struct keymap_event *event, int max);
+
+static inline int keymap_layer(const struct keymap *km)
+{
+    return km->depth ? km->stack[km->depth - 1] : 0;
+}
+
+#endif
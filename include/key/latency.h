@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_KEY_LATENCY_H__
+#define __NOS_KEY_LATENCY_H__
+
+#include <kernel/types.h>
+
+#define KEY_LAT_MAX_WORDS 4
+/* bin 0 is < 1us, bin n is [2^(n-1), 2^n) us, the last bin is open */
+#define KEY_LAT_HIST_BINS 16
+/* a sample not finished in this time is counted as lost */
+#define KEY_LAT_TIMEOUT_MS 200
+
+/* each stage is timed from the one before it, scan from the raw change */
+enum key_lat_stage {
+    KEY_LAT_SCAN,
+    KEY_LAT_INFO,
+    KEY_LAT_REPORT,
+    KEY_LAT_USB_IN,
+    KEY_LAT_STAGE_NUM,
+};
+
+/* sent to the host as is, every field is naturally aligned */
+struct key_lat_stat {
+    uint64_t total_ns;
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t max_ns;
+    uint32_t reserve;
+    uint32_t hist[KEY_LAT_HIST_BINS];
+};
+
+struct key_lat_report {
+    uint32_t samples;
+    uint32_t lost;
+    struct key_lat_stat stage[KEY_LAT_STAGE_NUM];
+    struct key_lat_stat total;
+};
+
+#ifdef CONFIG_KEY_LATENCY
+void key_latency_scan(uint32_t *raw, int words, u32 cycles);
+void key_latency_stamp(enum key_lat_stage stage);
+void key_latency_finish(void);
+void key_latency_cancel(void);
+void key_latency_settle(void);
+void key_latency_in_done(uint8_t report_id, bool last);
+void key_latency_inject(int key, uint32_t period_ms);
+void key_latency_get(struct key_lat_report *report);
+void key_latency_clear(void);
+void key_latency_dump(void);
+#else
+static inline void key_latency_scan(uint32_t *raw, int words, u32 cycles) {}
+static inline void key_latency_stamp(enum key_lat_stage stage) {}
+static inline void key_latency_finish(void) {}
+static inline void key_latency_cancel(void) {}
+static inline void key_latency_settle(void) {}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2023-2023 胡启航<Nick Hu>
+ *
+ * Author: 胡启航<Nick Hu>
+ *
+ * Email: huqihan@live.com
+ */
+
+#ifndef __NOS_MATRIX_KBD_H__
+#define __NOS_MATRIX_KBD_H__
+
+#include <kernel/types.h>
+#include <kernel/task.h>
+#include <kernel/device.h>
+#include <usb/usb_common.h>
+#include <key/debounce.h>
+#include <key/keymap.h>
+
+#define MATRIX_KBD_MAX_POS   128
+#define MATRIX_KBD_POS_WORDS (MATRIX_KBD_MAX_POS / 32)
+
+struct matrix_kbd;
+
+/* what a board provides, the core does the rest */
+struct matrix_kbd_ops {
+    /* gpio and scan hardware init, called before the task starts */
+    int (*init)(struct matrix_kbd *kbd);
+    /*
+     * Wait for the next matrix snapshot and store it as scan bits, a set
+     * bit is a pressed key. Returns the cycle counter when it was sampled.
+     */
+    u32 (*scan)(struct matrix_kbd *kbd, uint32_t *bits);
+};
+
+struct matrix_kbd {
+    /* filled by the board */
+    const char *name;
+    const struct matrix_kbd_ops *ops;
+    /* scan bit n is key position[n], -1 for an unused bit, NULL if the scan bits are key indexes */
+    const int8_t *position;
+    int positions;
+    int keys;
+    int layers;
+    /* [layers][keys] tables from KEYMAP() and ACTION_MAP() */
+    const uint8_t *code;
+    const uint8_t *action;
+    uint32_t scan_hz;
+    uint8_t prio;
+    uint32_t stack_size;
+    void *priv;
+
+    /* owned by the core */
+    struct task_struct *task;
+    struct device *hid_dev;
+    struct debounce db;
+    struct keymap keymap;
+    uint32_t bits[MATRIX_KBD_POS_WORDS];
+    uint32_t raw[KEYMAP_MAX_WORDS];
+    uint32_t state[KEYMAP_MAX_WORDS];
+    struct keymap_event event[KEYMAP_MAX_KEYS];
+    struct hid_nkro_report report;
+    /* key_action_seq() of the action keys in report */
+    u32 action_seq;
+};
+
+int matrix_kbd_register(struct matrix_kbd *kbd);
+
+#endif
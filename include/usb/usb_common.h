@@ -207,6 +207,10 @@
 #define HID_REPORT_ID_MEDIA             4
 #define HID_REPORT_ID_GENERAL           5
 #define HID_REPORT_ID_MOUSE             6
+#define HID_REPORT_ID_NKRO              8
+
+#define HID_PROTOCOL_BOOT               0
+#define HID_PROTOCOL_REPORT             1
 
 /*
  * Time of usb timeout
@@ -475,6 +479,41 @@ struct hid_report
 typedef struct hid_report* hid_report_t;
 extern void HID_Report_Received(hid_report_t report);
 
+/*
+ * N-key rollover report: the modifier byte followed by one bit per usage
+ * 0x00 - 0xdf, bit n of word w is usage w * 32 + n on a little endian cpu.
+ */
+#define HID_NKRO_BITMAP_WORDS           7
+#define HID_NKRO_USAGE_MAX              (HID_NKRO_BITMAP_WORDS * 32 - 1)
+
+struct hid_nkro_report {
+    uint8_t mods;
+    uint8_t bitmap[HID_NKRO_BITMAP_WORDS * 4];
+} __packed;
+
+/* control commands of the "hidd" device */
+enum hid_ctrl_cmd {
+    HID_CTRL_GET_STATS,
+    HID_CTRL_CLR_STATS,
+    HID_CTRL_SET_IN_DONE,
+};
+
+/*
+ * Called from the in completion with the report id that was sent, last is
+ * true when no newer report of that id is queued behind it.
+ */
+typedef void (*hid_in_done_t)(uint8_t report_id, bool last);
+
+/* in report counters, latency is from the first write to the in completion */
+struct hid_report_stats {
+    uint32_t sent;
+    uint32_t coalesced;
+    uint32_t dropped;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;
+};
+
 struct urequest
 {
     uint8_t  request_type;
@@ -12,6 +12,9 @@
 #include <kernel/kernel.h>
 #include <kernel/mm.h>
 #include <kernel/device.h>
+#include <kernel/sem.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <string.h>
 #include <usb/usb_common.h>
 
@@ -32,6 +35,15 @@
 #define USB_BCD_VERSION             0x0200   /* USB 2.0 */
 #define EP0_IN_ADDR                 0x80
 #define EP0_OUT_ADDR                0x00
+/* Max interface number of the lookup table */
+#ifdef CONFIG_USB_MAX_INTERFACES
+#define USB_MAX_INTERFACES          CONFIG_USB_MAX_INTERFACES
+#else
+#define USB_MAX_INTERFACES          8
+#endif
+/* 16 OUT endpoints followed by 16 IN endpoints */
+#define USB_EP_TABLE_SIZE           32
+#define USB_EP_TABLE_INDEX(addr)    ((((addr) & USB_DIR_MASK) >> 3) | ((addr) & USB_EP_DESC_NUM_MASK))
 #define EP_HANDLER(ep, func, size) \
     do { \
         /* WK_ERROR(ep != NULL); */ \
@@ -59,6 +71,7 @@
 struct ufunction;
 struct udevice;
 struct uendpoint;
+struct ustream;
 
 typedef enum
 {
@@ -118,6 +131,7 @@ struct uendpoint
     struct ep_id *id;
     udep_handler_t handler;
     int (*rx_indicate)(struct udevice* dev, size_t size);
+    struct ustream* stream;
 };
 typedef struct uendpoint* uep_t;
 
@@ -148,6 +162,7 @@ typedef int (*uintf_handler_t)(struct ufunction* func, ureq_t setup);
 struct uinterface
 {
     struct list_head list;
+    struct udevice* device;
     uint8_t intf_num;
     ualtsetting_t curr_setting;
     struct list_head setting_list;
@@ -184,6 +199,29 @@ struct uconfig
 };
 typedef struct uconfig* uconfig_t;
 
+struct ulookup_ep
+{
+    uep_t ep;
+    ufunction_t func;
+};
+
+/* what the data events of one endpoint cost, kept for app/usb_bench.c */
+struct usbd_dispatch_stat
+{
+    uint32_t count;
+    uint32_t notify_max;
+    /* _data_notify(): lookup, request bookkeeping and the class handler */
+    uint64_t notify_total;
+    /* from the dcd irq signalling the event to the end of _data_notify() */
+    uint64_t event_total;
+};
+
+struct ulookup_intf
+{
+    uintf_t intf;
+    ufunction_t func;
+};
+
 struct udevice
 {
     struct list_head list;
@@ -198,10 +236,39 @@ struct udevice
     uconfig_t curr_cfg;
     uint8_t nr_intf;
 
+    /* active endpoints and interfaces of curr_cfg, rebuilt on set config/altsetting */
+    struct ulookup_ep ep_table[USB_EP_TABLE_SIZE];
+    struct ulookup_intf intf_table[USB_MAX_INTERFACES];
+#ifdef CONFIG_USB_BENCH
+    /* in cpu cycles, indexed like ep_table */
+    struct usbd_dispatch_stat dispatch[USB_EP_TABLE_SIZE];
+#endif
+
     udcd_t dcd;
 };
 typedef struct udevice* udevice_t;
 
+/* ping-pong packet buffers of a bulk in stream */
+#define USTREAM_NR_BUF              2
+
+struct ustream
+{
+    struct udevice* device;
+    uep_t ep;
+    uint16_t maxpacket;
+    uint8_t* buf[USTREAM_NR_BUF];
+    uint16_t len[USTREAM_NR_BUF];
+    uint8_t head;
+    uint8_t tail;
+    uint8_t queued;
+    bool busy;
+    bool waiting;
+    spinlock_t lock;
+    sem_t space;
+    struct mutex write_lock;
+};
+typedef struct ustream* ustream_t;
+
 struct udclass
 {
     struct list_head list;
@@ -230,6 +297,9 @@ struct ep_msg
 {
     size_t size;
     uint8_t ep_addr;
+#ifdef CONFIG_USB_BENCH
+    u32 cycles;
+#endif
 };
 
 struct udev_msg
@@ -275,9 +345,18 @@ int usbd_set_altsetting(uintf_t intf, uint8_t value);
 udevice_t usbd_find_device(udcd_t dcd);
 uconfig_t usbd_find_config(udevice_t device, uint8_t value);
 uintf_t usbd_find_interface(udevice_t device, uint8_t value, ufunction_t *pfunc);
+ualtsetting_t usbd_find_altsetting(uintf_t intf, uint8_t value);
 uep_t usbd_find_endpoint(udevice_t device, ufunction_t* pfunc, uint8_t ep_addr);
 size_t usbd_io_request(udevice_t device, uep_t ep, uio_request_t req);
 size_t usbd_ep0_write(udevice_t device, void *buffer, size_t size);
+
+int usbd_stream_init(ustream_t stream, udevice_t device, uep_t ep);
+void usbd_stream_reset(ustream_t stream);
+ssize_t usbd_stream_write(ustream_t stream, const void *buffer, size_t size,
+                          bool zlp, uint32_t tick);
+int usbd_stream_flush(ustream_t stream, uint32_t tick);
+void usbd_stream_complete(ustream_t stream);
+void usbd_stream_resume(ustream_t stream);
 size_t usbd_ep0_read(udevice_t device, void *buffer, size_t size,
     int (*rx_ind)(udevice_t device, size_t size));
 
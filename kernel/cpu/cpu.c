@@ -52,6 +52,22 @@ u64 cpu_run_time_us(void)
     return asm_cpu_run_time_us();
 }
 
+/**
+ * This function will return the free running cpu cycle counter, it wraps
+ * around, only the difference of two reads is meaningful.
+ *
+ * @return the cycle count.
+ */
+u32 cpu_cycles(void)
+{
+    return asm_cpu_cycles();
+}
+
+u32 cpu_cycles_to_ns(u32 cycles)
+{
+    return (u32)((u64)cycles * 1000 / asm_cpu_cycles_per_us());
+}
+
 void cpu_reboot(u32 flag)
 {
     write_boot_flag(flag);
@@ -14,6 +14,24 @@
 
 static LIST_HEAD(g_memblock_list);
 static SPINLOCK(g_memblock_lock);
+/* bytes of the used mem_base, headers included, and their high water mark */
+static size_t g_memblock_used;
+static size_t g_memblock_peak;
+
+static void memblock_account(struct mem_base *base, bool alloc)
+{
+    size_t size = base->size + sizeof(struct mem_base);
+
+    spin_lock_irq(&g_memblock_lock);
+    if (alloc) {
+        g_memblock_used += size;
+        if (g_memblock_used > g_memblock_peak)
+            g_memblock_peak = g_memblock_used;
+    } else {
+        g_memblock_used -= size;
+    }
+    spin_unlock_irq(&g_memblock_lock);
+}
 
 static int memblock_init(struct memblock *block)
 {
@@ -148,6 +166,7 @@ recheck_memblock:
     }
     addr = ((addr_t)base) + sizeof(struct mem_base);
     if ((base->size) - size <= sizeof(struct mem_base)) {
+        memblock_account(base, true);
         if (!recheck) {
         return (void *)addr;
         } else {
@@ -164,6 +183,7 @@ recheck_memblock:
     base->size = size;
     new->used = false;
     recheck = true;
+    memblock_account(base, true);
 
     spin_lock_irq(&block->lock);
     list_add(&new->list, &base->list);
@@ -185,6 +205,9 @@ static int __kfree_base(struct memblock *block, struct mem_base *base)
 {
     struct mem_base *new;
 
+    if (base->used)
+        memblock_account(base, false);
+
     spin_lock_irq(&block->lock);
     if (base->list.prev != &block->base) {
         new = list_prev_entry(base, list);
@@ -365,3 +388,22 @@ size_t mm_block_free_size(void)
 
     return size;
 }
+
+/* the bytes kmalloc() hands out now, with the mem_base of each */
+size_t mm_block_used_size(void)
+{
+    return READ_ONCE(g_memblock_used);
+}
+
+/* the most mm_block_used_size() was since the last mm_block_peak_reset() */
+size_t mm_block_peak_size(void)
+{
+    return READ_ONCE(g_memblock_peak);
+}
+
+void mm_block_peak_reset(void)
+{
+    spin_lock_irq(&g_memblock_lock);
+    g_memblock_peak = g_memblock_used;
+    spin_unlock_irq(&g_memblock_lock);
+}
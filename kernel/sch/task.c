@@ -448,7 +448,8 @@ static bool task_stack_check(struct task_struct *task)
 #endif
 }
 
-static size_t task_get_stack_max_used(struct task_struct *task)
+/* the deepest the stack has been, from the '#' fill, 0 if it overflowed */
+size_t task_get_stack_max_used(struct task_struct *task)
 {
     size_t used, i;
     addr_t addr;
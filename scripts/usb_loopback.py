@@ -0,0 +1,40 @@
+# Host side of app/usb_loopback.c, measure the winusb bulk throughput.
+# usage: python3 scripts/usb_loopback.py [total_kbytes]
+import os
+import sys
+import time
+import usb.core
+import usb.util
+
+VENDOR_ID = 0x0EFF
+PRODUCT_ID = 0x0001
+BLOCK = 1024
+
+total = int(sys.argv[1]) * 1024 if len(sys.argv) > 1 else 1024 * 1024
+
+dev = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+if dev is None:
+    print("device not found")
+    exit(-1)
+
+cfg = dev.get_active_configuration()
+intf = usb.util.find_descriptor(cfg, bInterfaceClass=0xFF)
+ep_out = usb.util.find_descriptor(intf, custom_match=lambda e: \
+    usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_OUT)
+ep_in = usb.util.find_descriptor(intf, custom_match=lambda e: \
+    usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+
+blocks = total // BLOCK
+sent = 0
+start = time.time()
+for i in range(blocks):
+    data = os.urandom(BLOCK)
+    ep_out.write(data, timeout=1000)
+    echo = ep_in.read(BLOCK, timeout=1000)
+    if bytes(echo) != data:
+        print("mismatch at block %d" % i)
+        exit(-1)
+    sent += BLOCK
+cost = time.time() - start
+
+print("%d bytes in %.3fs, %.1f KB/s each way" % (sent, cost, sent / cost / 1024))